@@ -0,0 +1,112 @@
+#!/bin/bash
+# Writes a synthetic translation unit of the given kind and scale to stdout.
+# Each kind stresses a different part of the compiler:
+#   funcs   many small functions with locals, loops and calls
+#   inits   large initialised global tables, structs and strings
+#   exprs   deeply nested arithmetic expressions
+#   types   many typedefs and structs, and functions using them
+#   switch  functions with giant switch statements
+# The code uses no headers, so it compiles the same anywhere.
+
+set -euo pipefail
+
+if [ $# -ne 2 ]; then
+  echo "usage: $0 funcs|inits|exprs|types|switch <n>" >&2
+  exit 1
+fi
+
+kind=$1
+n=$2
+
+case $kind in
+funcs)
+  awk -v n="$n" 'BEGIN {
+    for (i = 0; i < n; i++) {
+      printf "int f%d(int a, int b) {\n", i
+      printf "  int s = 0;\n"
+      printf "  for (int i = 0; i < a; i++) {\n"
+      printf "    if (i %% 3 == 0)\n"
+      printf "      s += i * b;\n"
+      printf "    else\n"
+      printf "      s -= i + %d;\n", i
+      printf "  }\n"
+      if (i > 0) {
+        printf "  return s + f%d(a - 1, b);\n", i - 1
+      } else {
+        printf "  return s;\n"
+      }
+      printf "}\n\n"
+    }
+  }'
+  ;;
+inits)
+  awk -v n="$n" 'BEGIN {
+    printf "int table[%d] = {\n", n * 16
+    for (i = 0; i < n * 16; i++) {
+      printf "  %d,%s", (i * 2654435761) % 65536, i % 8 == 7 ? "\n" : ""
+    }
+    printf "};\n\n"
+    printf "struct entry { char *name; int id; long mask; char tag[8]; };\n"
+    printf "struct entry entries[] = {\n"
+    for (i = 0; i < n; i++) {
+      printf "  {\"entry_%d\", %d, %dL, \"t%d\"},\n", i, i, i * 7919, i % 1000
+    }
+    printf "};\n\n"
+    printf "char *messages[] = {\n"
+    for (i = 0; i < n; i++) {
+      printf "  \"message number %d: something happened\",\n", i % 97
+    }
+    printf "};\n\n"
+    printf "int zeros[%d];\n", n * 64
+    printf "int sparse[%d] = {1, 2, 3};\n", n * 64
+  }'
+  ;;
+exprs)
+  awk -v n="$n" 'BEGIN {
+    ops[0] = "+"; ops[1] = "-"; ops[2] = "*"; ops[3] = "^"; ops[4] = "|"
+    for (i = 0; i < n; i++) {
+      printf "long e%d(long a, long b, long c) {\n  return ", i
+      depth = 64
+      for (d = 0; d < depth; d++) {
+        printf "("
+      }
+      printf "a"
+      for (d = 0; d < depth; d++) {
+        v = (d % 3 == 0) ? "b" : (d % 3 == 1) ? "c" : (d + i) ""
+        printf " %s %s)", ops[(d + i) % 5], v
+      }
+      printf ";\n}\n\n"
+    }
+  }'
+  ;;
+types)
+  awk -v n="$n" 'BEGIN {
+    for (i = 0; i < n; i++) {
+      printf "typedef struct S%d {\n", i
+      printf "  int a;\n  long b;\n  char c[%d];\n", i % 13 + 1
+      if (i > 0) {
+        printf "  struct S%d *prev;\n  T%d inner;\n", i - 1, i - 1
+      }
+      printf "} T%d;\n", i
+      printf "typedef T%d *P%d;\n", i, i
+      printf "long use%d(P%d p) { return p->a + p->b + sizeof(T%d); }\n\n", i, i, i
+    }
+  }'
+  ;;
+switch)
+  awk -v n="$n" 'BEGIN {
+    for (f = 0; f < 8; f++) {
+      printf "int sw%d(int x) {\n  switch (x) {\n", f
+      for (i = 0; i < n; i++) {
+        key = f % 2 ? i * 7 : i
+        printf "  case %d:\n    return %d;\n", key, (i * 31 + f) % 1000
+      }
+      printf "  default:\n    return -1;\n  }\n}\n\n"
+    }
+  }'
+  ;;
+*)
+  echo "unknown kind: $kind" >&2
+  exit 1
+  ;;
+esac
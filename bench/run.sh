@@ -0,0 +1,73 @@
+#!/bin/bash
+# Measures compile throughput over the synthetic corpus written by gen.sh.
+# Every corpus file is compiled with -c --ftime-report by each compiler given,
+# a few times over, and the run with the least total wall-clock time is kept.
+# One tab-separated row per compiler, file and stage is written to
+# <out-dir>/results.tsv, and a readable summary to stdout.
+#
+# usage: run.sh <out-dir> <ucc>...
+#   BENCH_SCALE   multiplies the size of every corpus file (default 1)
+#   BENCH_REPEAT  runs per compiler and file (default 3)
+
+set -euo pipefail
+
+if [ $# -lt 2 ]; then
+  echo "usage: $0 <out-dir> <ucc>..." >&2
+  exit 1
+fi
+
+out=$1
+shift
+scale=${BENCH_SCALE:-1}
+repeat=${BENCH_REPEAT:-3}
+here=$(dirname "$0")
+export ASAN_OPTIONS=detect_leaks=0
+
+declare -A sizes=([funcs]=4000 [inits]=4000 [exprs]=2000 [types]=1000
+  [switch]=2000)
+
+mkdir -p "$out"
+for kind in funcs inits exprs types switch; do
+  "$here/gen.sh" "$kind" $((sizes[$kind] * scale)) > "$out/$kind.c"
+done
+
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+date=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+results=$out/results.tsv
+printf "commit\tdate\tcompiler\tfile\tlines\tstage\twall_ms\tcpu_ms\tlines_per_s\tpeak_rss_kib\n" > "$results"
+
+for ucc in "$@"; do
+  for kind in funcs inits exprs types switch; do
+    src=$out/$kind.c
+    lines=$(wc -l < "$src")
+    best=
+    best_ms=
+    for ((r = 0; r < repeat; r++)); do
+      report=$("$ucc" -c --ftime-report -o "$out/$kind.o" "$src" 2>&1)
+      ms=$(awk '$1 == "total" { print $2 }' <<< "$report")
+      if [ -z "$best" ] || awk -v a="$ms" -v b="$best_ms" 'BEGIN { exit !(a < b) }'; then
+        best=$report
+        best_ms=$ms
+      fi
+    done
+    awk -v commit="$commit" -v date="$date" -v ucc="$ucc" -v file="$kind" \
+      -v lines="$lines" '
+      NF == 4 && $2 ~ /^[0-9.]+$/ {
+        lps = $2 > 0 ? lines / ($2 / 1000) : 0
+        printf "%s\t%s\t%s\t%s\t%d\t%s\t%s\t%s\t%.0f\t%s\n", commit, date, ucc,
+               file, lines, $1, $2, $3, lps, $4
+      }' <<< "$best" >> "$results"
+  done
+done
+
+awk -F '\t' '
+  NR == 1 { next }
+  $3 != ucc {
+    ucc = $3
+    printf "\n%s\n%-8s %-10s %10s %12s %14s\n", ucc, "file", "stage", "wall (ms)",
+           "lines/s", "peak rss (KiB)"
+  }
+  { printf "%-8s %-10s %10s %12s %14s\n", $4, $6, $7, $9, $10 }
+' "$results"
+echo
+echo "results written to $results"
@@ -0,0 +1,40 @@
+// Table-driven CRC-32 over a pseudo-random buffer.
+int printf(char *fmt, ...);
+
+enum { LEN = 1 << 20, ROUNDS = 40 };
+
+unsigned int table[256];
+unsigned char buf[LEN];
+
+void makeTable(void) {
+  for (unsigned int i = 0; i < 256; i++) {
+    unsigned int c = i;
+    for (int k = 0; k < 8; k++) {
+      c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+    }
+    table[i] = c;
+  }
+}
+
+unsigned int crc32(unsigned char *p, long len, unsigned int crc) {
+  crc = ~crc;
+  for (long i = 0; i < len; i++) {
+    crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+int main(void) {
+  makeTable();
+  unsigned int seed = 12345;
+  for (long i = 0; i < LEN; i++) {
+    seed = seed * 1103515245 + 12345;
+    buf[i] = seed >> 16;
+  }
+  unsigned int crc = 0;
+  for (int r = 0; r < ROUNDS; r++) {
+    crc = crc32(buf, LEN, crc);
+  }
+  printf("%u\n", crc);
+  return 0;
+}
@@ -0,0 +1,94 @@
+// A stack-based bytecode interpreter dispatching on a switch.
+int printf(char *fmt, ...);
+
+enum {
+  OP_PUSH,
+  OP_LOAD,
+  OP_STORE,
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_MOD,
+  OP_XOR,
+  OP_DUP,
+  OP_POP,
+  OP_JNZ,
+  OP_JMP,
+  OP_HALT,
+};
+
+long run(int *code, long *vars) {
+  long stack[64];
+  int sp = 0;
+  int pc = 0;
+  for (;;) {
+    switch (code[pc++]) {
+    case OP_PUSH:
+      stack[sp++] = code[pc++];
+      break;
+    case OP_LOAD:
+      stack[sp++] = vars[code[pc++]];
+      break;
+    case OP_STORE:
+      vars[code[pc++]] = stack[--sp];
+      break;
+    case OP_ADD:
+      sp--;
+      stack[sp - 1] += stack[sp];
+      break;
+    case OP_SUB:
+      sp--;
+      stack[sp - 1] -= stack[sp];
+      break;
+    case OP_MUL:
+      sp--;
+      stack[sp - 1] *= stack[sp];
+      break;
+    case OP_MOD:
+      sp--;
+      stack[sp - 1] %= stack[sp];
+      break;
+    case OP_XOR:
+      sp--;
+      stack[sp - 1] ^= stack[sp];
+      break;
+    case OP_DUP:
+      stack[sp] = stack[sp - 1];
+      sp++;
+      break;
+    case OP_POP:
+      sp--;
+      break;
+    case OP_JNZ:
+      if (stack[--sp]) {
+        pc = code[pc];
+      } else {
+        pc++;
+      }
+      break;
+    case OP_JMP:
+      pc = code[pc];
+      break;
+    case OP_HALT:
+      return vars[1];
+    }
+  }
+}
+
+int main(void) {
+  // i = 8000000; acc = 0;
+  // do { acc = (acc * 31 + (i ^ acc)) % 1000003; i = i - 1; } while (i);
+  int code[] = {
+      OP_PUSH, 8000000, OP_STORE, 0,
+      OP_PUSH, 0, OP_STORE, 1,
+      // loop: 8
+      OP_LOAD, 1, OP_PUSH, 31, OP_MUL, OP_LOAD, 0, OP_LOAD, 1, OP_XOR,
+      OP_ADD, OP_PUSH, 1000003, OP_MOD, OP_STORE, 1,
+      OP_LOAD, 0, OP_PUSH, 1, OP_SUB, OP_DUP, OP_STORE, 0,
+      OP_JNZ, 8,
+      OP_HALT,
+  };
+  long vars[2] = {0, 0};
+  printf("%ld\n", run(code, vars));
+  return 0;
+}
@@ -0,0 +1,51 @@
+// Walks of a linked list of structs whose nodes are scattered in memory.
+int printf(char *fmt, ...);
+void *malloc(long size);
+
+enum { NODES = 200000, ROUNDS = 100 };
+
+typedef struct Node Node;
+struct Node {
+  Node *next;
+  long key;
+  int weight;
+  char tag;
+  double score;
+};
+
+int main(void) {
+  Node *pool = malloc(NODES * sizeof(Node));
+  long *order = malloc(NODES * sizeof(long));
+  for (long i = 0; i < NODES; i++) {
+    order[i] = i;
+  }
+  unsigned long seed = 42;
+  for (long i = NODES - 1; i > 0; i--) {
+    seed = seed * 6364136223846793005 + 1442695040888963407;
+    long j = (seed >> 33) % (i + 1);
+    long t = order[i];
+    order[i] = order[j];
+    order[j] = t;
+  }
+  for (long i = 0; i < NODES; i++) {
+    Node *n = &pool[order[i]];
+    n->next = i + 1 < NODES ? &pool[order[i + 1]] : 0;
+    n->key = i * 7;
+    n->weight = i % 13;
+    n->tag = 'a' + i % 26;
+    n->score = i * 0.5;
+  }
+  long sum = 0;
+  for (int r = 0; r < ROUNDS; r++) {
+    for (Node *n = &pool[order[0]]; n; n = n->next) {
+      if (n->tag == 'e') {
+        sum += n->key;
+      } else {
+        sum += n->weight;
+      }
+      n->weight = (n->weight + r) % 13;
+    }
+  }
+  printf("%ld\n", sum);
+  return 0;
+}
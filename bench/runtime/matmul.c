@@ -0,0 +1,39 @@
+// Naive multiplication of square double matrices.
+int printf(char *fmt, ...);
+
+enum { N = 200, ROUNDS = 10 };
+
+double a[N][N];
+double b[N][N];
+double c[N][N];
+
+void multiply(void) {
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++) {
+      double sum = 0;
+      for (int k = 0; k < N; k++) {
+        sum += a[i][k] * b[k][j];
+      }
+      c[i][j] = sum;
+    }
+  }
+}
+
+int main(void) {
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++) {
+      a[i][j] = (i * 7 + j * 3) % 17 - 8;
+      b[i][j] = (i * 5 + j * 11) % 13 - 6;
+    }
+  }
+  double trace = 0;
+  for (int r = 0; r < ROUNDS; r++) {
+    multiply();
+    for (int i = 0; i < N; i++) {
+      trace += c[i][i];
+    }
+    a[r][r] += 1;
+  }
+  printf("%ld\n", (long)trace);
+  return 0;
+}
@@ -0,0 +1,107 @@
+// The n-body simulation of the Jovian planets, in double precision.
+int printf(char *fmt, ...);
+double sqrt(double x);
+
+enum { BODIES = 5, STEPS = 1000000 };
+
+typedef struct {
+  double x, y, z;
+  double vx, vy, vz;
+  double mass;
+} Body;
+
+Body bodies[BODIES];
+
+void init(void) {
+  double pi = 3.141592653589793;
+  double solar_mass = 4 * pi * pi;
+  double days = 365.24;
+  double init[BODIES][7] = {
+      {0, 0, 0, 0, 0, 0, 1},
+      {4.84143144246472090e+00, -1.16032004402742839e+00,
+       -1.03622044471123109e-01, 1.66007664274403694e-03,
+       7.69901118419740425e-03, -6.90460016972063023e-05,
+       9.54791938424326609e-04},
+      {8.34336671824457987e+00, 4.12479856412430479e+00,
+       -4.03523417114321381e-01, -2.76742510726862411e-03,
+       4.99852801234917238e-03, 2.30417297573763929e-05,
+       2.85885980666130812e-04},
+      {1.28943695621391310e+01, -1.51111514016986312e+01,
+       -2.23307578892655734e-01, 2.96460137564761618e-03,
+       2.37847173959480950e-03, -2.96589568540237556e-05,
+       4.36624404335156298e-05},
+      {1.53796971148509165e+01, -2.59193146099879641e+01,
+       1.79258772950371181e-01, 2.68067772490389322e-03,
+       1.62824170038242295e-03, -9.51592254519715870e-05,
+       5.15138902046611451e-05}};
+  for (int i = 0; i < BODIES; i++) {
+    Body *b = &bodies[i];
+    b->x = init[i][0];
+    b->y = init[i][1];
+    b->z = init[i][2];
+    b->vx = init[i][3] * days;
+    b->vy = init[i][4] * days;
+    b->vz = init[i][5] * days;
+    b->mass = init[i][6] * solar_mass;
+  }
+  double px = 0, py = 0, pz = 0;
+  for (int i = 0; i < BODIES; i++) {
+    px += bodies[i].vx * bodies[i].mass;
+    py += bodies[i].vy * bodies[i].mass;
+    pz += bodies[i].vz * bodies[i].mass;
+  }
+  bodies[0].vx = -px / solar_mass;
+  bodies[0].vy = -py / solar_mass;
+  bodies[0].vz = -pz / solar_mass;
+}
+
+double energy(void) {
+  double e = 0;
+  for (int i = 0; i < BODIES; i++) {
+    Body *b = &bodies[i];
+    e += 0.5 * b->mass * (b->vx * b->vx + b->vy * b->vy + b->vz * b->vz);
+    for (int j = i + 1; j < BODIES; j++) {
+      Body *o = &bodies[j];
+      double dx = b->x - o->x;
+      double dy = b->y - o->y;
+      double dz = b->z - o->z;
+      e -= b->mass * o->mass / sqrt(dx * dx + dy * dy + dz * dz);
+    }
+  }
+  return e;
+}
+
+void advance(double dt) {
+  for (int i = 0; i < BODIES; i++) {
+    Body *b = &bodies[i];
+    for (int j = i + 1; j < BODIES; j++) {
+      Body *o = &bodies[j];
+      double dx = b->x - o->x;
+      double dy = b->y - o->y;
+      double dz = b->z - o->z;
+      double d2 = dx * dx + dy * dy + dz * dz;
+      double mag = dt / (d2 * sqrt(d2));
+      b->vx -= dx * o->mass * mag;
+      b->vy -= dy * o->mass * mag;
+      b->vz -= dz * o->mass * mag;
+      o->vx += dx * b->mass * mag;
+      o->vy += dy * b->mass * mag;
+      o->vz += dz * b->mass * mag;
+    }
+  }
+  for (int i = 0; i < BODIES; i++) {
+    Body *b = &bodies[i];
+    b->x += dt * b->vx;
+    b->y += dt * b->vy;
+    b->z += dt * b->vz;
+  }
+}
+
+int main(void) {
+  init();
+  for (int i = 0; i < STEPS; i++) {
+    advance(0.01);
+  }
+  printf("%ld\n", (long)(energy() * 1000000000));
+  return 0;
+}
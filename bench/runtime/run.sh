@@ -0,0 +1,89 @@
+#!/bin/bash
+# Measures how fast the code generated by ucc runs. Each kernel is built with
+# ucc and with the system compiler ($CC, default cc) at -O0 and -O2, run a
+# few times, and the fastest run of each is kept. The builds must print the
+# same checksum. Results are written to <out-dir>/runtime.tsv, and the slowdown
+# of ucc relative to each system build is printed, with the geometric mean
+# over all kernels.
+#
+# usage: run.sh <out-dir> <ucc>
+#   BENCH_REPEAT  runs per build (default 3)
+
+set -euo pipefail
+
+if [ $# -ne 2 ]; then
+  echo "usage: $0 <out-dir> <ucc>" >&2
+  exit 1
+fi
+
+out=$1
+ucc=$2
+cc=${CC:-cc}
+repeat=${BENCH_REPEAT:-3}
+here=$(dirname "$0")
+export ASAN_OPTIONS=detect_leaks=0
+
+# Prints the fastest wall-clock time of a binary in ms, and fails if its
+# output differs from the expected checksum.
+timeRun() {
+  local best=
+  for ((r = 0; r < repeat; r++)); do
+    local start end sum
+    start=$(date +%s%N)
+    sum=$("$1")
+    end=$(date +%s%N)
+    if [ "$sum" != "$2" ]; then
+      echo "$1: printed $sum, expected $2" >&2
+      exit 1
+    fi
+    local ms=$(((end - start) / 1000000))
+    if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then
+      best=$ms
+    fi
+  done
+  echo "$best"
+}
+
+mkdir -p "$out"
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+date=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+results=$out/runtime.tsv
+printf "commit\tdate\tkernel\tucc_ms\tcc_o0_ms\tcc_o2_ms\tvs_o0\tvs_o2\n" > "$results"
+
+for src in "$here"/*.c; do
+  kernel=$(basename "$src" .c)
+  bin=$out/$kernel
+  "$ucc" -c -o "$bin.o" "$src"
+  $cc -z noexecstack -o "$bin.ucc" "$bin.o" -lm
+  $cc -w -O0 -o "$bin.o0" "$src" -lm
+  $cc -w -O2 -o "$bin.o2" "$src" -lm
+  sum=$("$bin.o2")
+  ucc_ms=$(timeRun "$bin.ucc" "$sum")
+  o0_ms=$(timeRun "$bin.o0" "$sum")
+  o2_ms=$(timeRun "$bin.o2" "$sum")
+  awk -v c="$commit" -v d="$date" -v k="$kernel" -v u="$ucc_ms" -v o0="$o0_ms" \
+    -v o2="$o2_ms" 'BEGIN {
+      printf "%s\t%s\t%s\t%d\t%d\t%d\t%.2f\t%.2f\n", c, d, k, u, o0, o2,
+             u / (o0 ? o0 : 1), u / (o2 ? o2 : 1)
+    }' >> "$results"
+done
+
+awk -F '\t' '
+  NR == 1 {
+    printf "%-10s %10s %10s %10s %8s %8s\n", "kernel", "ucc (ms)", "-O0 (ms)",
+           "-O2 (ms)", "vs -O0", "vs -O2"
+    next
+  }
+  {
+    printf "%-10s %10d %10d %10d %7.2fx %7.2fx\n", $3, $4, $5, $6, $7, $8
+    log_o0 += log($7)
+    log_o2 += log($8)
+    n++
+  }
+  END {
+    printf "%-10s %32s %7.2fx %7.2fx\n", "geomean", "", exp(log_o0 / n),
+           exp(log_o2 / n)
+  }
+' "$results"
+echo
+echo "results written to $results"
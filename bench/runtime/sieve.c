@@ -0,0 +1,32 @@
+// Sieve of Eratosthenes over a byte array, repeated.
+int printf(char *fmt, ...);
+
+enum { LIMIT = 4000000, ROUNDS = 10 };
+
+char composite[LIMIT + 1];
+
+long sieve(void) {
+  for (long i = 0; i <= LIMIT; i++) {
+    composite[i] = 0;
+  }
+  long count = 0;
+  for (long i = 2; i <= LIMIT; i++) {
+    if (composite[i]) {
+      continue;
+    }
+    count++;
+    for (long j = i * i; j <= LIMIT; j += i) {
+      composite[j] = 1;
+    }
+  }
+  return count;
+}
+
+int main(void) {
+  long sum = 0;
+  for (int r = 0; r < ROUNDS; r++) {
+    sum += sieve();
+  }
+  printf("%ld\n", sum);
+  return 0;
+}
@@ -0,0 +1,69 @@
+// Scans a large generated text: word counts, lengths and substring search.
+int printf(char *fmt, ...);
+void *malloc(long size);
+
+enum { LEN = 4 << 20, ROUNDS = 8 };
+
+long countWords(char *s) {
+  long words = 0;
+  int in_word = 0;
+  for (; *s; s++) {
+    int is_space = *s == ' ' || *s == '\n' || *s == '\t';
+    if (!is_space && !in_word) {
+      words++;
+    }
+    in_word = !is_space;
+  }
+  return words;
+}
+
+long countMatches(char *s, char *pat) {
+  long n = 0;
+  for (; *s; s++) {
+    int k = 0;
+    while (pat[k] && s[k] == pat[k]) {
+      k++;
+    }
+    n += !pat[k];
+  }
+  return n;
+}
+
+long longestLine(char *s) {
+  long best = 0;
+  long cur = 0;
+  for (; *s; s++) {
+    if (*s == '\n') {
+      best = cur > best ? cur : best;
+      cur = 0;
+    } else {
+      cur++;
+    }
+  }
+  return best;
+}
+
+int main(void) {
+  char *words[] = {"the", "quick", "brown", "fox", "jumps", "over", "lazy",
+                   "dog", "then", "there", "these", "thermal"};
+  char *text = malloc(LEN + 16);
+  long pos = 0;
+  unsigned int seed = 7;
+  while (pos < LEN) {
+    seed = seed * 1103515245 + 12345;
+    char *w = words[(seed >> 16) % 12];
+    while (*w) {
+      text[pos++] = *w++;
+    }
+    text[pos++] = (seed >> 8) % 11 ? ' ' : '\n';
+  }
+  text[pos] = 0;
+  long sum = 0;
+  for (int r = 0; r < ROUNDS; r++) {
+    sum += countWords(text);
+    sum += countMatches(text, "the");
+    sum += longestLine(text);
+  }
+  printf("%ld\n", sum);
+  return 0;
+}
@@ -0,0 +1,13 @@
+#ifndef __STDDEF_H
+#define __STDDEF_H
+
+#define NULL ((void *)0)
+
+typedef unsigned long size_t;
+typedef long ptrdiff_t;
+typedef int wchar_t;
+typedef long max_align_t;
+
+#define offsetof(type, member) ((size_t)&(((type *)0)->member))
+
+#endif
@@ -0,0 +1,20 @@
+#!/bin/bash
+# Compares two object files by their disassembly, relocations, data sections
+# and decoded line tables, ignoring layout details that do not matter to the
+# linker such as symbol table order.
+
+set -e
+
+dump() {
+  objdump -dr "$1" | tail -n +4
+  for sec in .data .rodata .rodata.str1.1; do
+    if objdump -h "$1" | grep -q " $sec "; then
+      objdump -s -j "$sec" "$1" | tail -n +4
+      objdump -r -j "$sec" "$1" | tail -n +4
+    fi
+  done
+  objdump -h "$1" | awk '$2 == ".bss" { print "bss", $3 }'
+  objdump --dwarf=decodedline "$1" | tail -n +4
+}
+
+diff <(dump "$1") <(dump "$2")
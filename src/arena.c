@@ -0,0 +1,100 @@
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+
+enum { ARENA_BLOCK_SIZE = 64 * 1024, ARENA_ALIGN = 16 };
+
+// Tokens and interned strings live as long as the translation unit, as does
+// the AST. Everything lowered or computed for a single function is scratch,
+// and is reset once that function has been emitted.
+Arena token_arena = {.name = "tokens"};
+Arena ast_arena = {.name = "ast"};
+Arena fn_arena = {.name = "function"};
+Arena asm_arena = {.name = "assembler"};
+
+static void newArenaBlock(Arena *arena, size_t size);
+
+void *arenaAlloc(Arena *arena, size_t size) {
+  size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+  if (!arena->blocks || arena->ptr + size > arena->end) {
+    newArenaBlock(arena, size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE);
+  }
+  void *ptr = arena->ptr;
+  arena->ptr += size;
+  arena->used += size;
+  arena->total += size;
+  arena->alloc_cnt++;
+  if (arena->used > arena->peak) {
+    arena->peak = arena->used;
+  }
+  return ptr;
+}
+
+void *arenaCalloc(Arena *arena, size_t nmemb, size_t size) {
+  return arenaAlloc(arena, nmemb * size);
+}
+
+// Arena memory is never freed piecemeal, so growing an array leaves its old
+// copy behind until the arena is reset.
+void *arenaRealloc(Arena *arena, void *ptr, size_t old_size, size_t new_size) {
+  void *grown = arenaAlloc(arena, new_size);
+  if (ptr) {
+    memcpy(grown, ptr, old_size);
+  }
+  return grown;
+}
+
+char *arenaStrndup(Arena *arena, const char *str, size_t len) {
+  char *dup = arenaAlloc(arena, len + 1);
+  memcpy(dup, str, len);
+  return dup;
+}
+
+// Keeps the first block, so that an arena reset between functions does not go
+// back to malloc unless a function outgrows it.
+void arenaReset(Arena *arena) {
+  ArenaBlock *first = arena->blocks;
+  while (first && first->next) {
+    ArenaBlock *next = first->next;
+    arena->reserved -= first->size;
+    free(first);
+    first = next;
+  }
+  arena->blocks = first;
+  arena->used = 0;
+  if (first) {
+    memset(first->data, 0, first->size);
+    arena->ptr = first->data;
+    arena->end = first->data + first->size;
+  }
+}
+
+void newArenaBlock(Arena *arena, size_t size) {
+  ArenaBlock *block = calloc(1, sizeof(ArenaBlock) + size);
+  block->data = (char *)(block + 1);
+  block->size = size;
+  block->next = arena->blocks;
+  arena->blocks = block;
+  arena->ptr = block->data;
+  arena->end = block->data + size;
+  arena->reserved += size;
+  if (arena->reserved > arena->peak_reserved) {
+    arena->peak_reserved = arena->reserved;
+  }
+}
+
+void printMemStats(void) {
+  Arena *arenas[] = {&token_arena, &ast_arena, &fn_arena, &asm_arena};
+  fprintf(stderr, "%-10s %12s %14s ", "arena", "allocations", "total bytes");
+  fprintf(stderr, "%14s %14s\n", "peak bytes", "peak reserved");
+  for (size_t i = 0; i < sizeof(arenas) / sizeof(*arenas); i++) {
+    Arena *arena = arenas[i];
+    fprintf(stderr, "%-10s %12zu %14zu ", arena->name, arena->alloc_cnt,
+            arena->total);
+    fprintf(stderr, "%14zu %14zu\n", arena->peak, arena->peak_reserved);
+  }
+}
@@ -0,0 +1,15 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct Arena Arena;
+
+char *arenaStrndup(Arena *arena, const char *str, size_t len);
+void *arenaAlloc(Arena *arena, size_t size);
+void *arenaCalloc(Arena *arena, size_t nmemb, size_t size);
+void *arenaRealloc(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+void arenaReset(Arena *arena);
+void printMemStats(void);
+
+#endif // ARENA_H
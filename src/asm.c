@@ -0,0 +1,1238 @@
+#include "asm.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "defs.h"
+#include "elf_out.h"
+#include "hashmap.h"
+
+enum { ITEM_DATA, ITEM_JUMP, ITEM_ALIGN, ITEM_LABEL, ITEM_LOC };
+enum { FIX_PC32, FIX_PLT32, FIX_ABS64, FIX_DIFF32 };
+enum { OPND_NONE, OPND_REG, OPND_XMM, OPND_MEM, OPND_IMM, OPND_SYM };
+enum { REG_NONE = -1, REG_RIP = 16 };
+enum {
+  PFX_66 = 0x1,
+  PFX_F2 = 0x2,
+  PFX_F3 = 0x4,
+  PFX_REXW = 0x8,
+  PFX_REX = 0x10,
+};
+enum {
+  MN_ALU,
+  MN_CALL,
+  MN_CVT2SI,
+  MN_CVTSI2,
+  MN_IMUL,
+  MN_JCC,
+  MN_JMP,
+  MN_LEA,
+  MN_MOV,
+  MN_MOVQ,
+  MN_MOVSXD,
+  MN_MOVX,
+  MN_NULLARY,
+  MN_POP,
+  MN_PUSH,
+  MN_REP,
+  MN_SETCC,
+  MN_SHIFT,
+  MN_SSE,
+  MN_SSE_MOV,
+  MN_TEST,
+  MN_UNARY,
+};
+
+extern Arena asm_arena;
+static AsmUnit unit = {0};
+static AsmSection *cur_sec = NULL;
+static AsmSymbol *last_sym = NULL;
+static HashMap symbols = {0};
+static HashMap mnemonics = {0};
+static HashMap registers = {0};
+static bool tables_ready = false;
+static size_t line_no = 0;
+static size_t num_label_cnt[10] = {0};
+static const char *gp_reg_names[4][16] = {
+    {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "r8b", "r9b", "r10b",
+     "r11b", "r12b", "r13b", "r14b", "r15b"},
+    {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di", "r8w", "r9w", "r10w",
+     "r11w", "r12w", "r13w", "r14w", "r15w"},
+    {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d",
+     "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"},
+    {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10",
+     "r11", "r12", "r13", "r14", "r15"},
+};
+static const char *xmm_reg_names[] = {
+    "xmm0", "xmm1", "xmm2",  "xmm3",  "xmm4",  "xmm5",  "xmm6",  "xmm7",
+    "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15"};
+// Registers map to 0x100 for rip, 0x80 | n for xmm n, and (log2 size) << 4 | n
+// for the general purpose registers.
+static int reg_codes[4 * 16 + 16 + 1];
+static const char *cond_names[] = {"o", "no", "b", "ae", "e", "ne", "be", "a",
+                                   "s", "ns", "p", "np", "l", "ge", "le", "g"};
+static AsmMnemonic cond_mnemonics[2 * 16];
+static const AsmMnemonic mnemonic_table[] = {
+    {.name = "add", .kind = MN_ALU, .ext = 0},
+    {.name = "or", .kind = MN_ALU, .ext = 1},
+    {.name = "and", .kind = MN_ALU, .ext = 4},
+    {.name = "sub", .kind = MN_ALU, .ext = 5},
+    {.name = "xor", .kind = MN_ALU, .ext = 6},
+    {.name = "cmp", .kind = MN_ALU, .ext = 7},
+    {.name = "mov", .kind = MN_MOV},
+    {.name = "lea", .kind = MN_LEA, .opcode = 0x8d},
+    {.name = "movzx", .kind = MN_MOVX, .opcode = 0x0fb6},
+    {.name = "movsx", .kind = MN_MOVX, .opcode = 0x0fbe},
+    {.name = "movsxd", .kind = MN_MOVSXD, .opcode = 0x63},
+    {.name = "imul", .kind = MN_IMUL, .opcode = 0x0faf},
+    {.name = "not", .kind = MN_UNARY, .ext = 2},
+    {.name = "neg", .kind = MN_UNARY, .ext = 3},
+    {.name = "mul", .kind = MN_UNARY, .ext = 4},
+    {.name = "div", .kind = MN_UNARY, .ext = 6},
+    {.name = "idiv", .kind = MN_UNARY, .ext = 7},
+    {.name = "shl", .kind = MN_SHIFT, .ext = 4},
+    {.name = "shr", .kind = MN_SHIFT, .ext = 5},
+    {.name = "sar", .kind = MN_SHIFT, .ext = 7},
+    {.name = "test", .kind = MN_TEST, .opcode = 0x84},
+    {.name = "push", .kind = MN_PUSH, .opcode = 0x50},
+    {.name = "pop", .kind = MN_POP, .opcode = 0x58},
+    {.name = "ret", .kind = MN_NULLARY, .opcode = 0xc3},
+    {.name = "cdq", .kind = MN_NULLARY, .opcode = 0x99},
+    {.name = "cqo", .kind = MN_NULLARY, .prefix = 0x48, .opcode = 0x99},
+    {.name = "movsb", .kind = MN_NULLARY, .opcode = 0xa4},
+    {.name = "stosb", .kind = MN_NULLARY, .opcode = 0xaa},
+    {.name = "nop", .kind = MN_NULLARY, .opcode = 0x90},
+    {.name = "rep", .kind = MN_REP, .prefix = 0xf3},
+    {.name = "jmp", .kind = MN_JMP},
+    {.name = "call", .kind = MN_CALL},
+    {.name = "movss", .kind = MN_SSE_MOV, .prefix = PFX_F3, .opcode = 0x0f10},
+    {.name = "movsd", .kind = MN_SSE_MOV, .prefix = PFX_F2, .opcode = 0x0f10},
+    {.name = "movaps", .kind = MN_SSE_MOV, .opcode = 0x0f28},
+    {.name = "movups", .kind = MN_SSE_MOV, .opcode = 0x0f10},
+    {.name = "movq", .kind = MN_MOVQ, .prefix = PFX_66 | PFX_REXW},
+    {.name = "addss", .kind = MN_SSE, .prefix = PFX_F3, .opcode = 0x0f58},
+    {.name = "addsd", .kind = MN_SSE, .prefix = PFX_F2, .opcode = 0x0f58},
+    {.name = "subss", .kind = MN_SSE, .prefix = PFX_F3, .opcode = 0x0f5c},
+    {.name = "subsd", .kind = MN_SSE, .prefix = PFX_F2, .opcode = 0x0f5c},
+    {.name = "mulss", .kind = MN_SSE, .prefix = PFX_F3, .opcode = 0x0f59},
+    {.name = "mulsd", .kind = MN_SSE, .prefix = PFX_F2, .opcode = 0x0f59},
+    {.name = "divss", .kind = MN_SSE, .prefix = PFX_F3, .opcode = 0x0f5e},
+    {.name = "divsd", .kind = MN_SSE, .prefix = PFX_F2, .opcode = 0x0f5e},
+    {.name = "ucomiss", .kind = MN_SSE, .opcode = 0x0f2e},
+    {.name = "ucomisd", .kind = MN_SSE, .prefix = PFX_66, .opcode = 0x0f2e},
+    {.name = "xorps", .kind = MN_SSE, .opcode = 0x0f57},
+    {.name = "xorpd", .kind = MN_SSE, .prefix = PFX_66, .opcode = 0x0f57},
+    {.name = "pxor", .kind = MN_SSE, .prefix = PFX_66, .opcode = 0x0fef},
+    {.name = "cvtss2sd", .kind = MN_SSE, .prefix = PFX_F3, .opcode = 0x0f5a},
+    {.name = "cvtsd2ss", .kind = MN_SSE, .prefix = PFX_F2, .opcode = 0x0f5a},
+    {.name = "cvttss2si", .kind = MN_CVT2SI, .prefix = PFX_F3, .opcode = 0x0f2c},
+    {.name = "cvttsd2si", .kind = MN_CVT2SI, .prefix = PFX_F2, .opcode = 0x0f2c},
+    {.name = "cvtsi2ss", .kind = MN_CVTSI2, .prefix = PFX_F3, .opcode = 0x0f2a},
+    {.name = "cvtsi2sd", .kind = MN_CVTSI2, .prefix = PFX_F2, .opcode = 0x0f2a},
+};
+
+static AsmFixup *addFixup(int kind, AsmSymbol *sym, int64_t addend);
+static AsmItem *dataItem(void);
+static AsmItem *newItem(int kind);
+static AsmSection *findSection(const char *name, size_t len);
+static AsmSymbol *findSymbol(const char *name, size_t len);
+static AsmSymbol *numericLabel(const char *name, size_t len, bool is_def);
+static bool fitsInt8(int64_t val);
+static bool isIdentChar(char c);
+static bool isNumericLabelRef(const char *p, const char *end);
+static const char *parseSymbolExpr(const char *p, const char *end,
+                                   AsmSymbol **sym, int64_t *addend);
+static const char *skipSpace(const char *p, const char *end);
+static int64_t parseInt(const char *p, const char *end, const char **rest);
+static int64_t truncImm(int64_t val, int size);
+static int operandSize(AsmOperand *a, AsmOperand *b);
+static size_t itemSize(AsmItem *item);
+static void addReloc(AsmSection *sec, uint64_t offset, int type,
+                     AsmSymbol *sym, int64_t addend);
+static void asmError(const char *fmt, ...);
+static void defineLabel(AsmSymbol *sym);
+static void emitByte(int byte);
+static void emitImm(int64_t val, int size);
+static void emitInstruction(const AsmMnemonic *mn, AsmOperand *ops,
+                            size_t op_cnt);
+static void emitJump(AsmSection *sec, AsmItem *item);
+static void emitOpReg(int flags, int opcode, int reg);
+static void emitPrefixes(int flags, int reg, AsmOperand *rm);
+static void emitRM(int flags, int opcode, int reg, AsmOperand *rm,
+                   size_t imm_len);
+static void initTables(void);
+static void layoutSection(AsmSection *sec);
+static void parseDirective(const char *p, const char *end);
+static void parseInstruction(const char *p, const char *end);
+static void parseOperand(AsmOperand *op, const char *p, const char *end);
+static void parseStatement(const char *p, const char *end);
+static void putField(char *out, int64_t val, size_t size);
+static void resolveFixup(AsmSection *sec, AsmFixup *fix);
+static void writeSection(AsmSection *sec);
+
+// Assembles the Intel syntax produced by the code generator into an ELF
+// relocatable object. Only the instructions and directives that the code
+// generator emits are understood.
+void assemble(const char *text, size_t len, const char *output_path) {
+  initTables();
+  cur_sec = findSection(".text", 5);
+  findSection(".data", 5);
+  findSection(".bss", 4);
+
+  const char *end = text + len;
+  for (const char *p = text; p < end;) {
+    const char *eol = memchr(p, '\n', end - p);
+    if (!eol) {
+      eol = end;
+    }
+    line_no++;
+    // Statements on one line are separated by ';', outside of strings.
+    const char *start = p;
+    bool in_str = false;
+    for (const char *q = p; q < eol; q++) {
+      if (*q == '"' && (q == start || q[-1] != '\\')) {
+        in_str = !in_str;
+      } else if (*q == ';' && !in_str) {
+        parseStatement(p, q);
+        p = q + 1;
+      }
+    }
+    parseStatement(p, eol);
+    p = eol + 1;
+  }
+
+  for (AsmSection *sec = unit.sections; sec; sec = sec->next) {
+    layoutSection(sec);
+  }
+  for (AsmSection *sec = unit.sections; sec; sec = sec->next) {
+    writeSection(sec);
+  }
+  LineRow head = {0};
+  LineRow *cur = &head;
+  AsmSection *text_sec = findSection(".text", 5);
+  for (AsmItem *item = text_sec->items; item; item = item->next) {
+    if (item->kind == ITEM_LOC) {
+      cur = cur->next = arenaCalloc(&asm_arena, 1, sizeof(LineRow));
+      cur->addr = item->addr;
+      cur->file_no = item->file_no;
+      cur->line = item->line;
+    }
+  }
+  unit.lines = head.next;
+  writeElf(output_path, &unit);
+}
+
+void initTables(void) {
+  if (tables_ready) {
+    return;
+  }
+  tables_ready = true;
+  size_t n = 0;
+  for (int size = 0; size < 4; size++) {
+    for (int r = 0; r < 16; r++) {
+      const char *name = gp_reg_names[size][r];
+      reg_codes[n] = size << 4 | r;
+      hashmapPut(&registers, intern(name, strlen(name)), &reg_codes[n++]);
+    }
+  }
+  for (int r = 0; r < 16; r++) {
+    reg_codes[n] = 0x80 | r;
+    hashmapPut(&registers, intern(xmm_reg_names[r], strlen(xmm_reg_names[r])),
+               &reg_codes[n++]);
+  }
+  reg_codes[n] = 0x100;
+  hashmapPut(&registers, intern("rip", 3), &reg_codes[n]);
+
+  for (size_t i = 0; i < sizeof(mnemonic_table) / sizeof(*mnemonic_table);
+       i++) {
+    const char *name = mnemonic_table[i].name;
+    hashmapPut(&mnemonics, intern(name, strlen(name)),
+               (void *)&mnemonic_table[i]);
+  }
+  for (int cc = 0; cc < 16; cc++) {
+    char buf[8];
+    AsmMnemonic *jcc = &cond_mnemonics[cc];
+    AsmMnemonic *setcc = &cond_mnemonics[16 + cc];
+    jcc->kind = MN_JCC;
+    jcc->ext = cc;
+    setcc->kind = MN_SETCC;
+    setcc->ext = cc;
+    sprintf(buf, "j%s", cond_names[cc]);
+    jcc->name = intern(buf, strlen(buf));
+    sprintf(buf, "set%s", cond_names[cc]);
+    setcc->name = intern(buf, strlen(buf));
+    hashmapPut(&mnemonics, jcc->name, jcc);
+    hashmapPut(&mnemonics, setcc->name, setcc);
+  }
+}
+
+void asmError(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "assembler: line %zu: ", line_no);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  fprintf(stderr, "\n");
+  exit(EXIT_FAILURE);
+}
+
+// GNU as places .text, .data and .bss first, and so do we.
+AsmSection *findSection(const char *name, size_t len) {
+  AsmSection **link = &unit.sections;
+  for (; *link; link = &(*link)->next) {
+    if (strlen((*link)->name) == len && !strncmp((*link)->name, name, len)) {
+      return *link;
+    }
+  }
+  const char *interned = intern(name, len);
+  AsmSection *sec = NULL;
+  if (!strcmp(interned, ".text")) {
+    sec = newSection(interned, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR);
+  } else if (!strcmp(interned, ".data")) {
+    sec = newSection(interned, SHT_PROGBITS, SHF_ALLOC | SHF_WRITE);
+  } else if (!strcmp(interned, ".bss")) {
+    sec = newSection(interned, SHT_NOBITS, SHF_ALLOC | SHF_WRITE);
+  } else if (!strcmp(interned, ".rodata")) {
+    sec = newSection(interned, SHT_PROGBITS, SHF_ALLOC);
+  } else if (!strcmp(interned, ".rodata.str1.1")) {
+    sec = newSection(interned, SHT_PROGBITS,
+                     SHF_ALLOC | SHF_MERGE | SHF_STRINGS);
+    sec->entsize = 1;
+  } else {
+    asmError("unsupported section '%s'", interned);
+  }
+  *link = sec;
+  return sec;
+}
+
+AsmSymbol *findSymbol(const char *name, size_t len) {
+  const char *key = intern(name, len);
+  AsmSymbol *sym = hashmapGet(&symbols, key);
+  if (sym) {
+    return sym;
+  }
+  sym = arenaCalloc(&asm_arena, 1, sizeof(AsmSymbol));
+  sym->name = key;
+  sym->is_temp = len >= 2 && name[0] == '.' && name[1] == 'L';
+  if (last_sym) {
+    last_sym = last_sym->next = sym;
+  } else {
+    unit.symbols = last_sym = sym;
+  }
+  hashmapPut(&symbols, key, sym);
+  return sym;
+}
+
+// The numeric labels `N:` may be defined many times. `Nb` refers to the last
+// definition and `Nf` to the next one.
+AsmSymbol *numericLabel(const char *name, size_t len, bool is_def) {
+  const int digit = name[0] - '0';
+  size_t instance = num_label_cnt[digit];
+  if (is_def) {
+    instance = ++num_label_cnt[digit];
+  } else if (name[len - 1] == 'f') {
+    instance++;
+  }
+  char buf[32];
+  sprintf(buf, ".L%d\002%zu", digit, instance);
+  return findSymbol(buf, strlen(buf));
+}
+
+bool isIdentChar(char c) {
+  return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') ||
+         ('0' <= c && c <= '9') || c == '_' || c == '.' || c == '$';
+}
+
+bool isNumericLabelRef(const char *p, const char *end) {
+  return end - p == 2 && '0' <= p[0] && p[0] <= '9' &&
+         (p[1] == 'f' || p[1] == 'b');
+}
+
+const char *skipSpace(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    p++;
+  }
+  return p;
+}
+
+void parseStatement(const char *p, const char *end) {
+  p = skipSpace(p, end);
+  while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+    end--;
+  }
+  if (p == end) {
+    return;
+  }
+  const char *q = p;
+  while (q < end && isIdentChar(*q)) {
+    q++;
+  }
+  if (q < end && *q == ':' && q > p) {
+    const bool is_numeric = q - p == 1 && '0' <= *p && *p <= '9';
+    defineLabel(is_numeric ? numericLabel(p, 1, true) : findSymbol(p, q - p));
+    parseStatement(q + 1, end);
+    return;
+  }
+  if (*p == '.') {
+    parseDirective(p, end);
+  } else {
+    parseInstruction(p, end);
+  }
+}
+
+void defineLabel(AsmSymbol *sym) {
+  if (sym->section) {
+    asmError("symbol '%s' is already defined", sym->name);
+  }
+  sym->section = cur_sec;
+  newItem(ITEM_LABEL)->sym = sym;
+}
+
+AsmItem *newItem(int kind) {
+  AsmItem *item = arenaCalloc(&asm_arena, 1, sizeof(AsmItem));
+  item->kind = kind;
+  if (cur_sec->last_item) {
+    cur_sec->last_item = cur_sec->last_item->next = item;
+  } else {
+    cur_sec->items = cur_sec->last_item = item;
+  }
+  return item;
+}
+
+// Fixed bytes are gathered into runs, so that only jumps and alignment need to
+// be revisited when the section is laid out.
+AsmItem *dataItem(void) {
+  AsmItem *item = cur_sec->last_item;
+  if (item && item->kind == ITEM_DATA) {
+    return item;
+  }
+  return newItem(ITEM_DATA);
+}
+
+void emitByte(int byte) {
+  AsmItem *item = dataItem();
+  if (cur_sec->type == SHT_NOBITS) {
+    if (byte) {
+      asmError("non-zero data in section '%s'", cur_sec->name);
+    }
+    item->len++;
+    return;
+  }
+  if (item->len == item->cap) {
+    const size_t cap = item->cap ? item->cap * 2 : 64;
+    item->data = arenaRealloc(&asm_arena, item->data, item->cap, cap);
+    item->cap = cap;
+  }
+  item->data[item->len++] = (char)byte;
+}
+
+void emitImm(int64_t val, int size) {
+  for (int i = 0; i < size; i++) {
+    emitByte((int)((uint64_t)val >> (8 * i)) & 0xff);
+  }
+}
+
+AsmFixup *addFixup(int kind, AsmSymbol *sym, int64_t addend) {
+  AsmItem *item = dataItem();
+  AsmFixup *fix = arenaCalloc(&asm_arena, 1, sizeof(AsmFixup));
+  fix->item = item;
+  fix->offset = item->len;
+  fix->kind = kind;
+  fix->sym = sym;
+  fix->addend = addend;
+  if (cur_sec->last_fixup) {
+    cur_sec->last_fixup = cur_sec->last_fixup->next = fix;
+  } else {
+    cur_sec->fixups = cur_sec->last_fixup = fix;
+  }
+  sym->is_used = true;
+  return fix;
+}
+
+int64_t parseInt(const char *p, const char *end, const char **rest) {
+  bool neg = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    neg = *p == '-';
+    p++;
+  }
+  uint64_t val = 0;
+  const char *start = p;
+  if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    for (p += 2; p < end; p++) {
+      int d = 0;
+      if ('0' <= *p && *p <= '9') {
+        d = *p - '0';
+      } else if ('a' <= (*p | 0x20) && (*p | 0x20) <= 'f') {
+        d = (*p | 0x20) - 'a' + 10;
+      } else {
+        break;
+      }
+      val = val * 16 + d;
+    }
+  } else {
+    for (; p < end && '0' <= *p && *p <= '9'; p++) {
+      val = val * 10 + (*p - '0');
+    }
+  }
+  if (p == start) {
+    asmError("expected a number");
+  }
+  *rest = p;
+  return (int64_t)(neg ? 0 - val : val);
+}
+
+// Parses `sym`, `sym+N` or `sym-N`.
+const char *parseSymbolExpr(const char *p, const char *end, AsmSymbol **sym,
+                            int64_t *addend) {
+  p = skipSpace(p, end);
+  const char *q = p;
+  while (q < end && isIdentChar(*q)) {
+    q++;
+  }
+  if (q == p) {
+    asmError("expected a symbol");
+  }
+  *sym = isNumericLabelRef(p, q) ? numericLabel(p, 2, false)
+                                 : findSymbol(p, q - p);
+  *addend = 0;
+  q = skipSpace(q, end);
+  if (end - q > 1 && (*q == '+' || *q == '-') && '0' <= q[1] && q[1] <= '9') {
+    *addend = parseInt(q, end, &q);
+  }
+  return q;
+}
+
+void parseDirective(const char *p, const char *end) {
+  const char *q = p;
+  while (q < end && isIdentChar(*q)) {
+    q++;
+  }
+  const size_t len = q - p;
+  const char *arg = skipSpace(q, end);
+
+  if (len == 5 && !strncmp(p, ".text", len)) {
+    cur_sec = findSection(p, len);
+  } else if (len == 5 && !strncmp(p, ".data", len)) {
+    cur_sec = findSection(p, len);
+  } else if (len == 4 && !strncmp(p, ".bss", len)) {
+    cur_sec = findSection(p, len);
+  } else if (len == 8 && !strncmp(p, ".section", len)) {
+    const char *name_end = arg;
+    while (name_end < end && *name_end != ',' && *name_end != ' ') {
+      name_end++;
+    }
+    cur_sec = findSection(arg, name_end - arg);
+  } else if (len == 6 && (!strncmp(p, ".globl", len) ||
+                          !strncmp(p, ".local", len))) {
+    findSymbol(arg, end - arg)->is_global = p[1] == 'g';
+  } else if (len == 6 && !strncmp(p, ".align", len)) {
+    AsmItem *item = newItem(ITEM_ALIGN);
+    item->align = (size_t)parseInt(arg, end, &q);
+    if (item->align > cur_sec->align) {
+      cur_sec->align = item->align;
+    }
+  } else if (len == 5 && !strncmp(p, ".byte", len)) {
+    while (arg < end) {
+      emitByte((int)parseInt(arg, end, &q) & 0xff);
+      arg = skipSpace(q, end);
+      if (arg < end && *arg == ',') {
+        arg = skipSpace(arg + 1, end);
+      }
+    }
+  } else if (len == 6 && !strncmp(p, ".ascii", len)) {
+    if (arg == end || *arg != '"') {
+      asmError("expected a string");
+    }
+    for (q = arg + 1; q < end && *q != '"'; q++) {
+      if (*q != '\\') {
+        emitByte(*q & 0xff);
+        continue;
+      }
+      q++;
+      if (q == end) {
+        asmError("unterminated string");
+      }
+      if (*q == 'n') {
+        emitByte('\n');
+      } else if (*q == 't') {
+        emitByte('\t');
+      } else if ('0' <= *q && *q <= '7') {
+        int val = 0;
+        for (int i = 0; i < 3 && q < end && '0' <= *q && *q <= '7'; i++) {
+          val = val * 8 + (*q++ - '0');
+        }
+        q--;
+        emitByte(val & 0xff);
+      } else {
+        emitByte(*q & 0xff);
+      }
+    }
+  } else if (len == 5 && !strncmp(p, ".zero", len)) {
+    for (int64_t n = parseInt(arg, end, &q); n > 0; n--) {
+      emitByte(0);
+    }
+  } else if ((len == 5 && !strncmp(p, ".quad", len)) ||
+             (len == 5 && !strncmp(p, ".long", len))) {
+    const int size = p[1] == 'q' ? 8 : 4;
+    if (('0' <= *arg && *arg <= '9') || *arg == '-') {
+      emitImm(parseInt(arg, end, &q), size);
+      return;
+    }
+    AsmSymbol *sym = NULL;
+    int64_t addend = 0;
+    q = parseSymbolExpr(arg, end, &sym, &addend);
+    if (size == 8) {
+      addFixup(FIX_ABS64, sym, addend);
+    } else if (q < end && *q == '-') {
+      // `.long a-b` where b is a label in this section.
+      AsmSymbol *base = NULL;
+      parseSymbolExpr(q + 1, end, &base, &addend);
+      addFixup(FIX_DIFF32, sym, addend)->base = base;
+    } else {
+      asmError("unsupported .long expression");
+    }
+    emitImm(0, size);
+  } else if (len == 4 && !strncmp(p, ".loc", len)) {
+    AsmItem *item = newItem(ITEM_LOC);
+    item->file_no = (int)parseInt(arg, end, &q);
+    item->line = (size_t)parseInt(skipSpace(q, end), end, &q);
+  } else if (len == 5 && !strncmp(p, ".file", len)) {
+    const size_t file_no = (size_t)parseInt(arg, end, &q);
+    const char *name = memchr(q, '"', end - q);
+    const char *name_end = name ? memchr(name + 1, '"', end - name - 1) : NULL;
+    if (!name_end) {
+      asmError("expected a file name");
+    }
+    if (file_no >= unit.file_cnt) {
+      unit.file_names = arenaRealloc(&asm_arena, unit.file_names,
+                                     unit.file_cnt * sizeof(char *),
+                                     (file_no + 1) * sizeof(char *));
+      unit.file_cnt = file_no + 1;
+    }
+    unit.file_names[file_no] =
+        arenaStrndup(&asm_arena, name + 1, name_end - name - 1);
+  } else if (len == 13 && !strncmp(p, ".intel_syntax", len)) {
+    return;
+  } else {
+    asmError("unsupported directive '%.*s'", (int)len, p);
+  }
+}
+
+void parseInstruction(const char *p, const char *end) {
+  const char *q = p;
+  while (q < end && isIdentChar(*q)) {
+    q++;
+  }
+  const AsmMnemonic *mn = hashmapGet(&mnemonics, intern(p, q - p));
+  if (!mn) {
+    asmError("unknown instruction '%.*s'", (int)(q - p), p);
+  }
+  if (mn->kind == MN_REP) {
+    emitByte(mn->prefix);
+    parseInstruction(skipSpace(q, end), end);
+    return;
+  }
+  AsmOperand ops[3];
+  memset(ops, 0, sizeof(ops));
+  size_t op_cnt = 0;
+  p = skipSpace(q, end);
+  while (p < end) {
+    if (op_cnt == 3) {
+      asmError("too many operands");
+    }
+    q = memchr(p, ',', end - p);
+    if (!q) {
+      q = end;
+    }
+    parseOperand(&ops[op_cnt++], p, q);
+    p = q < end ? skipSpace(q + 1, end) : end;
+  }
+  emitInstruction(mn, ops, op_cnt);
+}
+
+void parseOperand(AsmOperand *op, const char *p, const char *end) {
+  p = skipSpace(p, end);
+  while (end > p && end[-1] == ' ') {
+    end--;
+  }
+  op->base = op->index = REG_NONE;
+
+  // An explicit size such as `DWORD PTR [rbp-8]`.
+  const char *sizes[] = {"byte", "word", "dword", "qword"};
+  for (int i = 0; i < 4; i++) {
+    const size_t len = strlen(sizes[i]);
+    if (end - p > (long)len + 4 && !strncasecmp(p, sizes[i], len) &&
+        p[len] == ' ') {
+      const char *q = skipSpace(p + len, end);
+      if (end - q >= 3 && !strncasecmp(q, "ptr", 3)) {
+        op->size = 1 << i;
+        p = skipSpace(q + 3, end);
+      }
+    }
+  }
+
+  if (*p == '[') {
+    op->kind = OPND_MEM;
+    p++;
+    bool neg = false;
+    while (p < end && *p != ']') {
+      p = skipSpace(p, end);
+      if (*p == '+' || *p == '-') {
+        neg = *p == '-';
+        p = skipSpace(p + 1, end);
+      }
+      if ('0' <= *p && *p <= '9') {
+        int64_t val = parseInt(p, end, &p);
+        op->disp += neg ? -val : val;
+      } else {
+        const char *q = p;
+        while (q < end && isIdentChar(*q)) {
+          q++;
+        }
+        int *code = hashmapGet(&registers, intern(p, q - p));
+        if (code) {
+          const int reg = *code == 0x100 ? REG_RIP : *code & 15;
+          q = skipSpace(q, end);
+          if (*q == '*') {
+            op->index = reg;
+            op->scale = (int)parseInt(skipSpace(q + 1, end), end, &q);
+          } else if (op->base == REG_NONE) {
+            op->base = reg;
+          } else {
+            op->index = reg;
+            op->scale = 1;
+          }
+        } else {
+          if (op->sym || neg) {
+            asmError("unsupported memory operand");
+          }
+          op->sym = findSymbol(p, q - p);
+        }
+        p = q;
+      }
+      p = skipSpace(p, end);
+      neg = false;
+    }
+    if (op->sym && op->base != REG_RIP) {
+      asmError("symbols are only supported as rip-relative operands");
+    }
+    return;
+  }
+
+  if (('0' <= *p && *p <= '9' && !isNumericLabelRef(p, end)) || *p == '-') {
+    op->kind = OPND_IMM;
+    op->disp = parseInt(p, end, &p);
+    return;
+  }
+
+  int *code = hashmapGet(&registers, intern(p, end - p));
+  if (code && *code & 0x80) {
+    op->kind = OPND_XMM;
+    op->reg = *code & 15;
+    op->size = 16;
+    return;
+  }
+  if (code && *code != 0x100) {
+    op->kind = OPND_REG;
+    op->reg = *code & 15;
+    op->size = 1 << (*code >> 4);
+    op->needs_rex = op->size == 1 && op->reg >= 4 && op->reg < 8;
+    return;
+  }
+  op->kind = OPND_SYM;
+  op->sym = isNumericLabelRef(p, end) ? numericLabel(p, 2, false)
+                                      : findSymbol(p, end - p);
+}
+
+bool fitsInt8(int64_t val) { return -128 <= val && val <= 127; }
+
+// Immediates are written as the operand size sees them, so that 4294967295
+// compared with a 32-bit register is the 8-bit -1.
+int64_t truncImm(int64_t val, int size) {
+  switch (size) {
+  case 1:
+    return (int8_t)val;
+  case 2:
+    return (int16_t)val;
+  case 4:
+    return (int32_t)val;
+  default:
+    return val;
+  }
+}
+
+int operandSize(AsmOperand *a, AsmOperand *b) {
+  if (a->kind == OPND_REG) {
+    return a->size;
+  }
+  if (b && b->kind == OPND_REG) {
+    return b->size;
+  }
+  if (a->size) {
+    return a->size;
+  }
+  asmError("operand size is ambiguous");
+  return 0;
+}
+
+void emitPrefixes(int flags, int reg, AsmOperand *rm) {
+  if (flags & PFX_66) {
+    emitByte(0x66);
+  }
+  if (flags & PFX_F2) {
+    emitByte(0xf2);
+  }
+  if (flags & PFX_F3) {
+    emitByte(0xf3);
+  }
+  int rex = 0x40;
+  if (flags & PFX_REXW) {
+    rex |= 8;
+  }
+  if (reg & 8) {
+    rex |= 4;
+  }
+  if (rm && rm->kind == OPND_MEM) {
+    if (rm->index != REG_NONE && rm->index & 8) {
+      rex |= 2;
+    }
+    if (rm->base != REG_NONE && rm->base != REG_RIP && rm->base & 8) {
+      rex |= 1;
+    }
+  } else if (rm && rm->reg & 8) {
+    rex |= 1;
+  }
+  if (rex != 0x40 || flags & PFX_REX) {
+    emitByte(rex);
+  }
+}
+
+// Emits an instruction's prefixes, opcode and ModRM, with `rm` as the operand
+// in the r/m field. Opcodes above 0xff are two bytes. A rip-relative
+// displacement is measured from the end of the instruction, so it must know
+// the size of any immediate that follows.
+void emitRM(int flags, int opcode, int reg, AsmOperand *rm, size_t imm_len) {
+  emitPrefixes(flags, reg, rm);
+  if (opcode > 0xff) {
+    emitByte(opcode >> 8);
+  }
+  emitByte(opcode & 0xff);
+  reg &= 7;
+  if (rm->kind != OPND_MEM) {
+    emitByte(0xc0 | reg << 3 | (rm->reg & 7));
+    return;
+  }
+  if (rm->base == REG_RIP) {
+    emitByte(reg << 3 | 5);
+    addFixup(FIX_PC32, rm->sym, rm->disp - 4 - (int64_t)imm_len);
+    emitImm(0, 4);
+    return;
+  }
+  const int base = rm->base & 7;
+  int mod = 0;
+  if (rm->disp != 0 || base == 5) {
+    mod = fitsInt8(rm->disp) ? 1 : 2;
+  }
+  if (rm->index != REG_NONE || base == 4) {
+    int scale = 0;
+    while (rm->index != REG_NONE && (1 << scale) < rm->scale) {
+      scale++;
+    }
+    emitByte(mod << 6 | reg << 3 | 4);
+    emitByte(scale << 6 | (rm->index != REG_NONE ? rm->index & 7 : 4) << 3 |
+             base);
+  } else {
+    emitByte(mod << 6 | reg << 3 | base);
+  }
+  if (mod == 1) {
+    emitImm(rm->disp, 1);
+  } else if (mod == 2) {
+    emitImm(rm->disp, 4);
+  }
+}
+
+// Emits an instruction with its register encoded in the low opcode bits.
+void emitOpReg(int flags, int opcode, int reg) {
+  AsmOperand rm = {0};
+  rm.kind = OPND_REG;
+  rm.reg = reg;
+  emitPrefixes(flags, 0, &rm);
+  emitByte(opcode + (reg & 7));
+}
+
+void emitInstruction(const AsmMnemonic *mn, AsmOperand *ops, size_t op_cnt) {
+  AsmOperand *dst = &ops[0];
+  AsmOperand *src = op_cnt > 1 ? &ops[1] : NULL;
+  int flags = mn->prefix & (PFX_66 | PFX_F2 | PFX_F3 | PFX_REXW);
+  if ((op_cnt > 0 && dst->needs_rex) || (src && src->needs_rex)) {
+    flags |= PFX_REX;
+  }
+  int size = 0;
+
+  switch (mn->kind) {
+  case MN_ALU:
+  case MN_MOV:
+  case MN_TEST:
+  case MN_UNARY:
+  case MN_SHIFT:
+  case MN_SETCC:
+    if (op_cnt == 0) {
+      asmError("missing operands for '%s'", mn->name);
+    }
+    size = mn->kind == MN_SETCC ? 1 : operandSize(dst, src);
+    if (size == 2) {
+      flags |= PFX_66;
+    } else if (size == 8) {
+      flags |= PFX_REXW;
+    }
+    break;
+  default:
+    break;
+  }
+
+  switch (mn->kind) {
+  case MN_ALU:
+    if (src->kind == OPND_IMM) {
+      const int64_t imm = truncImm(src->disp, size);
+      if (size == 1) {
+        if (dst->kind == OPND_REG && dst->reg == 0) {
+          emitPrefixes(flags, 0, NULL);
+          emitByte(mn->ext * 8 + 4);
+        } else {
+          emitRM(flags, 0x80, mn->ext, dst, 1);
+        }
+        emitImm(imm, 1);
+      } else if (fitsInt8(imm)) {
+        emitRM(flags, 0x83, mn->ext, dst, 1);
+        emitImm(imm, 1);
+      } else {
+        const int imm_size = size == 2 ? 2 : 4;
+        if (dst->kind == OPND_REG && dst->reg == 0) {
+          emitPrefixes(flags, 0, NULL);
+          emitByte(mn->ext * 8 + 5);
+        } else {
+          emitRM(flags, 0x81, mn->ext, dst, imm_size);
+        }
+        emitImm(imm, imm_size);
+      }
+    } else if (src->kind == OPND_REG) {
+      emitRM(flags, mn->ext * 8 + (size == 1 ? 0 : 1), src->reg, dst, 0);
+    } else {
+      emitRM(flags, mn->ext * 8 + (size == 1 ? 2 : 3), dst->reg, src, 0);
+    }
+    return;
+  case MN_MOV:
+    if (src->kind == OPND_IMM) {
+      const int64_t imm = truncImm(src->disp, size);
+      if (dst->kind == OPND_REG) {
+        if (size == 8 && imm == (int32_t)imm) {
+          emitRM(flags, 0xc7, 0, dst, 4);
+          emitImm(imm, 4);
+          return;
+        }
+        emitOpReg(flags, size == 1 ? 0xb0 : 0xb8, dst->reg);
+        emitImm(imm, size);
+        return;
+      }
+      const int imm_size = size == 8 ? 4 : size;
+      emitRM(flags, size == 1 ? 0xc6 : 0xc7, 0, dst, imm_size);
+      emitImm(imm, imm_size);
+    } else if (src->kind == OPND_REG) {
+      emitRM(flags, size == 1 ? 0x88 : 0x89, src->reg, dst, 0);
+    } else {
+      emitRM(flags, size == 1 ? 0x8a : 0x8b, dst->reg, src, 0);
+    }
+    return;
+  case MN_TEST:
+    emitRM(flags, mn->opcode + (size == 1 ? 0 : 1), src->reg, dst, 0);
+    return;
+  case MN_UNARY:
+    emitRM(flags, size == 1 ? 0xf6 : 0xf7, mn->ext, dst, 0);
+    return;
+  case MN_SHIFT:
+    if (!src || (src->kind == OPND_IMM && src->disp == 1)) {
+      emitRM(flags, size == 1 ? 0xd0 : 0xd1, mn->ext, dst, 0);
+    } else if (src->kind == OPND_REG && src->reg == 1 && src->size == 1) {
+      emitRM(flags, size == 1 ? 0xd2 : 0xd3, mn->ext, dst, 0);
+    } else if (src->kind == OPND_IMM) {
+      emitRM(flags, size == 1 ? 0xc0 : 0xc1, mn->ext, dst, 1);
+      emitImm(src->disp, 1);
+    } else {
+      asmError("unsupported shift count");
+    }
+    return;
+  case MN_SETCC:
+    emitRM(flags, 0x0f90 + mn->ext, 0, dst, 0);
+    return;
+  case MN_LEA:
+  case MN_MOVSXD:
+  case MN_IMUL:
+    if (dst->size == 8) {
+      flags |= PFX_REXW;
+    } else if (dst->size == 2) {
+      flags |= PFX_66;
+    }
+    emitRM(flags, mn->opcode, dst->reg, src, 0);
+    return;
+  case MN_MOVX: {
+    if (dst->size == 8) {
+      flags |= PFX_REXW;
+    } else if (dst->size == 2) {
+      flags |= PFX_66;
+    }
+    const int src_size = src->size ? src->size : 1;
+    if (src_size != 1 && src_size != 2) {
+      asmError("unsupported source size for '%s'", mn->name);
+    }
+    emitRM(flags, mn->opcode + (src_size == 2), dst->reg, src, 0);
+    return;
+  }
+  case MN_PUSH:
+  case MN_POP:
+    if (dst->kind != OPND_REG || dst->size != 8) {
+      asmError("'%s' takes a 64-bit register", mn->name);
+    }
+    emitOpReg(0, mn->opcode, dst->reg);
+    return;
+  case MN_NULLARY:
+    if (mn->prefix) {
+      emitByte(mn->prefix);
+    }
+    emitByte(mn->opcode);
+    return;
+  case MN_JCC:
+  case MN_JMP:
+    if (dst->kind == OPND_SYM) {
+      AsmItem *item = newItem(ITEM_JUMP);
+      item->sym = dst->sym;
+      item->cond = mn->kind == MN_JCC ? mn->ext : -1;
+      dst->sym->is_used = true;
+      return;
+    }
+    if (mn->kind == MN_JCC) {
+      asmError("conditional jumps take a label");
+    }
+    emitRM(flags, 0xff, 4, dst, 0);
+    return;
+  case MN_CALL:
+    if (dst->kind == OPND_SYM) {
+      emitByte(0xe8);
+      addFixup(FIX_PLT32, dst->sym, -4);
+      emitImm(0, 4);
+      return;
+    }
+    emitRM(flags, 0xff, 2, dst, 0);
+    return;
+  case MN_SSE:
+    emitRM(flags, mn->opcode, dst->reg, src, 0);
+    return;
+  case MN_SSE_MOV:
+    if (dst->kind == OPND_XMM) {
+      emitRM(flags, mn->opcode, dst->reg, src, 0);
+    } else {
+      emitRM(flags, mn->opcode + 1, src->reg, dst, 0);
+    }
+    return;
+  case MN_MOVQ:
+    if (dst->kind == OPND_XMM && src->kind == OPND_REG) {
+      emitRM(flags, 0x0f6e, dst->reg, src, 0);
+    } else if (dst->kind == OPND_REG && src->kind == OPND_XMM) {
+      emitRM(flags, 0x0f7e, src->reg, dst, 0);
+    } else {
+      asmError("unsupported operands for 'movq'");
+    }
+    return;
+  case MN_CVT2SI:
+    if (dst->size == 8) {
+      flags |= PFX_REXW;
+    }
+    emitRM(flags, mn->opcode, dst->reg, src, 0);
+    return;
+  case MN_CVTSI2:
+    if (src->size == 8) {
+      flags |= PFX_REXW;
+    }
+    emitRM(flags, mn->opcode, dst->reg, src, 0);
+    return;
+  default:
+    break;
+  }
+  asmError("unsupported instruction '%s'", mn->name);
+}
+
+size_t itemSize(AsmItem *item) {
+  switch (item->kind) {
+  case ITEM_DATA:
+    return item->len;
+  case ITEM_JUMP:
+    if (!item->is_long) {
+      return 2;
+    }
+    return item->cond < 0 ? 5 : 6;
+  case ITEM_ALIGN:
+    return (item->align - item->addr % item->align) % item->align;
+  default:
+    return 0;
+  }
+}
+
+// Jumps start short and are made long when their target is out of reach.
+// Growing one jump can push others out of reach, so layout repeats until
+// nothing changes.
+void layoutSection(AsmSection *sec) {
+  for (AsmItem *item = sec->items; item; item = item->next) {
+    if (item->kind == ITEM_JUMP &&
+        (item->sym->section != sec || item->sym->is_global)) {
+      if (!item->sym->section && item->sym->is_temp) {
+        asmError("undefined label '%s'", item->sym->name);
+      }
+      item->is_long = true;
+    }
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    uint64_t addr = 0;
+    for (AsmItem *item = sec->items; item; item = item->next) {
+      item->addr = addr;
+      if (item->kind == ITEM_LABEL) {
+        item->sym->value = addr;
+      }
+      addr += itemSize(item);
+    }
+    sec->size = addr;
+    for (AsmItem *item = sec->items; item; item = item->next) {
+      if (item->kind == ITEM_JUMP && !item->is_long &&
+          !fitsInt8((int64_t)(item->sym->value - (item->addr + 2)))) {
+        item->is_long = true;
+        changed = true;
+      }
+    }
+  }
+  if (sec->align == 0) {
+    sec->align = 1;
+  }
+}
+
+void writeSection(AsmSection *sec) {
+  if (sec->type != SHT_NOBITS) {
+    sec->data = arenaCalloc(&asm_arena, sec->size + 1, 1);
+    sec->cap = sec->size + 1;
+  }
+  // Fixups were recorded in item order, so relocations come out sorted by
+  // offset.
+  AsmFixup *fix = sec->fixups;
+  for (AsmItem *item = sec->items; item; item = item->next) {
+    if (item->kind == ITEM_DATA && item->data) {
+      memcpy(sec->data + item->addr, item->data, item->len);
+    } else if (item->kind == ITEM_JUMP) {
+      emitJump(sec, item);
+    } else if (item->kind == ITEM_ALIGN && sec->data &&
+               sec->flags & SHF_EXECINSTR) {
+      memset(sec->data + item->addr, 0x90, itemSize(item));
+    }
+    for (; fix && fix->item == item; fix = fix->next) {
+      resolveFixup(sec, fix);
+    }
+  }
+}
+
+void emitJump(AsmSection *sec, AsmItem *item) {
+  char *out = sec->data + item->addr;
+  const uint64_t end = item->addr + itemSize(item);
+  const int64_t disp = (int64_t)(item->sym->value - end);
+  if (!item->is_long) {
+    out[0] = (char)(item->cond < 0 ? 0xeb : 0x70 + item->cond);
+    out[1] = (char)disp;
+    return;
+  }
+  size_t pos = 0;
+  if (item->cond < 0) {
+    out[pos++] = (char)0xe9;
+  } else {
+    out[pos++] = 0x0f;
+    out[pos++] = (char)(0x80 + item->cond);
+  }
+  if (item->sym->section == sec && !item->sym->is_global) {
+    putField(out + pos, disp, 4);
+    return;
+  }
+  addReloc(sec, item->addr + pos, R_X86_64_PLT32, item->sym, -4);
+}
+
+void putField(char *out, int64_t val, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    out[i] = (char)((uint64_t)val >> (8 * i));
+  }
+}
+
+// References to labels in the same section are patched directly; everything
+// else is left to the linker.
+void resolveFixup(AsmSection *sec, AsmFixup *fix) {
+  const uint64_t place = fix->item->addr + fix->offset;
+  char *out = sec->data + place;
+  AsmSymbol *sym = fix->sym;
+  const bool is_local = sym->section == sec && !sym->is_global;
+  switch (fix->kind) {
+  case FIX_PC32:
+  case FIX_PLT32:
+    if (is_local) {
+      putField(out, (int64_t)(sym->value - place) + fix->addend, 4);
+    } else {
+      addReloc(sec, place,
+               fix->kind == FIX_PLT32 ? R_X86_64_PLT32 : R_X86_64_PC32, sym,
+               fix->addend);
+    }
+    return;
+  case FIX_ABS64:
+    addReloc(sec, place, R_X86_64_64, sym, fix->addend);
+    return;
+  case FIX_DIFF32:
+    if (fix->base->section != sec) {
+      asmError("'%s' is not in section '%s'", fix->base->name, sec->name);
+    }
+    if (is_local) {
+      putField(out, (int64_t)(sym->value - fix->base->value) + fix->addend, 4);
+    } else {
+      addReloc(sec, place, R_X86_64_PC32, sym,
+               fix->addend + (int64_t)(place - fix->base->value));
+    }
+    return;
+  default:
+    break;
+  }
+}
+
+// Relocations against local symbols are made against their section instead,
+// as the symbols themselves may not be in the symbol table. As in `as`, one
+// with an addend into a mergeable section keeps its symbol, since the linker
+// cannot tell which merged entry a section offset plus addend points into.
+void addReloc(AsmSection *sec, uint64_t offset, int type, AsmSymbol *sym,
+              int64_t addend) {
+  AsmReloc *rel = arenaCalloc(&asm_arena, 1, sizeof(AsmReloc));
+  rel->offset = offset;
+  rel->type = type;
+  if (sym->section && !sym->is_global &&
+      !(sym->section->flags & SHF_MERGE && addend && !sym->is_temp)) {
+    rel->section = sym->section;
+    rel->addend = addend + (int64_t)sym->value;
+  } else {
+    if (sym->is_temp) {
+      asmError("undefined label '%s'", sym->name);
+    }
+    sym->is_global |= !sym->section;
+    rel->sym = sym;
+    rel->addend = addend;
+  }
+  if (sec->last_reloc) {
+    sec->last_reloc = sec->last_reloc->next = rel;
+  } else {
+    sec->relocs = sec->last_reloc = rel;
+  }
+  sec->reloc_cnt++;
+}
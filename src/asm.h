@@ -0,0 +1,8 @@
+#ifndef ASM_H
+#define ASM_H
+
+#include <stddef.h>
+
+void assemble(const char *text, size_t len, const char *output_path);
+
+#endif // ASM_H
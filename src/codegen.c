@@ -1,28 +1,71 @@
 #include "codegen.h"
 
 #include <assert.h>
-#include <stdarg.h>
+#include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
+#include "arena.h"
 #include "comp_err.h"
 #include "defs.h"
+#include "emit.h"
+#include "ir.h"
 #include "parse.h"
+#include "peephole.h"
 
 enum { I8, I16, I32, I64, U8, U16, U32, U64, F32, F64 };
+enum { NUM_GP_REGS = 8, FIRST_CALLEE_SAVED = 2, NUM_FP_REGS = 8 };
+enum { RED_ZONE_SIZE = 128 };
+enum { MAX_UNROLLED_COPY = 128, MAX_UNROLLED_ZERO = 128 };
+enum { MIN_ZERO_RUN = 8, MIN_TEXT_RUN = 2 };
 
+extern Arena fn_arena;
+extern bool do_emit_stats;
+extern bool do_omit_frame_pointer;
+extern int gen_jobs;
+extern size_t insts_emitted;
 extern FILE *output;
-extern const char *input_file_path;
+extern File *files;
 extern Obj *prog;
 extern Obj *globals;
-static size_t stack_depth = 0;
 static Obj *cur_fn = NULL;
-static size_t label_num = 1;
+static IRFunc *cur_ir = NULL;
+static BasicBlock *next_bb = NULL;
+static size_t cur_fn_no = 0;
+static size_t label_num = 0;
+static int cur_file_no = 0;
+static size_t cur_line = 0;
+static size_t *vreg_start = NULL;
+static size_t *vreg_end = NULL;
+static int *vreg_reg = NULL;
+static size_t *vreg_slot = NULL;
+static size_t save_slots[NUM_GP_REGS];
+static bool is_leaf = false;
+static bool use_fp = true;
+static size_t frame_size = 0;
+static const char *frame_reg = "rbp";
+static char *ret_label = NULL;
+size_t frame_bytes = 0;
+size_t frame_bytes_saved = 0;
 static const char *argreg8[] = {"dil", "sil", "dl", "cl", "r8b", "r9b"};
 static const char *argreg16[] = {"di", "si", "dx", "cx", "r8w", "r9w"};
 static const char *argreg32[] = {"edi", "esi", "edx", "ecx", "r8d", "r9d"};
-static const char *argreg64[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+static const int argreg64[] = {REG_RDI, REG_RSI, REG_RDX,
+                               REG_RCX, REG_R8,  REG_R9};
+static const char *copyreg[] = {"r8b", "r8w", "r8d", "r8"};
+static const char *accreg[] = {"al", "ax", "eax", "rax"};
+static const char *ptr_sizes[] = {"BYTE", "WORD", "DWORD", "QWORD"};
+// r10 and r11 are caller-saved, the rest are callee-saved. rbp is only
+// allocated in functions that do not keep a frame pointer.
+static const int allocreg[] = {REG_R10, REG_R11, REG_RBX, REG_R12,
+                               REG_R13, REG_R14, REG_R15, REG_RBP};
+static const int allocfreg[] = {REG_XMM8,  REG_XMM9,  REG_XMM10, REG_XMM11,
+                                REG_XMM12, REG_XMM13, REG_XMM14, REG_XMM15};
 static const char f32f64[] = "cvtss2sd  xmm0, xmm0";
 static const char f32i16[] = "cvttss2si eax, xmm0; movsx eax, ax";
 static const char f32i32[] = "cvttss2si  eax, xmm0";
@@ -77,45 +120,89 @@ static const char *cast_table[][10] = {
     // clang-format on
 };
 
+static PeepOperand vregOperand(size_t v);
+static bool crossesCall(size_t *calls, size_t v);
+static bool isAllZero(const char *data, size_t size);
+static bool isCString(Obj *lit);
+static bool isSuffix(Obj *lit, Obj *of);
+static const char *bbLabel(BasicBlock *bb);
+static int compareTails(Obj *a, Obj *b);
 static int getTypeId(Type *ty);
-static void assignLvarOffsets(Obj *prog);
+static int moveOpcode(size_t v);
+static long slotDisp(size_t offset);
+static size_t runLength(const char *data, size_t start, size_t end,
+                        bool is_text);
+static size_t assignLvarOffsets(Obj *fn);
+static size_t maxTreeAt(size_t *tree, size_t m, size_t i);
+static size_t maxTreeRange(size_t *tree, size_t m, size_t l, size_t r);
+static size_t numberInsts(BasicBlock **order, size_t cnt, size_t *bb_start,
+                          size_t *bb_end);
+static void addGenStats(FILE *fp);
+static void allocRegs(Obj *fn);
+static void buildIntervals(BasicBlock **order, size_t cnt, size_t *calls);
+static void canonicalise(Type *ty);
 static void cast(Type *from, Type *to);
+static void castInt(int from, int to);
+static void cmpCase(IRInst *inst, int64_t val);
 static void cmpZero(Type *ty);
-static void genAddr(Node *node);
-static void genExpr(Node *node);
-static void genStmt(Node *node);
+static void copyAggregate(size_t size);
+static void emitBinary(IRInst *inst);
+static void emitBr(IRInst *inst);
+static void emitCall(IRInst *inst);
+static void emitData(const char *data, size_t start, size_t end);
+static void emitExtend(bool is_unsigned, size_t size);
+static void emitFunc(Obj *fn);
+static void emitInst(IRInst *inst);
+static void emitJmp(BasicBlock *bb);
+static void emitJumpTable(IRInst *inst, int64_t *vals, BasicBlock **bbs,
+                          size_t lo, size_t hi);
+static void emitSwitch(IRInst *inst);
+static void genFuncs(size_t first, size_t last);
+static void genParallel(size_t fn_cnt);
+static void emitRmw(IRInst *inst);
+static void emitStrLitPool(Obj **lits, size_t cnt, bool cstrings);
+static void emitStrLits(void);
+static void emitSwitchRange(IRInst *inst, int64_t *vals, BasicBlock **bbs,
+                            size_t lo, size_t hi, bool is_last);
+static void extendInterval(size_t v, size_t pos);
+static void liveness(BasicBlock **order, size_t cnt, uint64_t *live_in,
+                     uint64_t *live_out);
 static void load(Type *ty);
-static void pop(const char *arg);
-static void popf(size_t i);
-static void println(const char *fmt, ...);
-static void push(void);
-static void pushArgs(Node *args);
-static void pushf(void);
+static void loadVreg(int reg, size_t v);
+static void maxTreeCover(size_t *tree, size_t m, size_t l, size_t r,
+                         size_t val);
+static void maxTreeSet(size_t *tree, size_t m, size_t i, size_t val);
+static void sortCases(int64_t *vals, BasicBlock **bbs, size_t n,
+                      bool is_unsigned);
+static void sortStrLits(Obj **lits, size_t n);
 static void store(Type *ty);
 static void storeArgReg(size_t r, size_t offset, size_t sz);
 static void storeFp(size_t r, size_t offset, size_t sz);
+static void storeParams(Obj *fn);
+static void storeVreg(size_t v, int reg);
+static void writeGenStats(FILE *fp);
+static void zeroLocal(size_t offset, size_t size);
 
-void assignLvarOffsets(Obj *prog) {
-  for (Obj *fn = prog; fn; fn = fn->next) {
-    if (!fn->body) {
-      continue;
-    }
-    size_t offset = 0;
-    for (Obj *var = fn->locals; var; var = var->next) {
-      offset += var->ty->size;
-      offset = alignTo(offset, var->align);
-      var->offset = offset;
-    }
-    fn->stack_size = alignTo(offset, 16);
+bool castIsNop(Type *from, Type *to) {
+  if (to->kind == TY_VOID) {
+    return true;
+  }
+  if (to->kind == TY_BOOL) {
+    return false;
   }
+  return cast_table[getTypeId(from)][getTypeId(to)] == NULL;
 }
 
 void gen() {
-  assignLvarOffsets(prog);
-  println(".file 1 \"%s\"", input_file_path);
+  for (File *file = files; file; file = file->next) {
+    if (file->file_no) {
+      println(".file %d \"%s\"", file->file_no, file->name);
+    }
+  }
   println(".intel_syntax noprefix");
+  emitStrLits();
   for (Obj *var = globals; var; var = var->next) {
-    if (!var->is_definition) {
+    if (!var->is_definition || var->is_str_lit) {
       continue;
     }
     if (var->is_static) {
@@ -123,416 +210,1341 @@ void gen() {
     } else {
       println(".globl %s", var->name);
     }
-    println(".align %zu", var->align);
-    if (var->init_data) {
+    // Const objects are read-only, unless they hold addresses that the
+    // dynamic linker may have to patch.
+    if (var->is_readonly && !var->rel) {
+      println("  .section .rodata");
+      println(".align %zu", var->align);
+      println("%s:", var->name);
+      if (var->init_data) {
+        emitData(var->init_data, 0, var->ty->size);
+      } else {
+        println("  .zero %zu", var->ty->size);
+      }
+      continue;
+    }
+    if (var->init_data && (var->rel || !isAllZero(var->init_data,
+                                                   var->ty->size))) {
       println("  .data");
+      println(".align %zu", var->align);
       println("%s:", var->name);
-      Relocation *rel = var->rel;
-      ssize_t pos = 0;
-      while (pos < var->ty->size) {
-        if (rel && (ssize_t)rel->offset == pos) {
-          println("  .quad %s%+ld", rel->label, rel->addend);
-          rel = rel->next;
-          pos += 8;
-        } else {
-          println("  .byte %d", var->init_data[pos++]);
-        }
+      size_t pos = 0;
+      for (Relocation *rel = var->rel; rel; rel = rel->next) {
+        emitData(var->init_data, pos, rel->offset);
+        println("  .quad %s%+ld", rel->label, rel->addend);
+        pos = rel->offset + 8;
       }
+      emitData(var->init_data, pos, var->ty->size);
       continue;
     }
     println("  .bss");
+    println(".align %zu", var->align);
     println("%s:", var->name);
     println("  .zero %zu", var->ty->size);
   }
+  if (do_emit_stats) {
+    fprintf(stderr, "%-32s %10s\n", "function", "bytes");
+  }
+  size_t fn_cnt = 0;
   for (Obj *fn = prog; fn; fn = fn->next) {
+    fn_cnt += fn->body != NULL;
+  }
+  if (gen_jobs > 1 && fn_cnt > 1) {
+    genParallel(fn_cnt);
+  } else {
+    genFuncs(0, fn_cnt);
+  }
+  if (do_emit_stats) {
+    fprintf(stderr, "%-32s %10zu\n", "total", emitted());
+  }
+  emitFlush();
+}
+
+// String literals are never written, so they are pooled in read-only
+// sections. Sorting them by their reversed contents puts each directly before
+// any other that ends with it, so a literal that is a duplicate or a suffix of
+// another becomes just a label inside the longer literal's data. Plain C
+// strings go in a mergeable string section so the linker can also share them
+// between objects, and any other, such as one with a NUL inside, in .rodata.
+void emitStrLits(void) {
+  size_t cnt = 0;
+  for (Obj *var = globals; var; var = var->next) {
+    cnt += var->is_str_lit;
+  }
+  if (!cnt) {
+    return;
+  }
+  Obj **lits = arenaCalloc(&fn_arena, cnt, sizeof(Obj *));
+  size_t i = 0;
+  for (Obj *var = globals; var; var = var->next) {
+    if (var->is_str_lit) {
+      lits[i++] = var;
+    }
+  }
+  sortStrLits(lits, cnt);
+  emitStrLitPool(lits, cnt, true);
+  emitStrLitPool(lits, cnt, false);
+  arenaReset(&fn_arena);
+}
+
+bool isCString(Obj *lit) {
+  const size_t size = lit->ty->size;
+  return lit->ty->base->size == 1 && lit->align == 1 && size &&
+         !lit->init_data[size - 1] && !memchr(lit->init_data, 0, size - 1);
+}
+
+// Emits the runs of sorted literals whose longest member, which holds the data
+// for the rest, is a C string or is not, as `cstrings` says.
+void emitStrLitPool(Obj **lits, size_t cnt, bool cstrings) {
+  bool started = false;
+  size_t first = 0;
+  for (size_t i = 0; i < cnt; i++) {
+    if (i + 1 < cnt && isSuffix(lits[i], lits[i + 1])) {
+      continue;
+    }
+    Obj *host = lits[i];
+    if (isCString(host) != cstrings) {
+      first = i + 1;
+      continue;
+    }
+    if (!started) {
+      println(cstrings ? "  .section .rodata.str1.1,\"aMS\",@progbits,1"
+                       : "  .section .rodata");
+      started = true;
+    }
+    size_t pos = 0;
+    println(".align %zu", host->align);
+    for (size_t j = i + 1; j-- > first;) {
+      const size_t offset = host->ty->size - lits[j]->ty->size;
+      emitData(host->init_data, pos, offset);
+      println(".local %s", lits[j]->name);
+      println("%s:", lits[j]->name);
+      pos = offset;
+    }
+    emitData(host->init_data, pos, host->ty->size);
+    first = i + 1;
+  }
+}
+
+bool isSuffix(Obj *lit, Obj *of) {
+  return lit->ty->size <= of->ty->size && !compareTails(lit, of);
+}
+
+// Compares the common tail of two literals, last byte first.
+int compareTails(Obj *a, Obj *b) {
+  const size_t n = a->ty->size < b->ty->size ? a->ty->size : b->ty->size;
+  for (size_t i = 1; i <= n; i++) {
+    const uint8_t x = a->init_data[a->ty->size - i];
+    const uint8_t y = b->init_data[b->ty->size - i];
+    if (x != y) {
+      return x < y ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+void sortStrLits(Obj **lits, size_t n) {
+  Obj **tmp = arenaCalloc(&fn_arena, n, sizeof(Obj *));
+  for (size_t width = 1; width < n; width *= 2) {
+    for (size_t lo = 0; lo < n; lo += 2 * width) {
+      const size_t mid = lo + width < n ? lo + width : n;
+      const size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+      size_t i = lo;
+      size_t j = mid;
+      for (size_t k = lo; k < hi; k++) {
+        bool take_left = j >= hi;
+        if (i < mid && j < hi) {
+          const int cmp = compareTails(lits[i], lits[j]);
+          take_left = cmp < 0 ||
+                      (!cmp && lits[i]->ty->size <= lits[j]->ty->size);
+        }
+        tmp[k] = i < mid && take_left ? lits[i++] : lits[j++];
+      }
+    }
+    for (size_t k = 0; k < n; k++) {
+      lits[k] = tmp[k];
+    }
+  }
+}
+
+// Generates the functions numbered [first, last) in source order. Labels
+// within a function are numbered by the function, so the output for each
+// function is the same whichever worker generates it.
+void genFuncs(size_t first, size_t last) {
+  size_t fn_no = 0;
+  for (Obj *fn = prog; fn && fn_no < last; fn = fn->next) {
     if (!fn->body) {
       continue;
     }
+    if (fn_no++ < first) {
+      continue;
+    }
+    const size_t start = emitted();
+    cur_fn_no = fn_no;
+    fn->ir = lowerFunc(fn);
+    emitFunc(fn);
+    fn->ir = NULL;
+    arenaReset(&fn_arena);
+    if (do_emit_stats) {
+      fprintf(stderr, "%-32s %10zu\n", fn->name, emitted() - start);
+    }
+    emitFlushIfFull();
+  }
+}
+
+// The functions are split into `gen_jobs` runs, each generated by a forked
+// worker. Processes rather than threads keep the workers apart because the
+// code generator holds its per-function state in globals, and ucc has no
+// function pointers with which to start a thread when it compiles itself. A
+// worker writes its assembly, its diagnostics and its counters to files of its
+// own; the parent appends the assembly to the output and replays the
+// diagnostics in source order, and adds up the counters, so neither the output
+// nor the statistics depend on the number of workers.
+void genParallel(size_t fn_cnt) {
+  const size_t n = (size_t)gen_jobs < fn_cnt ? (size_t)gen_jobs : fn_cnt;
+  FILE **parts = calloc(n, sizeof(FILE *));
+  FILE **logs = calloc(n, sizeof(FILE *));
+  FILE **stats = calloc(n, sizeof(FILE *));
+  int *pids = calloc(n, sizeof(int));
+  emitFlush();
+  fflush(output);
+  fflush(stderr);
+  for (size_t k = 0; k < n; k++) {
+    parts[k] = tmpfile();
+    logs[k] = tmpfile();
+    stats[k] = tmpfile();
+    if (!parts[k] || !logs[k] || !stats[k]) {
+      fprintf(stderr, "tmpfile failed: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    pids[k] = fork();
+    if (pids[k] == -1) {
+      fprintf(stderr, "fork failed: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    if (pids[k] == 0) {
+      dup2(fileno(logs[k]), STDERR_FILENO);
+      output = parts[k];
+      genFuncs(fn_cnt * k / n, fn_cnt * (k + 1) / n);
+      emitFlush();
+      fclose(output);
+      writeGenStats(stats[k]);
+      fclose(stats[k]);
+      exit(EXIT_SUCCESS);
+    }
+  }
+  bool failed = false;
+  for (size_t k = 0; k < n; k++) {
+    int status = 0;
+    failed = failed || waitpid(pids[k], &status, 0) == -1 || status != 0;
+  }
+  char buf[4096];
+  for (size_t k = 0; k < n; k++) {
+    size_t len = 0;
+    fseek(logs[k], 0, SEEK_SET);
+    while ((len = fread(buf, 1, sizeof(buf), logs[k])) > 0) {
+      fwrite(buf, 1, len, stderr);
+    }
+    fclose(logs[k]);
+  }
+  if (failed) {
+    exit(EXIT_FAILURE);
+  }
+  for (size_t k = 0; k < n; k++) {
+    size_t len = 0;
+    fseek(parts[k], 0, SEEK_SET);
+    while ((len = fread(buf, 1, sizeof(buf), parts[k])) > 0) {
+      emitBytes(buf, len);
+    }
+    fclose(parts[k]);
+    emitFlushIfFull();
+    addGenStats(stats[k]);
+    fclose(stats[k]);
+  }
+  free(parts);
+  free(logs);
+  free(stats);
+  free(pids);
+}
 
-    println(".%s %s", fn->is_global ? "globl" : "local", fn->name);
-    println(".text");
-    println("%s:", fn->name);
-    cur_fn = fn;
+// The parent has generated no functions when the workers start, so each
+// worker's counters are its own.
+void writeGenStats(FILE *fp) {
+  size_t counts[3];
+  counts[0] = insts_emitted;
+  counts[1] = frame_bytes;
+  counts[2] = frame_bytes_saved;
+  fwrite(counts, sizeof(size_t), 3, fp);
+  writePeepholeHits(fp);
+}
 
-    println("  push rbp");
-    println("  mov rbp, rsp");
-    println("  sub rsp, %zu", fn->stack_size);
+void addGenStats(FILE *fp) {
+  size_t counts[3] = {0};
+  fseek(fp, 0, SEEK_SET);
+  if (fread(counts, sizeof(size_t), 3, fp) != 3) {
+    fprintf(stderr, "failed to read a code generator's counters\n");
+    exit(EXIT_FAILURE);
+  }
+  insts_emitted += counts[0];
+  frame_bytes += counts[1];
+  frame_bytes_saved += counts[2];
+  addPeepholeHits(fp);
+}
+
+bool isAllZero(const char *data, size_t size) {
+  return runLength(data, 0, size, false) == size;
+}
+
+// The length of the run of zero bytes, or of text bytes, starting at `start`.
+size_t runLength(const char *data, size_t start, size_t end, bool is_text) {
+  size_t i = start;
+  if (is_text) {
+    while (i < end && ((data[i] >= ' ' && data[i] <= '~') ||
+                       data[i] == '\n' || data[i] == '\t')) {
+      i++;
+    }
+  } else {
+    while (i < end && !data[i]) {
+      i++;
+    }
+  }
+  return i - start;
+}
 
-    if (fn->va_area) {
-      size_t gp = 0;
-      size_t fp = 0;
-      for (Obj *var = fn->params; var; var = var->next) {
-        if (isFloat(var->ty)) {
-          fp++;
+// Emits the bytes of an initialiser in as few directives as practical:
+// `.zero` for runs of zeros, `.ascii` for text, `.quad` for other data and
+// `.byte` for what is left over.
+void emitData(const char *data, size_t start, size_t end) {
+  size_t i = start;
+  while (i < end) {
+    const size_t zeros = runLength(data, i, end, false);
+    if (zeros >= MIN_ZERO_RUN || (zeros && i + zeros == end)) {
+      println("  .zero %zu", zeros);
+      i += zeros;
+      continue;
+    }
+    const size_t text = runLength(data, i, end, true);
+    if (text >= MIN_TEXT_RUN) {
+      emitStr("  .ascii \"");
+      for (size_t j = i; j < i + text; j++) {
+        if (data[j] == '\n') {
+          emitStr("\\n");
+        } else if (data[j] == '\t') {
+          emitStr("\\t");
         } else {
-          gp++;
+          if (data[j] == '"' || data[j] == '\\') {
+            emitChar('\\');
+          }
+          emitChar(data[j]);
         }
       }
-      size_t offset = fn->va_area->offset;
-      println("  mov DWORD PTR [rbp-%zu], %zu", offset, gp * 8);
-      println("  mov DWORD PTR [rbp-%zu], %zu", offset - 4, fp * 8 + 48);
-      println("  mov QWORD PTR [rbp-%zu], rbp", offset - 16);
-      println("  sub QWORD PTR [rbp-%zu], %zu", offset - 16, offset - 24);
-      println("  mov QWORD PTR [rbp-%zu], rdi", offset - 24);
-      println("  mov QWORD PTR [rbp-%zu], rsi", offset - 32);
-      println("  mov QWORD PTR [rbp-%zu], rdx", offset - 40);
-      println("  mov QWORD PTR [rbp-%zu], rcx", offset - 48);
-      println("  mov QWORD PTR [rbp-%zu], r8", offset - 56);
-      println("  mov QWORD PTR [rbp-%zu], r9", offset - 64);
-      println("  movsd [rbp-%zu], xmm0", offset - 72);
-      println("  movsd [rbp-%zu], xmm1", offset - 80);
-      println("  movsd [rbp-%zu], xmm2", offset - 88);
-      println("  movsd [rbp-%zu], xmm3", offset - 96);
-      println("  movsd [rbp-%zu], xmm4", offset - 104);
-      println("  movsd [rbp-%zu], xmm5", offset - 112);
-      println("  movsd [rbp-%zu], xmm6", offset - 120);
-      println("  movsd [rbp-%zu], xmm7", offset - 128);
+      emitStr("\"\n");
+      i += text;
+      continue;
+    }
+    if (end - i >= 8) {
+      uint64_t val = 0;
+      for (int j = 7; j >= 0; j--) {
+        val = val << 8 | (uint8_t)data[i + j];
+      }
+      println("  .quad %ld", (int64_t)val);
+      i += 8;
+      continue;
     }
+    emitStr("  .byte ");
+    for (; i < end; i++) {
+      emitInt(data[i]);
+      emitChar(i + 1 < end ? ',' : '\n');
+    }
+  }
+}
 
-    size_t gp = 0;
-    size_t fp = 0;
-    for (Obj *param = fn->params; param; param = param->next) {
-      if (isFloat(param->ty)) {
-        storeFp(fn->param_cnt - (fp++) - 1, param->offset, param->ty->size);
-      } else {
-        storeArgReg(fn->param_cnt - (gp++) - 1, param->offset, param->ty->size);
+// Locals in memory are stacked in list order, each above every local placed
+// before it whose block overlaps its own. Locals of disjoint blocks so share
+// stack space, while locals that are live together keep the same layout as if
+// every local had a slot of its own, so neighbours declared together stay
+// neighbours.
+//
+// A placed span overlaps a new one if it begins within it, or covers the
+// point where it begins. Two max segment trees over the span positions answer
+// each in logarithmic time: one keyed by where each span begins, and one
+// holding each span over its whole range. Locals without a span overlap
+// everything.
+size_t assignLvarOffsets(Obj *fn) {
+  size_t lo = 0;
+  size_t hi = 0;
+  size_t unshared = 0;
+  for (Obj *var = fn->locals; var; var = var->next) {
+    if (!var->vreg) {
+      unshared = alignTo(unshared + var->ty->size, var->align);
+      if (var->scope_end) {
+        lo = !hi || var->scope_begin < lo ? var->scope_begin : lo;
+        hi = var->scope_end > hi ? var->scope_end : hi;
       }
     }
+  }
+  const size_t m = hi ? hi - lo + 1 : 0;
+  size_t *begins = arenaCalloc(&fn_arena, 2 * m + 1, sizeof(size_t));
+  size_t *covers = arenaCalloc(&fn_arena, 2 * m + 1, sizeof(size_t));
+  size_t size = 0;
+  for (Obj *var = fn->locals; var; var = var->next) {
+    if (var->vreg) {
+      continue;
+    }
+    size_t top = size;
+    if (var->scope_end) {
+      const size_t b = var->scope_begin - lo;
+      const size_t e = var->scope_end - lo;
+      const size_t within = maxTreeRange(begins, m, b, e + 1);
+      const size_t open = maxTreeAt(covers, m, b);
+      top = within > open ? within : open;
+    }
+    var->offset = alignTo(top + var->ty->size, var->align);
+    size = var->offset > size ? var->offset : size;
+    if (var->scope_end) {
+      maxTreeSet(begins, m, var->scope_begin - lo, var->offset);
+      maxTreeCover(covers, m, var->scope_begin - lo, var->scope_end - lo + 1,
+                   var->offset);
+    } else {
+      // Later locals of any span must be stacked above this one.
+      maxTreeCover(covers, m, 0, m, var->offset);
+    }
+  }
+  frame_bytes += size;
+  frame_bytes_saved += unshared - size;
+  return size;
+}
 
-    genStmt(fn->body);
+// The trees are stored bottom-up, with the leaves for positions 0 to m - 1 at
+// m to 2m - 1 and each node at i above the pair at 2i and 2i + 1.
+void maxTreeSet(size_t *tree, size_t m, size_t i, size_t val) {
+  for (i += m; i; i >>= 1) {
+    tree[i] = val > tree[i] ? val : tree[i];
+  }
+}
 
-    println(".L.return.%s:", fn->name);
-    println("  mov rsp, rbp");
-    println("  pop rbp");
-    println("  ret");
+// The highest value set in [l, r).
+size_t maxTreeRange(size_t *tree, size_t m, size_t l, size_t r) {
+  size_t max = 0;
+  for (l += m, r += m; l < r; l >>= 1, r >>= 1) {
+    if (l & 1) {
+      max = tree[l] > max ? tree[l] : max;
+      l++;
+    }
+    if (r & 1) {
+      r--;
+      max = tree[r] > max ? tree[r] : max;
+    }
   }
+  return max;
 }
 
-void genStmt(Node *node) {
-  println("  .loc 1 %zu", node->tok->line_num);
-  switch (node->kind) {
-  case ND_BLK:
-    for (Node *n = node->body; n; n = n->next) {
-      genStmt(n);
+// Raises every position in [l, r) to at least `val`.
+void maxTreeCover(size_t *tree, size_t m, size_t l, size_t r, size_t val) {
+  for (l += m, r += m; l < r; l >>= 1, r >>= 1) {
+    if (l & 1) {
+      tree[l] = val > tree[l] ? val : tree[l];
+      l++;
     }
-    return;
-  case ND_IF: {
-    const size_t c = label_num++;
-    genExpr(node->cond);
-    cmpZero(node->cond->ty);
-    println("  je .L.else%zu", c);
-    genStmt(node->then);
-    println("  jmp .L.end%zu", c);
-    println(".L.else%zu:", c);
-    if (node->els) {
-      genStmt(node->els);
+    if (r & 1) {
+      r--;
+      tree[r] = val > tree[r] ? val : tree[r];
     }
-    println(".L.end%zu:", c);
-    return;
   }
-  case ND_FOR: {
-    const size_t c = label_num++;
-    if (node->pre) {
-      genStmt(node->pre);
+}
+
+// The highest value covering position i.
+size_t maxTreeAt(size_t *tree, size_t m, size_t i) {
+  size_t max = 0;
+  for (i += m; i; i >>= 1) {
+    max = tree[i] > max ? tree[i] : max;
+  }
+  return max;
+}
+
+// Positions are even for instructions, and odd for block boundaries, so that
+// an interval ending at an instruction never overlaps one starting there.
+size_t numberInsts(BasicBlock **order, size_t cnt, size_t *bb_start,
+                   size_t *bb_end) {
+  size_t pos = 1;
+  for (size_t i = 0; i < cnt; i++) {
+    bb_start[order[i]->id] = pos++;
+    for (IRInst *inst = order[i]->insts; inst; inst = inst->next) {
+      inst->pos = ++pos;
+      pos++;
     }
-    println(".L.begin%zu:", c);
-    if (node->cond) {
-      genExpr(node->cond);
-      cmpZero(node->cond->ty);
-      println("  je %s", node->brk_label);
+    bb_end[order[i]->id] = pos++;
+  }
+  return pos;
+}
+
+void liveness(BasicBlock **order, size_t cnt, uint64_t *live_in,
+              uint64_t *live_out) {
+  const size_t words = (cur_ir->vreg_cnt + 63) / 64;
+  uint64_t *use = arenaCalloc(&fn_arena, cur_ir->block_cnt * words, sizeof(uint64_t));
+  uint64_t *def = arenaCalloc(&fn_arena, cur_ir->block_cnt * words, sizeof(uint64_t));
+
+  for (size_t i = 0; i < cnt; i++) {
+    uint64_t *u = use + order[i]->id * words;
+    uint64_t *d = def + order[i]->id * words;
+    for (IRInst *inst = order[i]->insts; inst; inst = inst->next) {
+      for (size_t j = 0; j < inst->arg_cnt + 2; j++) {
+        size_t v = j == 0 ? inst->lhs : j == 1 ? inst->rhs : inst->args[j - 2];
+        if (v && !(d[v / 64] & ((uint64_t)1 << (v % 64)))) {
+          u[v / 64] |= (uint64_t)1 << (v % 64);
+        }
+      }
+      if (inst->dst) {
+        d[inst->dst / 64] |= (uint64_t)1 << (inst->dst % 64);
+      }
     }
-    genStmt(node->body);
-    println("%s:", node->cont_label);
-    if (node->post) {
-      genExpr(node->post);
+  }
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = cnt; i > 0; i--) {
+      BasicBlock *bb = order[i - 1];
+      IRInst *term = bb->last;
+      uint64_t *out = live_out + bb->id * words;
+      uint64_t *in = live_in + bb->id * words;
+      size_t succ_cnt = term->op == IR_SWITCH ? term->case_cnt + 2 : 2;
+      for (size_t j = 0; j < succ_cnt; j++) {
+        BasicBlock *succ = j == 0 ? term->then
+                           : j == 1 ? term->els
+                                    : term->case_bbs[j - 2];
+        if (!succ) {
+          continue;
+        }
+        uint64_t *succ_in = live_in + succ->id * words;
+        for (size_t w = 0; w < words; w++) {
+          out[w] |= succ_in[w];
+        }
+      }
+      uint64_t *u = use + bb->id * words;
+      uint64_t *d = def + bb->id * words;
+      for (size_t w = 0; w < words; w++) {
+        uint64_t val = u[w] | (out[w] & ~d[w]);
+        if (val != in[w]) {
+          in[w] = val;
+          changed = true;
+        }
+      }
     }
-    println("  jmp .L.begin%zu", c);
-    println("%s:", node->brk_label);
-    return;
   }
-  case ND_WHILE: {
-    const size_t c = label_num++;
-    println(".L.begin%zu:", c);
-    println("%s:", node->cont_label);
-    if (node->cond) {
-      genExpr(node->cond);
-      cmpZero(node->cond->ty);
-      println("  je %s", node->brk_label);
+
+}
+
+void extendInterval(size_t v, size_t pos) {
+  if (pos < vreg_start[v]) {
+    vreg_start[v] = pos;
+  }
+  if (pos > vreg_end[v]) {
+    vreg_end[v] = pos;
+  }
+}
+
+// Every virtual register gets a single interval spanning all of the positions
+// at which it is live. `calls[p]` counts the calls at or before position p.
+void buildIntervals(BasicBlock **order, size_t cnt, size_t *calls) {
+  const size_t words = (cur_ir->vreg_cnt + 63) / 64;
+  uint64_t *live_in = arenaCalloc(&fn_arena, cur_ir->block_cnt * words, sizeof(uint64_t));
+  uint64_t *live_out = arenaCalloc(&fn_arena, cur_ir->block_cnt * words, sizeof(uint64_t));
+  size_t *bb_start = arenaCalloc(&fn_arena, cur_ir->block_cnt, sizeof(size_t));
+  size_t *bb_end = arenaCalloc(&fn_arena, cur_ir->block_cnt, sizeof(size_t));
+
+  const size_t end = numberInsts(order, cnt, bb_start, bb_end);
+  liveness(order, cnt, live_in, live_out);
+
+  for (size_t v = 0; v < cur_ir->vreg_cnt; v++) {
+    vreg_start[v] = (size_t)-1;
+    vreg_end[v] = 0;
+  }
+  for (size_t i = 0; i < cnt; i++) {
+    BasicBlock *bb = order[i];
+    for (size_t v = 1; v < cur_ir->vreg_cnt; v++) {
+      const uint64_t bit = (uint64_t)1 << (v % 64);
+      if (live_in[bb->id * words + v / 64] & bit) {
+        extendInterval(v, bb_start[bb->id]);
+      }
+      if (live_out[bb->id * words + v / 64] & bit) {
+        extendInterval(v, bb_end[bb->id]);
+      }
+    }
+    for (IRInst *inst = bb->insts; inst; inst = inst->next) {
+      for (size_t j = 0; j < inst->arg_cnt + 2; j++) {
+        size_t v = j == 0 ? inst->lhs : j == 1 ? inst->rhs : inst->args[j - 2];
+        if (v) {
+          extendInterval(v, inst->pos);
+        }
+      }
+      if (inst->dst) {
+        extendInterval(inst->dst, inst->pos);
+      }
+      if (inst->op == IR_CALL) {
+        calls[inst->pos] = 1;
+      }
     }
-    genStmt(node->body);
-    println("  jmp .L.begin%zu", c);
-    println("%s:", node->brk_label);
-    return;
   }
-  case ND_GOTO:
-    println("  jmp %s", node->unique_label);
-    return;
-  case ND_LABEL:
-    println("%s:", node->unique_label);
-    genStmt(node->lhs);
-    return;
-  case ND_RET:
-    if (node->lhs) {
-      genExpr(node->lhs);
+  for (size_t p = 1; p < end; p++) {
+    calls[p] += calls[p - 1];
+  }
+  for (Obj *param = cur_fn->params; param; param = param->next) {
+    if (param->vreg && vreg_start[param->vreg] != (size_t)-1) {
+      extendInterval(param->vreg, 0);
     }
-    println("  jmp .L.return.%s", cur_fn->name);
-    return;
-  case ND_SWITCH:
-    genExpr(node->cond);
-    for (Node *n = node->case_next; n; n = n->case_next) {
-      const char *reg = (node->cond->ty->size == 8) ? "rax" : "eax";
-      println("  cmp %s, %ld", reg, n->val);
-      println("  je %s", n->label);
+  }
+
+}
+
+bool crossesCall(size_t *calls, size_t v) {
+  return calls[vreg_end[v] - 1] > calls[vreg_start[v]];
+}
+
+// Linear scan register allocation. Values that are live across a call may
+// only use callee-saved registers, and since every xmm register is
+// caller-saved, floating point values live across calls are always spilled.
+void allocRegs(Obj *fn) {
+  IRFunc *ir = fn->ir;
+  const size_t n = ir->vreg_cnt;
+  vreg_start = arenaCalloc(&fn_arena, n, sizeof(size_t));
+  vreg_end = arenaCalloc(&fn_arena, n, sizeof(size_t));
+  vreg_reg = arenaCalloc(&fn_arena, n, sizeof(int));
+  vreg_slot = arenaCalloc(&fn_arena, n, sizeof(size_t));
+
+  size_t cnt = 0;
+  for (BasicBlock *bb = ir->blocks; bb; bb = bb->next) {
+    cnt++;
+  }
+  BasicBlock **order = arenaCalloc(&fn_arena, cnt, sizeof(BasicBlock *));
+  cnt = 0;
+  for (BasicBlock *bb = ir->blocks; bb; bb = bb->next) {
+    order[cnt++] = bb;
+  }
+  size_t max_pos = 2;
+  is_leaf = true;
+  for (size_t i = 0; i < cnt; i++) {
+    for (IRInst *inst = order[i]->insts; inst; inst = inst->next) {
+      max_pos += 2;
+      is_leaf = is_leaf && inst->op != IR_CALL;
     }
-    if (node->default_case) {
-      println("  jmp %s", node->default_case->label);
+    max_pos += 2;
+  }
+  size_t *calls = arenaCalloc(&fn_arena, max_pos + 1, sizeof(size_t));
+  buildIntervals(order, cnt, calls);
+
+  size_t *bucket = arenaCalloc(&fn_arena, max_pos + 1, sizeof(size_t));
+  size_t *bucket_next = arenaCalloc(&fn_arena, n, sizeof(size_t));
+  for (size_t v = n - 1; v > 0; v--) {
+    vreg_reg[v] = -1;
+    if (vreg_start[v] != (size_t)-1) {
+      bucket_next[v] = bucket[vreg_start[v]];
+      bucket[vreg_start[v]] = v;
+    }
+  }
+
+  // The va_area is filled in relative to rbp, so variadic functions always
+  // keep the frame pointer.
+  const size_t gp_cnt = do_omit_frame_pointer && !fn->va_area
+                            ? NUM_GP_REGS
+                            : NUM_GP_REGS - 1;
+  size_t offset = assignLvarOffsets(fn);
+  size_t gp_owner[NUM_GP_REGS] = {0};
+  size_t fp_owner[NUM_FP_REGS] = {0};
+  bool callee_used[NUM_GP_REGS] = {0};
+  for (size_t pos = 0; pos <= max_pos; pos++) {
+    for (size_t v = bucket[pos]; v; v = bucket_next[v]) {
+      const bool is_fp = ir->vreg_is_fp[v];
+      size_t *owner = is_fp ? fp_owner : gp_owner;
+      const size_t nregs = is_fp ? NUM_FP_REGS : gp_cnt;
+      for (size_t r = 0; r < nregs; r++) {
+        if (owner[r] && vreg_end[owner[r]] <= pos) {
+          owner[r] = 0;
+        }
+      }
+
+      size_t first = 0;
+      if (crossesCall(calls, v)) {
+        first = is_fp ? nregs : FIRST_CALLEE_SAVED;
+      }
+      int reg = -1;
+      for (size_t r = first; r < nregs && reg < 0; r++) {
+        if (!owner[r]) {
+          reg = (int)r;
+        }
+      }
+      if (reg < 0) {
+        size_t victim = 0;
+        for (size_t r = first; r < nregs; r++) {
+          if (!victim || vreg_end[owner[r]] > vreg_end[victim]) {
+            victim = owner[r];
+            reg = (int)r;
+          }
+        }
+        if (victim && vreg_end[victim] > vreg_end[v]) {
+          vreg_reg[victim] = -1;
+          offset += 8;
+          vreg_slot[victim] = offset;
+        } else {
+          reg = -1;
+        }
+      }
+
+      if (reg < 0) {
+        offset += 8;
+        vreg_slot[v] = offset;
+        continue;
+      }
+      vreg_reg[v] = reg;
+      owner[reg] = v;
+      if (!is_fp && reg >= FIRST_CALLEE_SAVED) {
+        callee_used[reg] = true;
+      }
+    }
+  }
+
+  for (size_t r = 0; r < NUM_GP_REGS; r++) {
+    save_slots[r] = 0;
+    if (callee_used[r]) {
+      offset += 8;
+      save_slots[r] = offset;
+    }
+  }
+  fn->stack_size = alignTo(offset, 16);
+
+  // Without a frame pointer, slots are addressed from rsp, which stays put
+  // after the prologue since arguments are only passed in registers. A leaf
+  // function's slots fit below rsp in the red zone if they are small enough,
+  // and otherwise the frame only needs realigning for calls. Even with frame
+  // pointers, a leaf function with no slots needs no frame at all.
+  use_fp = fn->va_area ||
+           (!do_omit_frame_pointer && !(is_leaf && !fn->stack_size));
+  frame_reg = use_fp ? "rbp" : "rsp";
+  frame_size = 0;
+  if (!use_fp && !is_leaf) {
+    frame_size = fn->stack_size + 8;
+  } else if (!use_fp && fn->stack_size + 8 > RED_ZONE_SIZE) {
+    frame_size = fn->stack_size;
+  }
+}
+
+// The displacement from `frame_reg` of the slot `offset` bytes below where rbp
+// would point: the return address is just above that, and without a frame
+// pointer rsp is `frame_size` bytes below it.
+long slotDisp(size_t offset) {
+  if (use_fp) {
+    return -(long)offset;
+  }
+  return (long)frame_size - 8 - (long)offset;
+}
+
+void emitFunc(Obj *fn) {
+  cur_fn = fn;
+  cur_ir = fn->ir;
+  cur_file_no = 0;
+  cur_line = 0;
+  label_num = 0;
+  ret_label = arenaAlloc(&fn_arena, strlen(fn->name) + 11);
+  sprintf(ret_label, ".L.return.%s", fn->name);
+  allocRegs(fn);
+
+  emitBeginFunc();
+  println(".%s %s", fn->is_global ? "globl" : "local", fn->name);
+  println(".text");
+  println("%s:", fn->name);
+
+  if (use_fp) {
+    println("  push rbp");
+    println("  mov rbp, rsp");
+    println("  sub rsp, %zu", fn->stack_size);
+  } else if (frame_size) {
+    println("  sub rsp, %zu", frame_size);
+  }
+  for (size_t r = 0; r < NUM_GP_REGS; r++) {
+    if (save_slots[r]) {
+      println("  mov [%s%+ld], %s", frame_reg, slotDisp(save_slots[r]),
+              regName(allocreg[r], 8));
+    }
+  }
+
+  if (fn->va_area) {
+    size_t gp = 0;
+    size_t fp = 0;
+    for (Obj *var = fn->params; var; var = var->next) {
+      if (isFloat(var->ty)) {
+        fp++;
+      } else {
+        gp++;
+      }
+    }
+    size_t offset = fn->va_area->offset;
+    println("  mov DWORD PTR [rbp-%zu], %zu", offset, gp * 8);
+    println("  mov DWORD PTR [rbp-%zu], %zu", offset - 4, fp * 8 + 48);
+    println("  mov QWORD PTR [rbp-%zu], rbp", offset - 16);
+    println("  sub QWORD PTR [rbp-%zu], %zu", offset - 16, offset - 24);
+    println("  mov QWORD PTR [rbp-%zu], rdi", offset - 24);
+    println("  mov QWORD PTR [rbp-%zu], rsi", offset - 32);
+    println("  mov QWORD PTR [rbp-%zu], rdx", offset - 40);
+    println("  mov QWORD PTR [rbp-%zu], rcx", offset - 48);
+    println("  mov QWORD PTR [rbp-%zu], r8", offset - 56);
+    println("  mov QWORD PTR [rbp-%zu], r9", offset - 64);
+    println("  movsd [rbp-%zu], xmm0", offset - 72);
+    println("  movsd [rbp-%zu], xmm1", offset - 80);
+    println("  movsd [rbp-%zu], xmm2", offset - 88);
+    println("  movsd [rbp-%zu], xmm3", offset - 96);
+    println("  movsd [rbp-%zu], xmm4", offset - 104);
+    println("  movsd [rbp-%zu], xmm5", offset - 112);
+    println("  movsd [rbp-%zu], xmm6", offset - 120);
+    println("  movsd [rbp-%zu], xmm7", offset - 128);
+  }
+
+  storeParams(fn);
+
+  for (BasicBlock *bb = cur_ir->blocks; bb; bb = bb->next) {
+    next_bb = bb->next;
+    emitLabel(bbLabel(bb));
+    for (IRInst *inst = bb->insts; inst; inst = inst->next) {
+      emitInst(inst);
+    }
+  }
+
+  emitLabel(ret_label);
+  for (size_t r = 0; r < NUM_GP_REGS; r++) {
+    if (save_slots[r]) {
+      println("  mov %s, [%s%+ld]", regName(allocreg[r], 8), frame_reg,
+              slotDisp(save_slots[r]));
+    }
+  }
+  if (use_fp) {
+    println("  mov rsp, rbp");
+    println("  pop rbp");
+  } else if (frame_size) {
+    println("  add rsp, %zu", frame_size);
+  }
+  println("  ret");
+  emitEndFunc();
+}
+
+void storeParams(Obj *fn) {
+  Obj **params = arenaCalloc(&fn_arena, fn->param_cnt, sizeof(Obj *));
+  size_t i = fn->param_cnt;
+  for (Obj *param = fn->params; param; param = param->next) {
+    params[--i] = param;
+  }
+  size_t gp = 0;
+  size_t fp = 0;
+  for (i = 0; i < fn->param_cnt; i++) {
+    Obj *param = params[i];
+    if (isFloat(param->ty)) {
+      if (param->vreg) {
+        storeVreg(param->vreg, REG_XMM0 + fp++);
+      } else {
+        storeFp(fp++, param->offset, param->ty->size);
+      }
+    } else if (param->vreg) {
+      if (vreg_reg[param->vreg] >= 0 || vreg_slot[param->vreg]) {
+        emitRegs(OPC_MOV, REG_RAX, 8, argreg64[gp], 8);
+        canonicalise(param->ty);
+        storeVreg(param->vreg, REG_RAX);
+      }
+      gp++;
+    } else {
+      storeArgReg(gp++, param->offset, param->ty->size);
     }
-    println("  jmp %s", node->brk_label);
-    genStmt(node->then);
-    println("%s:", node->brk_label);
+  }
+}
+
+// A vreg's register or spill slot as an operand.
+PeepOperand vregOperand(size_t v) {
+  if (vreg_reg[v] < 0) {
+    return slotOperand(use_fp ? REG_RBP : REG_RSP, slotDisp(vreg_slot[v]), 0);
+  }
+  if (cur_ir->vreg_is_fp[v]) {
+    return regOperand(allocfreg[vreg_reg[v]], 16);
+  }
+  return regOperand(allocreg[vreg_reg[v]], 8);
+}
+
+// Floating-point values are copied between registers with movaps and to or
+// from a slot with movsd.
+int moveOpcode(size_t v) {
+  if (!cur_ir->vreg_is_fp[v]) {
+    return OPC_MOV;
+  }
+  return vreg_reg[v] >= 0 ? OPC_MOVAPS : OPC_MOVSD;
+}
+
+void loadVreg(int reg, size_t v) {
+  if (!v || (vreg_reg[v] < 0 && !vreg_slot[v])) {
     return;
-  case ND_CASE:
-    println("%s:", node->label);
-    genStmt(node->lhs);
+  }
+  PeepOperand dst = regOperand(reg, cur_ir->vreg_is_fp[v] ? 16 : 8);
+  PeepOperand src = vregOperand(v);
+  emitOp(moveOpcode(v), &dst, &src);
+}
+
+void storeVreg(size_t v, int reg) {
+  if (vreg_reg[v] < 0 && !vreg_slot[v]) {
     return;
-  case ND_DO: {
-    const size_t c = label_num++;
-    println(".L.begin%zu:", c);
-    genStmt(node->then);
-    println("%s:", node->cont_label);
-    genExpr(node->cond);
-    cmpZero(node->cond->ty);
-    println("  jne .L.begin%zu", c);
-    println("%s:", node->brk_label);
+  }
+  PeepOperand dst = vregOperand(v);
+  PeepOperand src = regOperand(reg, cur_ir->vreg_is_fp[v] ? 16 : 8);
+  emitOp(moveOpcode(v), &dst, &src);
+}
+
+// Brings a value in rax into the same form that `load` produces for `ty`.
+void canonicalise(Type *ty) {
+  if (!isInteger(ty)) {
     return;
   }
-  default:
-    break;
+  if (ty->size == 4) {
+    emitRegs(OPC_MOVSXD, REG_RAX, 8, REG_RAX, 4);
+  } else if (ty->size < 4) {
+    emitExtend(ty->is_unsigned, ty->size);
   }
-  genExpr(node);
 }
 
-void genExpr(Node *node) {
-  println("  .loc 1 %zu", node->tok->line_num);
-  switch (node->kind) {
-  case ND_NULL_EXPR:
-    return;
-  case ND_NUM: {
+// Extends the low `size` bytes of rax into eax.
+void emitExtend(bool is_unsigned, size_t size) {
+  emitRegs(is_unsigned ? OPC_MOVZX : OPC_MOVSX, REG_RAX, 4, REG_RAX, size);
+}
+
+// A basic block's label, which jumps to the block refer to.
+const char *bbLabel(BasicBlock *bb) {
+  char *label = arenaAlloc(&fn_arena, 48);
+  sprintf(label, ".L.bb%zu.%zu", cur_fn_no, bb->id);
+  return label;
+}
+
+void emitJmp(BasicBlock *bb) {
+  if (bb != next_bb) {
+    emitJumpTo(OPC_JMP, bbLabel(bb));
+  }
+}
+
+void emitInst(IRInst *inst) {
+  if (inst->file_no &&
+      (inst->file_no != cur_file_no || inst->line_num != cur_line)) {
+    emitLoc(inst->file_no, inst->line_num);
+    cur_file_no = inst->file_no;
+    cur_line = inst->line_num;
+  }
+  const bool dst_fp = inst->dst && cur_ir->vreg_is_fp[inst->dst];
+  const bool lhs_fp = inst->lhs && cur_ir->vreg_is_fp[inst->lhs];
+  switch (inst->op) {
+  case IR_IMM: {
     union {
       float f32;
       double f64;
       uint32_t u32;
       uint64_t u64;
     } u;
-    switch (node->ty->kind) {
+    switch (inst->ty->kind) {
     case TY_FLOAT:
-      u.f32 = (float)node->fval;
+      u.f32 = (float)inst->fval;
       println("  mov eax, %u", u.u32);
       println("  movq xmm0, rax");
+      storeVreg(inst->dst, REG_XMM0);
       return;
     case TY_DOUBLE:
-      u.f64 = node->fval;
+      u.f64 = inst->fval;
       println("  mov rax, %lu", u.u64);
       println("  movq xmm0, rax");
+      storeVreg(inst->dst, REG_XMM0);
       return;
     default:
-      println("  mov rax, %ld", node->val);
+      break;
+    }
+    if (vreg_reg[inst->dst] >= 0) {
+      PeepOperand dst = vregOperand(inst->dst);
+      PeepOperand src = immOperand(inst->imm);
+      emitOp(OPC_MOV, &dst, &src);
       return;
     }
-  }
-  case ND_VAR:
-  case ND_MEMBER:
-    genAddr(node);
-    load(node->ty);
+    println("  mov rax, %ld", inst->imm);
+    storeVreg(inst->dst, REG_RAX);
     return;
-  case ND_ASS:
-    genAddr(node->lhs);
-    push();
-    genExpr(node->rhs);
-    store(node->ty);
+  }
+  case IR_ADDR_LOCAL:
+    println("  lea rax, [%s%+ld]", frame_reg, slotDisp(inst->var->offset));
+    storeVreg(inst->dst, REG_RAX);
     return;
-  case ND_STMT_EXPR:
-    for (Node *n = node->body; n; n = n->next) {
-      genStmt(n);
-    }
+  case IR_ADDR_GLOBAL:
+    println("  lea rax, [rip+%s]", inst->var->name);
+    storeVreg(inst->dst, REG_RAX);
     return;
-  case ND_ADDR:
-    genAddr(node->body);
+  case IR_ADDI:
+    loadVreg(REG_RAX, inst->lhs);
+    println("  add rax, %ld", inst->imm);
+    storeVreg(inst->dst, REG_RAX);
     return;
-  case ND_DEREF:
-    genExpr(node->body);
-    load(node->ty);
+  case IR_LOAD:
+    loadVreg(REG_RAX, inst->lhs);
+    load(inst->ty);
+    storeVreg(inst->dst, dst_fp ? REG_XMM0 : REG_RAX);
     return;
-  case ND_COMMA:
-    genExpr(node->lhs);
-    genExpr(node->rhs);
+  case IR_STORE:
+    loadVreg(REG_RDI, inst->lhs);
+    if (inst->rhs && cur_ir->vreg_is_fp[inst->rhs]) {
+      loadVreg(REG_XMM0, inst->rhs);
+    } else {
+      loadVreg(REG_RAX, inst->rhs);
+    }
+    store(inst->ty);
     return;
-  case ND_CAST:
-    genExpr(node->lhs);
-    cast(node->lhs->ty, node->ty);
+  case IR_MOV:
+    if (dst_fp) {
+      loadVreg(REG_XMM0, inst->lhs);
+      storeVreg(inst->dst, REG_XMM0);
+      return;
+    }
+    loadVreg(REG_RAX, inst->lhs);
+    if (inst->ty) {
+      canonicalise(inst->ty);
+    }
+    storeVreg(inst->dst, REG_RAX);
     return;
-  case ND_TERN: {
-    const size_t c = label_num++;
-    genExpr(node->cond);
-    cmpZero(node->cond->ty);
-    println("  je .L.else.%zu", c);
-    genExpr(node->then);
-    println("  jmp .L.end.%zu", c);
-    println(".L.else.%zu:", c);
-    genExpr(node->els);
-    println(".L.end.%zu:", c);
+  case IR_CAST:
+    loadVreg(lhs_fp ? REG_XMM0 : REG_RAX, inst->lhs);
+    cast(inst->ty, inst->to);
+    storeVreg(inst->dst, dst_fp ? REG_XMM0 : REG_RAX);
     return;
-  }
-  case ND_NOT:
-    genExpr(node->lhs);
-    cmpZero(node->lhs->ty);
+  case IR_NOT:
+    loadVreg(lhs_fp ? REG_XMM0 : REG_RAX, inst->lhs);
+    cmpZero(inst->ty);
     println("  sete al");
     println("  movzx rax, al");
+    storeVreg(inst->dst, REG_RAX);
     return;
-  case ND_BITNOT:
-    genExpr(node->lhs);
+  case IR_BITNOT:
+    loadVreg(REG_RAX, inst->lhs);
     println("  not rax");
+    storeVreg(inst->dst, REG_RAX);
     return;
-  case ND_LOGAND: {
-    const size_t c = label_num++;
-    genExpr(node->lhs);
-    cmpZero(node->lhs->ty);
-    println("  je .L.false.%zu", c);
-    genExpr(node->rhs);
-    cmpZero(node->rhs->ty);
-    println("  je .L.false.%zu", c);
-    println("  mov rax, 1");
-    println("  jmp .L.end.%zu", c);
-    println(".L.false.%zu:", c);
-    println("  mov rax, 0");
-    println(".L.end.%zu:", c);
-    return;
-  }
-  case ND_LOGOR: {
-    const size_t c = label_num++;
-    genExpr(node->lhs);
-    cmpZero(node->lhs->ty);
-    println("  jne .L.true.%zu", c);
-    genExpr(node->rhs);
-    cmpZero(node->rhs->ty);
-    println("  jne .L.true.%zu", c);
-    println("  mov rax, 0");
-    println("  jmp .L.end.%zu", c);
-    println(".L.true.%zu:", c);
-    println("  mov rax, 1");
-    println(".L.end.%zu:", c);
-    return;
-  }
-  case ND_FUNCCALL: {
-    pushArgs(node->args);
-    size_t gp = 0;
-    size_t fp = 0;
-    for (Node *arg = node->args; arg; arg = arg->next) {
-      if (isFloat(arg->ty)) {
-        popf(fp++);
-      } else {
-        pop(argreg64[gp++]);
-      }
+  case IR_CALL:
+    emitCall(inst);
+    return;
+  case IR_MEMZERO:
+    zeroLocal(inst->var->offset, inst->var->ty->size);
+    return;
+  case IR_RET:
+    loadVreg(lhs_fp ? REG_XMM0 : REG_RAX, inst->lhs);
+    if (next_bb || inst->next) {
+      emitJumpTo(OPC_JMP, ret_label);
     }
-    if (stack_depth % 2 == 0) {
-      println("  call %s", node->funcname);
-    } else {
-      println("  sub rsp, 8");
-      println("  call %s", node->funcname);
-      println("  add rsp, 8");
+    return;
+  case IR_JMP:
+    emitJmp(inst->then);
+    return;
+  case IR_BR:
+    emitBr(inst);
+    return;
+  case IR_SWITCH:
+    emitSwitch(inst);
+    return;
+  case IR_RMW:
+    emitRmw(inst);
+    return;
+  default:
+    break;
+  }
+  emitBinary(inst);
+}
+
+// The new value is loaded back from memory only if it is used. An immediate
+// is wrapped to the width of the memory operand, as the assembler expects.
+void emitRmw(IRInst *inst) {
+  const char *mnemonic = "add";
+  switch (inst->rmw_op) {
+  case IR_SUB:
+    mnemonic = "sub";
+    break;
+  case IR_BITAND:
+    mnemonic = "and";
+    break;
+  case IR_BITOR:
+    mnemonic = "or";
+    break;
+  case IR_BITXOR:
+    mnemonic = "xor";
+    break;
+  default:
+    break;
+  }
+  const int log = inst->ty->size == 1   ? 0
+                  : inst->ty->size == 2 ? 1
+                  : inst->ty->size == 4 ? 2
+                                        : 3;
+  char *mem = "[rdi]";
+  if (!inst->var) {
+    loadVreg(REG_RDI, inst->lhs);
+  } else if (inst->var->is_global) {
+    mem = arenaAlloc(&fn_arena, strlen(inst->var->name) + 8);
+    sprintf(mem, "[rip+%s]", inst->var->name);
+  } else {
+    mem = arenaAlloc(&fn_arena, 32);
+    sprintf(mem, "[%s%+ld]", frame_reg, slotDisp(inst->var->offset));
+  }
+  if (inst->rhs) {
+    loadVreg(REG_RAX, inst->rhs);
+    println("  %s %s, %s", mnemonic, mem, accreg[log]);
+  } else {
+    int64_t imm = inst->imm;
+    if (log == 0) {
+      imm = (signed char)imm;
+    } else if (log == 1) {
+      imm = (short)imm;
+    } else if (log == 2) {
+      imm = (int)imm;
     }
-    switch (node->ty->kind) {
-    case TY_BOOL:
-      println("  movzx eax, al");
-      break;
-    case TY_CHAR:
-      if (node->ty->is_unsigned) {
-        println("  movzx eax, al");
-      } else {
-        println("  movsx eax, al");
-      }
-      break;
-    case TY_SHORT:
-      if (node->ty->is_unsigned) {
-        println("  movzx eax, ax");
-      } else {
-        println("  movsx eax, ax");
-      }
-      break;
-    default:
-      break;
+    println("  %s %s PTR %s, %ld", mnemonic, ptr_sizes[log], mem, imm);
+  }
+  if (inst->dst) {
+    println("  lea rax, %s", mem);
+    load(inst->ty);
+    storeVreg(inst->dst, REG_RAX);
+  }
+}
+
+// Switches are lowered to a binary search over the sorted case values, which
+// ends in a bounds-checked jump table wherever the values are dense and in a
+// short compare chain elsewhere.
+void emitSwitch(IRInst *inst) {
+  loadVreg(REG_RAX, inst->lhs);
+  const bool is_wide = inst->ty->size == 8;
+  int64_t *vals = arenaCalloc(&fn_arena, inst->case_cnt + 1, sizeof(int64_t));
+  BasicBlock **bbs = arenaCalloc(&fn_arena, inst->case_cnt + 1, sizeof(BasicBlock *));
+  for (size_t i = 0; i < inst->case_cnt; i++) {
+    int64_t val = inst->case_vals[i];
+    if (!is_wide) {
+      val = inst->ty->is_unsigned ? (int64_t)(uint32_t)val
+                                  : (int64_t)(int32_t)val;
+    }
+    vals[i] = val;
+    bbs[i] = inst->case_bbs[i];
+  }
+  sortCases(vals, bbs, inst->case_cnt, is_wide && inst->ty->is_unsigned);
+  size_t cnt = 0;
+  for (size_t i = 0; i < inst->case_cnt; i++) {
+    if (cnt == 0 || vals[i] != vals[cnt - 1]) {
+      vals[cnt] = vals[i];
+      bbs[cnt++] = bbs[i];
     }
+  }
+  emitSwitchRange(inst, vals, bbs, 0, cnt, true);
+}
+
+void emitSwitchRange(IRInst *inst, int64_t *vals, BasicBlock **bbs,
+                     size_t lo, size_t hi, bool is_last) {
+  const size_t n = hi - lo;
+  if (n >= 4 && (uint64_t)vals[hi - 1] - (uint64_t)vals[lo] < 3 * n) {
+    emitJumpTable(inst, vals, bbs, lo, hi);
     return;
   }
-  case ND_MEMZERO:
-    println("  mov rcx, %zu", node->var->ty->size);
-    println("  lea rdi, [rbp-%zu]", node->var->offset);
-    println("  mov al, 0");
-    println("  rep stosb");
+  if (n > 3) {
+    const size_t mid = lo + n / 2;
+    const size_t label = label_num++;
+    cmpCase(inst, vals[mid]);
+    println("  %s .L.sw%zu.%zu", inst->ty->is_unsigned ? "jb" : "jl",
+            cur_fn_no, label);
+    emitSwitchRange(inst, vals, bbs, mid, hi, false);
+    println(".L.sw%zu.%zu:", cur_fn_no, label);
+    emitSwitchRange(inst, vals, bbs, lo, mid, is_last);
     return;
+  }
+  for (size_t i = lo; i < hi; i++) {
+    cmpCase(inst, vals[i]);
+    emitJumpTo(OPC_JE, bbLabel(bbs[i]));
+  }
+  if (is_last) {
+    emitJmp(inst->els);
+  } else {
+    emitJumpTo(OPC_JMP, bbLabel(inst->els));
+  }
+}
+
+// Indexes a table of 32-bit offsets relative to the table itself, so that
+// the table needs no relocations. Gaps in the range go to the default.
+void emitJumpTable(IRInst *inst, int64_t *vals, BasicBlock **bbs, size_t lo,
+                   size_t hi) {
+  const size_t label = label_num++;
+  const uint64_t len = (uint64_t)vals[hi - 1] - (uint64_t)vals[lo] + 1;
+  if (inst->ty->size == 8) {
+    println("  mov rdi, rax");
+    println("  mov rcx, %ld", vals[lo]);
+    println("  sub rdi, rcx");
+    println("  cmp rdi, %lu", len - 1);
+  } else {
+    println("  mov edi, eax");
+    println("  sub edi, %ld", vals[lo]);
+    println("  cmp edi, %lu", len - 1);
+  }
+  emitJumpTo(OPC_JA, bbLabel(inst->els));
+  println("  lea rcx, [rip+.L.jt%zu.%zu]", cur_fn_no, label);
+  println("  movsxd rdi, DWORD PTR [rcx+rdi*4]");
+  println("  add rdi, rcx");
+  println("  jmp rdi");
+  println("  .section .rodata");
+  println("  .align 4");
+  println(".L.jt%zu.%zu:", cur_fn_no, label);
+  size_t i = lo;
+  for (uint64_t k = 0; k < len; k++) {
+    BasicBlock *bb = inst->els;
+    if ((uint64_t)vals[i] - (uint64_t)vals[lo] == k) {
+      bb = bbs[i++];
+    }
+    println("  .long .L.bb%zu.%zu-.L.jt%zu.%zu", cur_fn_no, bb->id, cur_fn_no,
+            label);
+  }
+  println("  .text");
+}
+
+void cmpCase(IRInst *inst, int64_t val) {
+  if (inst->ty->size != 8 || val == (int32_t)val) {
+    emitRegImm(OPC_CMP, REG_RAX, inst->ty->size == 8 ? 8 : 4, val);
+  } else {
+    println("  mov rcx, %ld", val);
+    println("  cmp rax, rcx");
+  }
+}
+
+// A bottom-up merge sort, keeping each case value paired with its block.
+void sortCases(int64_t *vals, BasicBlock **bbs, size_t n, bool is_unsigned) {
+  int64_t *tmp_vals = arenaCalloc(&fn_arena, n + 1, sizeof(int64_t));
+  BasicBlock **tmp_bbs = arenaCalloc(&fn_arena, n + 1, sizeof(BasicBlock *));
+  for (size_t width = 1; width < n; width *= 2) {
+    for (size_t lo = 0; lo < n; lo += 2 * width) {
+      const size_t mid = lo + width < n ? lo + width : n;
+      const size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+      size_t i = lo;
+      size_t j = mid;
+      for (size_t k = lo; k < hi; k++) {
+        bool take_left = j >= hi;
+        if (i < mid && j < hi) {
+          take_left = is_unsigned ? (uint64_t)vals[i] <= (uint64_t)vals[j]
+                                  : vals[i] <= vals[j];
+        }
+        if (i < mid && take_left) {
+          tmp_vals[k] = vals[i];
+          tmp_bbs[k] = bbs[i++];
+        } else {
+          tmp_vals[k] = vals[j];
+          tmp_bbs[k] = bbs[j++];
+        }
+      }
+    }
+    for (size_t k = 0; k < n; k++) {
+      vals[k] = tmp_vals[k];
+      bbs[k] = tmp_bbs[k];
+    }
+  }
+}
+
+void emitBr(IRInst *inst) {
+  loadVreg(cur_ir->vreg_is_fp[inst->lhs] ? REG_XMM0 : REG_RAX, inst->lhs);
+  cmpZero(inst->ty);
+  if (inst->then == next_bb) {
+    emitJumpTo(OPC_JE, bbLabel(inst->els));
+  } else if (inst->els == next_bb) {
+    emitJumpTo(OPC_JNE, bbLabel(inst->then));
+  } else {
+    emitJumpTo(OPC_JE, bbLabel(inst->els));
+    emitJumpTo(OPC_JMP, bbLabel(inst->then));
+  }
+}
+
+void emitCall(IRInst *inst) {
+  size_t gp = 0;
+  size_t fp = 0;
+  for (size_t i = 0; i < inst->arg_cnt; i++) {
+    const size_t v = inst->args[i];
+    if (v && cur_ir->vreg_is_fp[v]) {
+      loadVreg(REG_XMM0 + fp++, v);
+    } else {
+      loadVreg(argreg64[gp++], v);
+    }
+  }
+  if (inst->func_ty->is_variadic) {
+    println("  mov eax, %zu", fp);
+  }
+  println("  call %s", inst->funcname);
+  switch (inst->ty->kind) {
+  case TY_BOOL:
+    emitExtend(true, 1);
+    break;
+  case TY_CHAR:
+  case TY_SHORT:
+    emitExtend(inst->ty->is_unsigned, inst->ty->size);
+    break;
   default:
     break;
   }
+  if (inst->dst) {
+    storeVreg(inst->dst, cur_ir->vreg_is_fp[inst->dst] ? REG_XMM0 : REG_RAX);
+  }
+}
 
-  if (isFloat(node->lhs->ty)) {
-    genExpr(node->rhs);
-    pushf();
-    genExpr(node->lhs);
-    popf(1);
+void emitBinary(IRInst *inst) {
+  if (isFloat(inst->ty)) {
+    loadVreg(REG_XMM0, inst->lhs);
+    loadVreg(REG_XMM1, inst->rhs);
 
-    const char *sz = (node->lhs->ty->kind == TY_FLOAT) ? "ss" : "sd";
+    const char *sz = (inst->ty->kind == TY_FLOAT) ? "ss" : "sd";
 
-    switch (node->kind) {
-    case ND_ADD:
+    switch (inst->op) {
+    case IR_ADD:
       println("  add%s xmm0, xmm1", sz);
+      storeVreg(inst->dst, REG_XMM0);
       return;
-    case ND_SUB:
+    case IR_SUB:
       println("  sub%s xmm0, xmm1", sz);
+      storeVreg(inst->dst, REG_XMM0);
       return;
-    case ND_MUL:
+    case IR_MUL:
       println("  mul%s xmm0, xmm1", sz);
+      storeVreg(inst->dst, REG_XMM0);
       return;
-    case ND_DIV:
+    case IR_DIV:
       println("  div%s xmm0, xmm1", sz);
+      storeVreg(inst->dst, REG_XMM0);
       return;
-    case ND_EQ:
-    case ND_NE:
-    case ND_LT:
-    case ND_LE:
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_LE:
       println("  ucomi%s xmm1, xmm0", sz);
-      if (node->kind == ND_EQ) {
+      if (inst->op == IR_EQ) {
         println("  sete al");
         println("  setnp dl");
         println("  and al, dl");
-      } else if (node->kind == ND_NE) {
+      } else if (inst->op == IR_NE) {
         println("  setne al");
         println("  setp dl");
         println("  or al, dl");
-      } else if (node->kind == ND_LT) {
+      } else if (inst->op == IR_LT) {
         println("  seta al");
       } else {
         println("  setae al");
       }
       println("  and al, 1");
       println("  movzx rax, al");
+      storeVreg(inst->dst, REG_RAX);
       return;
     default:
       break;
     }
 
-    compErrorToken(node->tok->str, "invalid expression");
+    compError("invalid expression");
   }
 
-  genExpr(node->rhs);
-  push();
-  genExpr(node->lhs);
-  pop("rdi");
+  loadVreg(REG_RAX, inst->lhs);
+  loadVreg(REG_RDI, inst->rhs);
 
   char *ax = NULL;
   char *di = NULL;
   char *dx = NULL;
 
-  if (node->lhs->ty->kind == TY_LONG || node->lhs->ty->base) {
+  if (inst->ty->kind == TY_LONG || inst->ty->base) {
     ax = "rax";
     di = "rdi";
     dx = "rdx";
@@ -542,134 +1554,93 @@ void genExpr(Node *node) {
     dx = "edx";
   }
 
-  switch (node->kind) {
-  case ND_ADD:
+  switch (inst->op) {
+  case IR_ADD:
     println("  add %s, %s", ax, di);
-    return;
-  case ND_SUB:
+    break;
+  case IR_SUB:
     println("  sub %s, %s", ax, di);
-    return;
-  case ND_MUL:
+    break;
+  case IR_MUL:
     println("  imul %s, %s", ax, di);
-    return;
-  case ND_DIV:
-    if (node->ty->is_unsigned) {
+    break;
+  case IR_DIV:
+  case IR_MOD:
+    if (inst->to->is_unsigned) {
       println("  mov %s, 0", dx);
       println("  div %s", di);
     } else {
-      if (node->lhs->ty->size == 8) {
+      if (inst->ty->size == 8) {
         println("  cqo");
       } else {
         println("  cdq");
       }
       println("  idiv %s", di);
     }
-    return;
-  case ND_MOD:
-    if (node->ty->is_unsigned) {
-      println("  mov %s, 0", dx);
-      println("  div %s", di);
-    } else {
-      if (node->lhs->ty->size == 8) {
-        println("  cqo");
-      } else {
-        println("  cdq");
-      }
-      println("  idiv %s", di);
+    if (inst->op == IR_MOD) {
+      println("  mov rax, rdx");
     }
-    println("  mov rax, rdx");
-    return;
-  case ND_BITAND:
+    break;
+  case IR_BITAND:
     println("  and %s, %s", ax, di);
-    return;
-  case ND_BITOR:
+    break;
+  case IR_BITOR:
     println("  or %s, %s", ax, di);
-    return;
-  case ND_BITXOR:
+    break;
+  case IR_BITXOR:
     println("  xor %s, %s", ax, di);
-    return;
-  case ND_EQ:
+    break;
+  case IR_EQ:
     println("  cmp %s, %s", ax, di);
     println("  sete al");
     println("  movzx %s, al", ax);
-    return;
-  case ND_NE:
+    break;
+  case IR_NE:
     println("  cmp %s, %s", ax, di);
     println("  setne al");
     println("  movzx %s, al", ax);
-    return;
-  case ND_LT:
+    break;
+  case IR_LT:
     println("  cmp %s, %s", ax, di);
-    if (node->lhs->ty->is_unsigned) {
+    if (inst->ty->is_unsigned) {
       println("  setb al");
     } else {
       println("  setl al");
     }
     println("  movzx %s, al", ax);
-    return;
-  case ND_LE:
+    break;
+  case IR_LE:
     println("  cmp %s, %s", ax, di);
-    if (node->lhs->ty->is_unsigned) {
+    if (inst->ty->is_unsigned) {
       println("  setbe al");
     } else {
       println("  setle al");
     }
     println("  movzx %s, al", ax);
-    return;
-  case ND_SHL:
+    break;
+  case IR_SHL:
     println("  mov rcx, rdi");
     println("  shl %s, cl", ax);
-    return;
-  case ND_SHR:
+    break;
+  case IR_SHR:
     println("  mov rcx, rdi");
-    if (node->lhs->ty->is_unsigned) {
+    if (inst->ty->is_unsigned) {
       println("  shr %s, cl", ax);
     } else {
       println("  sar %s, cl", ax);
     }
-    return;
-  default:
     break;
-  }
-
-  compError("invalid expression");
-}
-
-void genAddr(Node *node) {
-  switch (node->kind) {
-  case ND_VAR:
-    if (node->var->is_global) {
-      println("  lea rax, [rip+%s]", node->var->name);
-    } else {
-      println("  lea rax, [rbp-%zu]", node->var->offset);
-    }
-    return;
-  case ND_DEREF:
-    genExpr(node->body);
-    return;
-  case ND_COMMA:
-    genExpr(node->lhs);
-    genAddr(node->rhs);
-    return;
-  case ND_MEMBER:
-    genAddr(node->lhs);
-    println("  add rax, %zu", node->var->offset);
-    return;
   default:
-    break;
+    compError("invalid expression");
   }
-  compError("not an lvalue");
+  storeVreg(inst->dst, REG_RAX);
 }
 
 void store(Type *ty) {
-  pop("rdi");
   switch (ty->kind) {
   case TY_STRUCT:
   case TY_UNION:
-    for (ssize_t i = 0; i < ty->size; i++) {
-      println("  mov r8b, [rax+%zu]", i);
-      println("  mov [rdi+%zu], r8b", i);
-    }
+    copyAggregate(ty->size);
     return;
   case TY_FLOAT:
     println("  movss [rdi], xmm0");
@@ -691,28 +1662,76 @@ void store(Type *ty) {
   }
 }
 
+// Copies `size` bytes from [rax] to [rdi]. Small aggregates are unrolled into
+// 16-byte SSE moves followed by 8, 4, 2 and 1-byte moves for the tail; larger
+// ones use `rep movsb`, whose startup cost is then amortised.
+void copyAggregate(size_t size) {
+  if (size > MAX_UNROLLED_COPY) {
+    println("  mov rsi, rax");
+    println("  mov rcx, %zu", size);
+    println("  rep movsb");
+    return;
+  }
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    println("  movups xmm0, [rax+%zu]", i);
+    println("  movups [rdi+%zu], xmm0", i);
+  }
+  for (int log = 3; log >= 0; log--) {
+    const size_t chunk = (size_t)1 << log;
+    for (; i + chunk <= size; i += chunk) {
+      println("  mov %s, [rax+%zu]", copyreg[log], i);
+      println("  mov [rdi+%zu], %s", i, copyreg[log]);
+    }
+  }
+}
+
+// Zeroes the local `offset` bytes down the frame. Small objects take a few wide stores;
+// `rep stosb` is kept for large ones, where its startup latency is repaid.
+void zeroLocal(size_t offset, size_t size) {
+  if (size > MAX_UNROLLED_ZERO) {
+    println("  mov rcx, %zu", size);
+    println("  lea rdi, [%s%+ld]", frame_reg, slotDisp(offset));
+    println("  mov al, 0");
+    println("  rep stosb");
+    return;
+  }
+  size_t i = 0;
+  if (size >= 16) {
+    println("  xorps xmm0, xmm0");
+    for (; i + 16 <= size; i += 16) {
+      println("  movups [%s%+ld], xmm0", frame_reg, slotDisp(offset - i));
+    }
+  }
+  for (int log = 3; log >= 0; log--) {
+    const size_t chunk = (size_t)1 << log;
+    for (; i + chunk <= size; i += chunk) {
+      println("  mov %s PTR [%s%+ld], 0", ptr_sizes[log], frame_reg,
+              slotDisp(offset - i));
+    }
+  }
+}
+
 void storeArgReg(size_t r, size_t offset, size_t sz) {
   switch (sz) {
   case 1:
-    println("  mov [rbp-%zu], %s", offset, argreg8[r]);
+    println("  mov [%s%+ld], %s", frame_reg, slotDisp(offset), argreg8[r]);
     return;
   case 2:
-    println("  mov [rbp-%zu], %s", offset, argreg16[r]);
+    println("  mov [%s%+ld], %s", frame_reg, slotDisp(offset), argreg16[r]);
     return;
   case 4:
-    println("  mov [rbp-%zu], %s", offset, argreg32[r]);
+    println("  mov [%s%+ld], %s", frame_reg, slotDisp(offset), argreg32[r]);
     return;
   case 8:
-    println("  mov [rbp-%zu], %s", offset, argreg64[r]);
+    println("  mov [%s%+ld], %s", frame_reg, slotDisp(offset),
+            regName(argreg64[r], 8));
     return;
   }
   assert(false);
 }
 
 void load(Type *ty) {
-  if (ty->kind == TY_ARR || ty->kind == TY_STRUCT || ty->kind == TY_UNION) {
-    return;
-  }
   switch (ty->kind) {
   case TY_ARR:
   case TY_STRUCT:
@@ -746,16 +1765,43 @@ void cast(Type *from, Type *to) {
   if (to->kind == TY_BOOL) {
     cmpZero(from);
     println("  setne al");
-    println("  movzx eax, al");
+    emitExtend(true, 1);
     return;
   }
   int t1 = getTypeId(from);
   int t2 = getTypeId(to);
-  if (cast_table[t1][t2]) {
+  if (!cast_table[t1][t2]) {
+    return;
+  }
+  if (t1 < F32 && t2 < F32) {
+    castInt(t1, t2);
+  } else {
     println("  %s", cast_table[t1][t2]);
   }
 }
 
+// The integer conversions of the cast table, emitted so that the peephole
+// optimiser can see them.
+void castInt(int from, int to) {
+  switch (to) {
+  case I8:
+  case I16:
+    emitExtend(false, to == I8 ? 1 : 2);
+    return;
+  case U8:
+  case U16:
+    emitExtend(true, to == U8 ? 1 : 2);
+    return;
+  default:
+    break;
+  }
+  if (from == U32) {
+    emitRegs(OPC_MOV, REG_RAX, 4, REG_RAX, 4);
+  } else {
+    emitRegs(OPC_MOVSXD, REG_RAX, 8, REG_RAX, 4);
+  }
+}
+
 int getTypeId(Type *ty) {
   switch (ty->kind) {
   case TY_CHAR:
@@ -789,62 +1835,16 @@ void cmpZero(Type *ty) {
   default:
     break;
   }
-  if (isInteger(ty) && ty->size <= 4) {
-    println("  cmp eax, 0");
-  } else {
-    println("  cmp rax, 0");
-  }
-}
-
-void pop(const char *arg) {
-  println("  pop %s", arg);
-  stack_depth--;
-}
-
-void push(void) {
-  println("  push rax");
-  stack_depth++;
-}
-
-void println(const char *fmt, ...) {
-  va_list args;
-  va_start(args, fmt);
-  vfprintf(output, fmt, args);
-  va_end(args);
-  fprintf(output, "\n");
-}
-
-void popf(size_t i) {
-  println("  movsd xmm%zu, [rsp]", i);
-  println("  add rsp, 8");
-  stack_depth--;
-}
-
-void pushf(void) {
-  println("  sub rsp, 8");
-  println("  movsd [rsp], xmm0");
-  stack_depth++;
-}
-
-void pushArgs(Node *args) {
-  if (args) {
-    pushArgs(args->next);
-    genExpr(args);
-    if (isFloat(args->ty)) {
-      pushf();
-    } else {
-      push();
-    }
-  }
+  emitRegImm(OPC_CMP, REG_RAX, isInteger(ty) && ty->size <= 4 ? 4 : 8, 0);
 }
 
 void storeFp(size_t r, size_t offset, size_t sz) {
   switch (sz) {
   case 4:
-    println("  movss [rbp-%zu], xmm%zu", offset, r);
+    println("  movss [%s%+ld], xmm%zu", frame_reg, slotDisp(offset), r);
     return;
   case 8:
-    println("  movsd [rbp-%zu], xmm%zu", offset, r);
+    println("  movsd [%s%+ld], xmm%zu", frame_reg, slotDisp(offset), r);
     return;
   default:
     break;
@@ -1,8 +1,12 @@
 #ifndef CODEGEN_H
 #define CODEGEN_H
 
+#include <stdbool.h>
+
 typedef struct Node Node;
+typedef struct Type Type;
 
+bool castIsNop(Type *from, Type *to);
 void gen();
 
 #endif // CODEGEN_H
@@ -1,5 +1,6 @@
 #include "comp_err.h"
 
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,40 +8,71 @@
 #include "defs.h"
 
 extern Token *token;
-extern const char *file_content;
+extern File *files;
 extern const char *input_file_path;
+extern int assembler_pid;
 
-#define COMP_ERR_BODY(LINE_NUM, LOC)                                           \
-  const char *line_start = (LOC);                                              \
-  while (file_content < line_start && line_start[-1] != '\n') {                \
-    line_start--;                                                              \
-  }                                                                            \
-  const char *line_end = (LOC);                                                \
-  while (*line_end != '\n') {                                                  \
-    line_end++;                                                                \
+static File *findFile(const char *loc);
+static void exitFailure(void);
+
+// Locations are found by address in the file buffers. Anything else, such as
+// a decoded string literal, is reported without its source line.
+#define COMP_ERR_BODY(SRC, LINE_NUM, LOC)                                      \
+  if (SRC) {                                                                   \
+    const char *line_start = (LOC);                                            \
+    while ((SRC)->contents < line_start && line_start[-1] != '\n') {           \
+      line_start--;                                                            \
+    }                                                                          \
+    const char *line_end = (LOC);                                              \
+    while (*line_end != '\n' && *line_end != '\0') {                           \
+      line_end++;                                                              \
+    }                                                                          \
+    size_t offset = fprintf(stderr, "%s:%zu: ", (SRC)->name, LINE_NUM);        \
+    fprintf(stderr, "%.*s\n", (int)(line_end - line_start), line_start);       \
+    const int pos = (int)((LOC)-line_start + offset);                          \
+    fprintf(stderr, "%*s", pos, " ");                                          \
+    fprintf(stderr, "^ ");                                                     \
+  } else {                                                                     \
+    fprintf(stderr, "%s: ", input_file_path);                                  \
   }                                                                            \
-  size_t offset = fprintf(stderr, "%s:%zu: ", input_file_path, LINE_NUM);      \
-  fprintf(stderr, "%.*s\n", (int)(line_end - line_start), line_start);         \
-  const int pos = (int)((LOC)-line_start + offset);                            \
-  fprintf(stderr, "%*s", pos, " ");                                            \
-  fprintf(stderr, "^ ");                                                       \
   va_list args;                                                                \
   va_start(args, fmt);                                                         \
   vfprintf(stderr, fmt, args);                                                 \
   va_end(args);                                                                \
   fprintf(stderr, "\n");                                                       \
-  exit(EXIT_FAILURE);
+  exitFailure();
 
 void compError(const char *fmt, ...) {
-  COMP_ERR_BODY(token->line_num, token->str);
+  File *file = findFile(token->str);
+  COMP_ERR_BODY(file, token->line_num, token->str);
 }
 
 void compErrorToken(const char *loc, const char *fmt, ...) {
+  File *file = findFile(loc);
   size_t line_num = 1;
-  for (const char *p = file_content; p < loc; p++) {
+  for (const char *p = file ? file->contents : loc; p < loc; p++) {
     if (*p == '\n') {
       line_num++;
     }
   }
-  COMP_ERR_BODY(line_num, loc);
+  COMP_ERR_BODY(file, line_num, loc);
+}
+
+File *findFile(const char *loc) {
+  for (File *file = files; file; file = file->next) {
+    if (file->contents <= loc && loc <= file->contents + file->len) {
+      return file;
+    }
+  }
+  return NULL;
+}
+
+// The assembler is reading the output as it is written, and would still turn
+// the part written so far into an object file if it were allowed to see the
+// end of its input.
+void exitFailure(void) {
+  if (assembler_pid > 0) {
+    kill(assembler_pid, SIGKILL);
+  }
+  exit(EXIT_FAILURE);
 }
@@ -6,18 +6,121 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+typedef struct Arena Arena;
+typedef struct ArenaBlock ArenaBlock;
+typedef struct AsmFixup AsmFixup;
+typedef struct AsmItem AsmItem;
+typedef struct AsmMnemonic AsmMnemonic;
+typedef struct AsmOperand AsmOperand;
+typedef struct AsmReloc AsmReloc;
+typedef struct AsmSection AsmSection;
+typedef struct AsmSymbol AsmSymbol;
+typedef struct AsmUnit AsmUnit;
+typedef struct BasicBlock BasicBlock;
+typedef struct CondIncl CondIncl;
+typedef struct File File;
+typedef struct HashEntry HashEntry;
+typedef struct HashMap HashMap;
+typedef struct Hideset Hideset;
+typedef struct IRFunc IRFunc;
+typedef struct IRInst IRInst;
 typedef struct InitDesg InitDesg;
 typedef struct Initialiser Initialiser;
+typedef struct LineRow LineRow;
+typedef struct Macro Macro;
+typedef struct MacroArg MacroArg;
+typedef struct MacroParam MacroParam;
 typedef struct Node Node;
 typedef struct Obj Obj;
+typedef struct PeepInst PeepInst;
+typedef struct PeepOperand PeepOperand;
 typedef struct Relocation Relocation;
 typedef struct Scope Scope;
-typedef struct TagScope TagScope;
 typedef struct Token Token;
 typedef struct Type Type;
 typedef struct VarAttr VarAttr;
 typedef struct VarScope VarScope;
 
+// ELF constants used by the integrated assembler and object writer.
+enum {
+  SHT_PROGBITS = 1,
+  SHT_SYMTAB = 2,
+  SHT_STRTAB = 3,
+  SHT_RELA = 4,
+  SHT_NOBITS = 8,
+};
+enum {
+  SHF_WRITE = 0x1,
+  SHF_ALLOC = 0x2,
+  SHF_EXECINSTR = 0x4,
+  SHF_MERGE = 0x10,
+  SHF_STRINGS = 0x20,
+  SHF_INFO_LINK = 0x40,
+};
+enum {
+  R_X86_64_64 = 1,
+  R_X86_64_PC32 = 2,
+  R_X86_64_PLT32 = 4,
+  R_X86_64_32 = 10,
+};
+
+// Registers, numbered as in the instruction encoding, with the SSE registers
+// after the general purpose ones.
+enum {
+  REG_RAX,
+  REG_RCX,
+  REG_RDX,
+  REG_RBX,
+  REG_RSP,
+  REG_RBP,
+  REG_RSI,
+  REG_RDI,
+  REG_R8,
+  REG_R9,
+  REG_R10,
+  REG_R11,
+  REG_R12,
+  REG_R13,
+  REG_R14,
+  REG_R15,
+  REG_XMM0,
+  REG_XMM1,
+  REG_XMM2,
+  REG_XMM3,
+  REG_XMM4,
+  REG_XMM5,
+  REG_XMM6,
+  REG_XMM7,
+  REG_XMM8,
+  REG_XMM9,
+  REG_XMM10,
+  REG_XMM11,
+  REG_XMM12,
+  REG_XMM13,
+  REG_XMM14,
+  REG_XMM15,
+};
+
+// What the peephole optimiser sees of a function: instructions it may
+// rewrite, labels, line number directives and anything else as opaque text.
+enum { PEEP_INST, PEEP_LABEL, PEEP_LOC, PEEP_OTHER };
+// The instructions that are emitted as a PEEP_INST.
+enum {
+  OPC_CMP,
+  OPC_JA,
+  OPC_JE,
+  OPC_JMP,
+  OPC_JNE,
+  OPC_MOV,
+  OPC_MOVAPS,
+  OPC_MOVSD,
+  OPC_MOVSX,
+  OPC_MOVSXD,
+  OPC_MOVZX,
+  OPC_TEST,
+};
+enum { PEEP_REG, PEEP_SLOT, PEEP_IMM };
+
 typedef enum {
   ND_ADD,
   ND_ADDR,
@@ -80,6 +183,47 @@ typedef enum {
   TY_VOID,
 } TypeKind;
 
+typedef enum {
+  KW_NONE,
+  KW_ALIGNAS,
+  KW_ALIGNOF,
+  KW_AUTO,
+  KW_BOOL,
+  KW_BREAK,
+  KW_CASE,
+  KW_CHAR,
+  KW_CONST,
+  KW_CONTINUE,
+  KW_DEFAULT,
+  KW_DO,
+  KW_DOUBLE,
+  KW_ELSE,
+  KW_ENUM,
+  KW_EXTERN,
+  KW_FLOAT,
+  KW_FOR,
+  KW_GOTO,
+  KW_IF,
+  KW_INT,
+  KW_LONG,
+  KW_NORETURN,
+  KW_REGISTER,
+  KW_RESTRICT,
+  KW_RETURN,
+  KW_SHORT,
+  KW_SIGNED,
+  KW_SIZEOF,
+  KW_STATIC,
+  KW_STRUCT,
+  KW_SWITCH,
+  KW_TYPEDEF,
+  KW_UNION,
+  KW_UNSIGNED,
+  KW_VOID,
+  KW_VOLATILE,
+  KW_WHILE,
+} Keyword;
+
 typedef enum {
   TK_ELSE,
   TK_EOF,
@@ -95,6 +239,40 @@ typedef enum {
   TK_WHILE,
 } TokenKind;
 
+typedef enum {
+  IR_ADD,
+  IR_ADDI,
+  IR_ADDR_GLOBAL,
+  IR_ADDR_LOCAL,
+  IR_BITAND,
+  IR_BITNOT,
+  IR_BITOR,
+  IR_BITXOR,
+  IR_BR,
+  IR_CALL,
+  IR_CAST,
+  IR_DIV,
+  IR_EQ,
+  IR_IMM,
+  IR_JMP,
+  IR_LE,
+  IR_LOAD,
+  IR_LT,
+  IR_MEMZERO,
+  IR_MOD,
+  IR_MOV,
+  IR_MUL,
+  IR_NE,
+  IR_NOT,
+  IR_RET,
+  IR_RMW,
+  IR_SHL,
+  IR_SHR,
+  IR_STORE,
+  IR_SUB,
+  IR_SWITCH,
+} IROp;
+
 struct Type {
   Type *next;
   TypeKind kind;
@@ -113,13 +291,20 @@ struct Type {
 
 struct Token {
   TokenKind kind;
+  Keyword kwd;
   Token *next;
   int64_t val;
   double fval;
   Type *ty;
   const char *str;
+  const char *name;
   size_t len;
   size_t line_num;
+  File *file;
+  bool at_bol;
+  bool has_space;
+  Hideset *hideset;
+  Token *origin;
 };
 
 struct Obj {
@@ -132,15 +317,26 @@ struct Obj {
   bool is_global;
   bool is_definition;
   bool is_static;
+  bool is_addr_taken;
+  bool is_str_lit;
+  // A const object, as opposed to one reached through a pointer to const.
+  bool is_readonly;
+  size_t vreg;
+  // The span of parse positions of the block a local is declared in, or zero
+  // if the local may be live anywhere in its function.
+  size_t scope_begin;
+  size_t scope_end;
   const char *init_data;
   Relocation *rel;
   // function
   Node *body;
   Obj *params;
   size_t param_cnt;
+  size_t call_cnt;
   size_t stack_size;
   Obj *locals;
   Obj *va_area;
+  IRFunc *ir;
 };
 
 struct Node {
@@ -172,27 +368,95 @@ struct Node {
 };
 
 struct VarScope {
-  VarScope *next;
-  char *name;
   Obj *var;
   Type *type_def;
   Type *enum_ty;
   int enum_val;
 };
 
+struct ArenaBlock {
+  ArenaBlock *next;
+  char *data;
+  size_t size;
+};
+
+struct Arena {
+  const char *name;
+  ArenaBlock *blocks;
+  char *ptr;
+  char *end;
+  size_t used;
+  size_t peak;
+  size_t total;
+  size_t reserved;
+  size_t peak_reserved;
+  size_t alloc_cnt;
+};
+
+struct HashEntry {
+  const char *key;
+  void *val;
+};
+
+// A map with an arena keeps its buckets there, and is released with it.
+struct HashMap {
+  HashEntry *buckets;
+  size_t cap;
+  size_t cnt;
+  Arena *arena;
+};
+
 struct Scope {
   Scope *next;
-  VarScope *vars;
-  TagScope *tags;
+  HashMap vars;
+  HashMap tags;
+  Obj *locals;
+  size_t begin;
 };
 
-struct TagScope {
-  TagScope *next;
+struct File {
+  File *next;
   const char *name;
-  Type *ty;
+  const char *contents;
+  size_t len;
+  int file_no;
+};
+
+struct Hideset {
+  Hideset *next;
+  const char *name;
+};
+
+struct MacroParam {
+  MacroParam *next;
+  const char *name;
+};
+
+struct MacroArg {
+  MacroArg *next;
+  const char *name;
+  bool is_va_args;
+  Token *tok;
+};
+
+struct Macro {
+  const char *name;
+  bool is_objlike;
+  MacroParam *params;
+  const char *va_args_name;
+  Token *body;
+  int builtin;
+};
+
+struct CondIncl {
+  CondIncl *next;
+  int ctx;
+  Token *tok;
+  bool included;
 };
 
 struct VarAttr {
+  bool is_const;
   bool is_extern;
   bool is_static;
   bool is_typedef;
@@ -221,4 +485,187 @@ struct Relocation {
   size_t addend;
 };
 
+// A virtual register is identified by its index into `IRFunc::vreg_is_fp`.
+// Index 0 is reserved to mean "no value". An IR_RMW applies `rmw_op` in place
+// to the memory at `lhs`, or at `var` if that is set, with `rhs` as the
+// operand, or `imm` if `rhs` is zero.
+struct IRInst {
+  IRInst *next;
+  IROp op;
+  IROp rmw_op;
+  size_t dst;
+  size_t lhs;
+  size_t rhs;
+  size_t *args;
+  size_t arg_cnt;
+  int64_t imm;
+  double fval;
+  Type *ty;
+  Type *to;
+  Type *func_ty;
+  Obj *var;
+  const char *funcname;
+  BasicBlock *then;
+  BasicBlock *els;
+  int64_t *case_vals;
+  BasicBlock **case_bbs;
+  size_t case_cnt;
+  int file_no;
+  size_t line_num;
+  size_t pos;
+};
+
+struct BasicBlock {
+  BasicBlock *next;
+  size_t id;
+  const char *label;
+  IRInst *insts;
+  IRInst *last;
+  bool is_reachable;
+};
+
+struct IRFunc {
+  BasicBlock *blocks;
+  BasicBlock **all_blocks;
+  size_t block_cnt;
+  size_t block_cap;
+  bool *vreg_is_fp;
+  Obj **vreg_var;
+  size_t vreg_cnt;
+  size_t vreg_cap;
+};
+
+// An operand of a PEEP_INST: a register, a stack slot at `val` from the base
+// register `reg`, or the immediate `val`.
+struct PeepOperand {
+  int kind;
+  int reg;
+  // The width of a register, or of a slot access that the other operand does
+  // not imply; zero for any other slot.
+  size_t size;
+  int64_t val;
+};
+
+// A piece of a function's assembly, as seen by the peephole optimiser. Its
+// instructions are recorded as opcodes and operands at their emit sites and
+// only formatted once it has run; other pieces keep the text emitted for them.
+struct PeepInst {
+  int kind;
+  int opcode;
+  PeepOperand opnds[2];
+  size_t opnd_cnt;
+  // The label a jump goes to, or that a PEEP_LABEL defines.
+  const char *label;
+  // Where the text of a piece other than a PEEP_INST starts, relative to the
+  // start of the function, and its length.
+  size_t start;
+  size_t len;
+  bool is_dead;
+};
+
+struct AsmSection {
+  AsmSection *next;
+  const char *name;
+  int type;
+  int flags;
+  size_t align;
+  size_t link;
+  size_t info;
+  size_t entsize;
+  AsmItem *items;
+  AsmItem *last_item;
+  AsmFixup *fixups;
+  AsmFixup *last_fixup;
+  AsmReloc *relocs;
+  AsmReloc *last_reloc;
+  size_t reloc_cnt;
+  char *data;
+  size_t size;
+  size_t cap;
+  size_t index;
+  size_t sym_index;
+  size_t offset;
+  AsmSection *rela;
+};
+
+struct AsmSymbol {
+  AsmSymbol *next;
+  const char *name;
+  AsmSection *section;
+  uint64_t value;
+  bool is_global;
+  bool is_temp;
+  bool is_used;
+  size_t index;
+};
+
+struct AsmItem {
+  AsmItem *next;
+  int kind;
+  uint64_t addr;
+  char *data;
+  size_t len;
+  size_t cap;
+  AsmSymbol *sym;
+  int cond;
+  bool is_long;
+  size_t align;
+  int file_no;
+  size_t line;
+};
+
+struct AsmFixup {
+  AsmFixup *next;
+  AsmItem *item;
+  size_t offset;
+  int kind;
+  AsmSymbol *sym;
+  AsmSymbol *base;
+  int64_t addend;
+};
+
+struct AsmReloc {
+  AsmReloc *next;
+  uint64_t offset;
+  int type;
+  AsmSymbol *sym;
+  AsmSection *section;
+  int64_t addend;
+};
+
+struct AsmMnemonic {
+  const char *name;
+  int kind;
+  int prefix;
+  int opcode;
+  int ext;
+};
+
+struct AsmOperand {
+  int kind;
+  int reg;
+  int size;
+  bool needs_rex;
+  int base;
+  int index;
+  int scale;
+  int64_t disp;
+  AsmSymbol *sym;
+};
+
+struct LineRow {
+  LineRow *next;
+  uint64_t addr;
+  int file_no;
+  size_t line;
+};
+
+struct AsmUnit {
+  AsmSection *sections;
+  AsmSymbol *symbols;
+  LineRow *lines;
+  const char **file_names;
+  size_t file_cnt;
+};
+
 #endif // DEFS_H
@@ -0,0 +1,479 @@
+#include "elf_out.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "defs.h"
+
+enum { STB_LOCAL = 0, STB_GLOBAL = 1 };
+enum { STT_NOTYPE = 0, STT_SECTION = 3 };
+enum {
+  DW_LNS_copy = 1,
+  DW_LNS_advance_pc = 2,
+  DW_LNS_advance_line = 3,
+  DW_LNS_set_file = 4,
+  DW_LNS_const_add_pc = 8,
+  DW_LNE_end_sequence = 1,
+  DW_LNE_set_address = 2,
+};
+enum { LINE_BASE = -5, LINE_RANGE = 14, OPCODE_BASE = 13 };
+
+extern Arena asm_arena;
+static const char std_opcode_lengths[] = {0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1};
+
+static AsmSection *findText(AsmUnit *unit);
+static size_t alignTo(size_t n, size_t align);
+static void addDebugSections(AsmUnit *unit);
+static void addSectionReloc(AsmSection *sec, int type, AsmSection *target,
+                            int64_t addend);
+static void appendSection(AsmUnit *unit, AsmSection *sec);
+static void genDebugLine(AsmUnit *unit, AsmSection *line, AsmSection *text);
+static void patchInt(AsmSection *sec, size_t offset, uint64_t val, size_t size);
+static void putSleb(AsmSection *sec, int64_t val);
+static void putString(AsmSection *sec, const char *str);
+static void putUleb(AsmSection *sec, uint64_t val);
+static void writeSectionHeader(AsmSection *out, AsmSection *sec,
+                               size_t name_offset);
+
+AsmSection *newSection(const char *name, int type, int flags) {
+  AsmSection *sec = arenaCalloc(&asm_arena, 1, sizeof(AsmSection));
+  sec->name = name;
+  sec->type = type;
+  sec->flags = flags;
+  return sec;
+}
+
+void putBytes(AsmSection *sec, const void *data, size_t len) {
+  if (sec->size + len > sec->cap) {
+    size_t cap = sec->cap ? sec->cap : 64;
+    while (cap < sec->size + len) {
+      cap *= 2;
+    }
+    sec->data = arenaRealloc(&asm_arena, sec->data, sec->cap, cap);
+    sec->cap = cap;
+  }
+  memcpy(sec->data + sec->size, data, len);
+  sec->size += len;
+}
+
+// Values are written little-endian, whatever the host.
+void putInt(AsmSection *sec, uint64_t val, size_t size) {
+  unsigned char buf[8];
+  for (size_t i = 0; i < size; i++) {
+    buf[i] = (unsigned char)(val >> (8 * i));
+  }
+  putBytes(sec, buf, size);
+}
+
+void patchInt(AsmSection *sec, size_t offset, uint64_t val, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    sec->data[offset + i] = (char)(val >> (8 * i));
+  }
+}
+
+void putUleb(AsmSection *sec, uint64_t val) {
+  do {
+    int byte = val & 0x7f;
+    val >>= 7;
+    putInt(sec, val ? byte | 0x80 : byte, 1);
+  } while (val);
+}
+
+void putSleb(AsmSection *sec, int64_t val) {
+  for (;;) {
+    int byte = val & 0x7f;
+    val >>= 7;
+    if ((val == 0 && !(byte & 0x40)) || (val == -1 && byte & 0x40)) {
+      putInt(sec, byte, 1);
+      return;
+    }
+    putInt(sec, byte | 0x80, 1);
+  }
+}
+
+void putString(AsmSection *sec, const char *str) {
+  putBytes(sec, str, strlen(str) + 1);
+}
+
+size_t alignTo(size_t n, size_t align) {
+  return align > 1 ? (n + align - 1) / align * align : n;
+}
+
+void appendSection(AsmUnit *unit, AsmSection *sec) {
+  AsmSection **link = &unit->sections;
+  while (*link) {
+    link = &(*link)->next;
+  }
+  *link = sec;
+}
+
+AsmSection *findText(AsmUnit *unit) {
+  for (AsmSection *sec = unit->sections; sec; sec = sec->next) {
+    if (!strcmp(sec->name, ".text")) {
+      return sec;
+    }
+  }
+  return NULL;
+}
+
+// Adds a relocation at the current end of `sec` against the start of
+// `target`.
+void addSectionReloc(AsmSection *sec, int type, AsmSection *target,
+                     int64_t addend) {
+  AsmReloc *rel = arenaCalloc(&asm_arena, 1, sizeof(AsmReloc));
+  rel->offset = sec->size;
+  rel->type = type;
+  rel->section = target;
+  rel->addend = addend;
+  if (sec->last_reloc) {
+    sec->last_reloc = sec->last_reloc->next = rel;
+  } else {
+    sec->relocs = sec->last_reloc = rel;
+  }
+  sec->reloc_cnt++;
+}
+
+// The line table mirrors the one `as` builds from `.file` and `.loc`: one
+// directory entry per distinct directory and one row per `.loc`.
+void genDebugLine(AsmUnit *unit, AsmSection *line, AsmSection *text) {
+  putInt(line, 0, 4);
+  putInt(line, 3, 2);
+  const size_t header_len_pos = line->size;
+  putInt(line, 0, 4);
+  putInt(line, 1, 1);
+  putInt(line, 1, 1);
+  putInt(line, (uint64_t)LINE_BASE, 1);
+  putInt(line, LINE_RANGE, 1);
+  putInt(line, OPCODE_BASE, 1);
+  putBytes(line, std_opcode_lengths, sizeof(std_opcode_lengths));
+
+  size_t *dir_of = arenaCalloc(&asm_arena, unit->file_cnt + 1, sizeof(size_t));
+  size_t dir_cnt = 0;
+  for (size_t i = 1; i < unit->file_cnt; i++) {
+    const char *name = unit->file_names[i] ? unit->file_names[i] : "";
+    const char *slash = strrchr(name, '/');
+    if (!slash) {
+      continue;
+    }
+    const size_t len = slash - name;
+    for (size_t j = 1; j < i && !dir_of[i]; j++) {
+      const char *other = unit->file_names[j] ? unit->file_names[j] : "";
+      const char *other_slash = strrchr(other, '/');
+      if (dir_of[j] && other_slash && (size_t)(other_slash - other) == len &&
+          !strncmp(name, other, len)) {
+        dir_of[i] = dir_of[j];
+      }
+    }
+    if (!dir_of[i]) {
+      dir_of[i] = ++dir_cnt;
+      putBytes(line, name, len);
+      putInt(line, 0, 1);
+    }
+  }
+  putInt(line, 0, 1);
+  for (size_t i = 1; i < unit->file_cnt; i++) {
+    const char *name = unit->file_names[i] ? unit->file_names[i] : "";
+    const char *slash = strrchr(name, '/');
+    putString(line, slash ? slash + 1 : name);
+    putUleb(line, dir_of[i]);
+    putUleb(line, 0);
+    putUleb(line, 0);
+  }
+  putInt(line, 0, 1);
+  patchInt(line, header_len_pos, line->size - header_len_pos - 4, 4);
+
+  int file_no = 1;
+  int64_t line_no = 1;
+  uint64_t addr = 0;
+  for (LineRow *row = unit->lines; row; row = row->next) {
+    if (row->file_no != file_no) {
+      file_no = row->file_no;
+      putInt(line, DW_LNS_set_file, 1);
+      putUleb(line, file_no);
+    }
+    if (row == unit->lines) {
+      putInt(line, 0, 1);
+      putUleb(line, 9);
+      putInt(line, DW_LNE_set_address, 1);
+      addSectionReloc(line, R_X86_64_64, text, (int64_t)row->addr);
+      putInt(line, 0, 8);
+      addr = row->addr;
+    }
+    int64_t line_delta = (int64_t)row->line - line_no;
+    uint64_t addr_delta = row->addr - addr;
+    line_no = (int64_t)row->line;
+    addr = row->addr;
+    if (line_delta < LINE_BASE || line_delta >= LINE_BASE + LINE_RANGE) {
+      putInt(line, DW_LNS_advance_line, 1);
+      putSleb(line, line_delta);
+      line_delta = 0;
+    }
+    const uint64_t max_addr_delta = (255 - OPCODE_BASE) / LINE_RANGE;
+    if (addr_delta > max_addr_delta &&
+        addr_delta - max_addr_delta <= max_addr_delta) {
+      putInt(line, DW_LNS_const_add_pc, 1);
+      addr_delta -= max_addr_delta;
+    } else if (addr_delta > max_addr_delta) {
+      putInt(line, DW_LNS_advance_pc, 1);
+      putUleb(line, addr_delta);
+      addr_delta = 0;
+    }
+    const uint64_t op = (uint64_t)(line_delta - LINE_BASE) +
+                        LINE_RANGE * addr_delta + OPCODE_BASE;
+    if (op > 255) {
+      putInt(line, DW_LNS_advance_pc, 1);
+      putUleb(line, addr_delta);
+      putInt(line, (uint64_t)(line_delta - LINE_BASE) + OPCODE_BASE, 1);
+    } else {
+      putInt(line, op, 1);
+    }
+  }
+  putInt(line, DW_LNS_advance_pc, 1);
+  putUleb(line, text->size - addr);
+  putInt(line, 0, 1);
+  putUleb(line, 1);
+  putInt(line, DW_LNE_end_sequence, 1);
+  patchInt(line, 0, line->size - 4, 4);
+}
+
+// Describes the object as a single compilation unit covering .text, which is
+// what `as` generates for sources that carry only `.loc` directives.
+void addDebugSections(AsmUnit *unit) {
+  AsmSection *text = findText(unit);
+  AsmSection *line = newSection(".debug_line", SHT_PROGBITS, 0);
+  AsmSection *info = newSection(".debug_info", SHT_PROGBITS, 0);
+  AsmSection *abbrev = newSection(".debug_abbrev", SHT_PROGBITS, 0);
+  AsmSection *aranges = newSection(".debug_aranges", SHT_PROGBITS, 0);
+  line->align = info->align = abbrev->align = aranges->align = 1;
+  appendSection(unit, line);
+  appendSection(unit, info);
+  appendSection(unit, abbrev);
+  appendSection(unit, aranges);
+
+  genDebugLine(unit, line, text);
+
+  char cwd[PATH_MAX];
+  if (!getcwd(cwd, sizeof(cwd))) {
+    cwd[0] = '\0';
+  }
+  putInt(info, 0, 4);
+  putInt(info, 3, 2);
+  addSectionReloc(info, R_X86_64_32, abbrev, 0);
+  putInt(info, 0, 4);
+  putInt(info, 8, 1);
+  putUleb(info, 1);
+  addSectionReloc(info, R_X86_64_32, line, 0);
+  putInt(info, 0, 4);
+  addSectionReloc(info, R_X86_64_64, text, 0);
+  putInt(info, 0, 8);
+  addSectionReloc(info, R_X86_64_64, text, (int64_t)text->size);
+  putInt(info, 0, 8);
+  putString(info, unit->file_cnt > 1 && unit->file_names[1]
+                      ? unit->file_names[1]
+                      : "");
+  putString(info, cwd);
+  putString(info, "ucc");
+  putInt(info, 0x8001, 2);
+  patchInt(info, 0, info->size - 4, 4);
+
+  const char abbrev_data[] = {1,    0x11, 0,    0x10, 0x06, 0x11, 0x01,
+                              0x12, 0x01, 0x03, 0x08, 0x1b, 0x08, 0x25,
+                              0x08, 0x13, 0x05, 0,    0,    0};
+  putBytes(abbrev, abbrev_data, sizeof(abbrev_data));
+
+  putInt(aranges, 0, 4);
+  putInt(aranges, 2, 2);
+  addSectionReloc(aranges, R_X86_64_32, info, 0);
+  putInt(aranges, 0, 4);
+  putInt(aranges, 8, 1);
+  putInt(aranges, 0, 1);
+  putInt(aranges, 0, 4);
+  addSectionReloc(aranges, R_X86_64_64, text, 0);
+  putInt(aranges, 0, 8);
+  putInt(aranges, text->size, 8);
+  putInt(aranges, 0, 8);
+  putInt(aranges, 0, 8);
+  patchInt(aranges, 0, aranges->size - 4, 4);
+}
+
+void writeSectionHeader(AsmSection *out, AsmSection *sec, size_t name_offset) {
+  putInt(out, name_offset, 4);
+  putInt(out, sec->type, 4);
+  putInt(out, sec->flags, 8);
+  putInt(out, 0, 8);
+  putInt(out, sec->offset, 8);
+  putInt(out, sec->size, 8);
+  putInt(out, sec->link, 4);
+  putInt(out, sec->info, 4);
+  putInt(out, sec->align, 8);
+  putInt(out, sec->entsize, 8);
+}
+
+// Lays out an ELF64 relocatable object: the header, then every section's
+// contents in order, then the section header table.
+void writeElf(const char *path, AsmUnit *unit) {
+  if (unit->lines) {
+    addDebugSections(unit);
+  }
+
+  size_t content_cnt = 0;
+  size_t shnum = 1;
+  for (AsmSection *sec = unit->sections; sec; sec = sec->next) {
+    content_cnt++;
+    sec->index = shnum++;
+    sec->sym_index = content_cnt;
+    if (sec->reloc_cnt) {
+      char *name = arenaAlloc(&asm_arena, strlen(sec->name) + 6);
+      sprintf(name, ".rela%s", sec->name);
+      sec->rela = newSection(name, SHT_RELA, SHF_INFO_LINK);
+      sec->rela->align = 8;
+      sec->rela->entsize = 24;
+      sec->rela->info = sec->index;
+      sec->rela->index = shnum++;
+    }
+  }
+  AsmSection *symtab = newSection(".symtab", SHT_SYMTAB, 0);
+  AsmSection *strtab = newSection(".strtab", SHT_STRTAB, 0);
+  AsmSection *shstrtab = newSection(".shstrtab", SHT_STRTAB, 0);
+  symtab->index = shnum++;
+  strtab->index = shnum++;
+  shstrtab->index = shnum++;
+  symtab->align = 8;
+  symtab->entsize = 24;
+  symtab->link = strtab->index;
+  strtab->align = shstrtab->align = 1;
+
+  // Section symbols, then named locals, then globals, which must come last.
+  putInt(strtab, 0, 1);
+  for (int i = 0; i < 24; i++) {
+    putInt(symtab, 0, 1);
+  }
+  for (AsmSection *sec = unit->sections; sec; sec = sec->next) {
+    putInt(symtab, 0, 4);
+    putInt(symtab, STB_LOCAL << 4 | STT_SECTION, 1);
+    putInt(symtab, 0, 1);
+    putInt(symtab, sec->index, 2);
+    putInt(symtab, 0, 8);
+    putInt(symtab, 0, 8);
+  }
+  size_t sym_cnt = content_cnt + 1;
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass == 1) {
+      symtab->info = sym_cnt;
+    }
+    for (AsmSymbol *sym = unit->symbols; sym; sym = sym->next) {
+      if (sym->is_temp || sym->is_global != (pass == 1) ||
+          (!sym->section && !sym->is_global)) {
+        continue;
+      }
+      sym->index = sym_cnt++;
+      putInt(symtab, strtab->size, 4);
+      putString(strtab, sym->name);
+      putInt(symtab, (pass == 1 ? STB_GLOBAL : STB_LOCAL) << 4 | STT_NOTYPE,
+             1);
+      putInt(symtab, 0, 1);
+      putInt(symtab, sym->section ? sym->section->index : 0, 2);
+      putInt(symtab, sym->value, 8);
+      putInt(symtab, 0, 8);
+    }
+  }
+
+  for (AsmSection *sec = unit->sections; sec; sec = sec->next) {
+    if (!sec->rela) {
+      continue;
+    }
+    sec->rela->link = symtab->index;
+    for (AsmReloc *rel = sec->relocs; rel; rel = rel->next) {
+      const uint64_t sym_index =
+          rel->sym ? rel->sym->index : rel->section->sym_index;
+      putInt(sec->rela, rel->offset, 8);
+      putInt(sec->rela, sym_index << 32 | (uint64_t)rel->type, 8);
+      putInt(sec->rela, (uint64_t)rel->addend, 8);
+    }
+  }
+
+  AsmSection **all = arenaCalloc(&asm_arena, shnum, sizeof(AsmSection *));
+  size_t n = 0;
+  for (AsmSection *sec = unit->sections; sec; sec = sec->next) {
+    all[n++] = sec;
+    if (sec->rela) {
+      all[n++] = sec->rela;
+    }
+  }
+  all[n++] = symtab;
+  all[n++] = strtab;
+  all[n++] = shstrtab;
+  putInt(shstrtab, 0, 1);
+  for (size_t i = 0; i < n; i++) {
+    putString(shstrtab, all[i]->name);
+  }
+
+  size_t offset = 64;
+  for (size_t i = 0; i < n; i++) {
+    if (all[i]->type != SHT_NOBITS) {
+      offset = alignTo(offset, all[i]->align);
+    }
+    all[i]->offset = offset;
+    if (all[i]->type != SHT_NOBITS) {
+      offset += all[i]->size;
+    }
+  }
+  const size_t shoff = alignTo(offset, 8);
+
+  AsmSection *out = newSection("", 0, 0);
+  putBytes(out, "\177ELF", 4);
+  putInt(out, 2, 1);
+  putInt(out, 1, 1);
+  putInt(out, 1, 1);
+  for (int i = 0; i < 9; i++) {
+    putInt(out, 0, 1);
+  }
+  putInt(out, 1, 2);
+  putInt(out, 62, 2);
+  putInt(out, 1, 4);
+  putInt(out, 0, 8);
+  putInt(out, 0, 8);
+  putInt(out, shoff, 8);
+  putInt(out, 0, 4);
+  putInt(out, 64, 2);
+  putInt(out, 0, 2);
+  putInt(out, 0, 2);
+  putInt(out, 64, 2);
+  putInt(out, shnum, 2);
+  putInt(out, shstrtab->index, 2);
+  for (size_t i = 0; i < n; i++) {
+    if (all[i]->type == SHT_NOBITS) {
+      continue;
+    }
+    while (out->size < all[i]->offset) {
+      putInt(out, 0, 1);
+    }
+    if (all[i]->size) {
+      putBytes(out, all[i]->data, all[i]->size);
+    }
+  }
+  while (out->size < shoff) {
+    putInt(out, 0, 1);
+  }
+  for (int i = 0; i < 64; i++) {
+    putInt(out, 0, 1);
+  }
+  size_t name_offset = 1;
+  for (size_t i = 0; i < n; i++) {
+    writeSectionHeader(out, all[i], name_offset);
+    name_offset += strlen(all[i]->name) + 1;
+  }
+
+  FILE *file = fopen(path, "w");
+  if (!file || fwrite(out->data, 1, out->size, file) != out->size) {
+    fprintf(stderr, "failed to write object file: '%s'\n", path);
+    exit(EXIT_FAILURE);
+  }
+  fclose(file);
+}
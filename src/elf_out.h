@@ -0,0 +1,15 @@
+#ifndef ELF_OUT_H
+#define ELF_OUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct AsmSection AsmSection;
+typedef struct AsmUnit AsmUnit;
+
+AsmSection *newSection(const char *name, int type, int flags);
+void putBytes(AsmSection *sec, const void *data, size_t len);
+void putInt(AsmSection *sec, uint64_t val, size_t size);
+void writeElf(const char *path, AsmUnit *unit);
+
+#endif // ELF_OUT_H
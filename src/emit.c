@@ -0,0 +1,380 @@
+#include "emit.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "defs.h"
+#include "peephole.h"
+
+enum { FLUSH_THRESHOLD = 1 << 20 };
+
+extern Arena fn_arena;
+extern FILE *output;
+size_t insts_emitted = 0;
+static char *buf = NULL;
+static size_t len = 0;
+static size_t cap = 0;
+static size_t flushed = 0;
+static size_t func_start = 0;
+static bool in_func = false;
+static PeepInst *insts = NULL;
+static size_t inst_cnt = 0;
+static size_t inst_cap = 0;
+static size_t chunk_start = 0;
+static const char *opcode_names[] = {
+    "cmp",   "ja",     "je",    "jmp",    "jne",   "mov",
+    "movaps", "movsd", "movsx", "movsxd", "movzx", "test"};
+static const char *gp_names[][4] = {
+    {"al", "ax", "eax", "rax"},     {"cl", "cx", "ecx", "rcx"},
+    {"dl", "dx", "edx", "rdx"},     {"bl", "bx", "ebx", "rbx"},
+    {"spl", "sp", "esp", "rsp"},    {"bpl", "bp", "ebp", "rbp"},
+    {"sil", "si", "esi", "rsi"},    {"dil", "di", "edi", "rdi"},
+    {"r8b", "r8w", "r8d", "r8"},    {"r9b", "r9w", "r9d", "r9"},
+    {"r10b", "r10w", "r10d", "r10"}, {"r11b", "r11w", "r11d", "r11"},
+    {"r12b", "r12w", "r12d", "r12"}, {"r13b", "r13w", "r13d", "r13"},
+    {"r14b", "r14w", "r14d", "r14"}, {"r15b", "r15w", "r15d", "r15"}};
+static const char *xmm_names[] = {
+    "xmm0", "xmm1", "xmm2",  "xmm3",  "xmm4",  "xmm5",  "xmm6",  "xmm7",
+    "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15"};
+static const char *ptr_names[] = {"BYTE", "WORD", "DWORD", "QWORD"};
+
+static PeepInst *closeChunk(int kind);
+static PeepInst *newPeepInst(void);
+static size_t countInsts(const char *text, size_t n);
+static size_t sizeLog(size_t size);
+static void emitOperand(PeepOperand *op);
+static void emitPeepInst(PeepInst *inst);
+static void reserve(size_t n);
+
+void reserve(size_t n) {
+  if (len + n <= cap) {
+    return;
+  }
+  size_t new_cap = cap ? cap : FLUSH_THRESHOLD;
+  while (new_cap < len + n) {
+    new_cap *= 2;
+  }
+  buf = realloc(buf, new_cap);
+  if (!buf) {
+    fprintf(stderr, "out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  cap = new_cap;
+}
+
+// The total number of bytes of assembly emitted so far.
+size_t emitted(void) { return flushed + len; }
+
+void emitChar(char c) {
+  reserve(1);
+  buf[len++] = c;
+}
+
+void emitBytes(const char *bytes, size_t n) {
+  reserve(n);
+  memcpy(buf + len, bytes, n);
+  len += n;
+}
+
+void emitStr(const char *str) { emitBytes(str, strlen(str)); }
+
+void emitUint(uint64_t val) {
+  char digits[20];
+  size_t n = 0;
+  do {
+    digits[n++] = (char)('0' + val % 10);
+    val /= 10;
+  } while (val);
+  reserve(n);
+  while (n) {
+    buf[len++] = digits[--n];
+  }
+}
+
+void emitInt(int64_t val) {
+  if (val < 0) {
+    emitChar('-');
+    emitUint(0 - (uint64_t)val);
+  } else {
+    emitUint((uint64_t)val);
+  }
+}
+
+// Emits the stack slot operand `[base+disp]`, such as `[rbp-8]` or
+// `[rsp+16]`.
+void emitSlot(const char *base, int64_t disp) {
+  emitChar('[');
+  emitStr(base);
+  if (disp >= 0) {
+    emitChar('+');
+  }
+  emitInt(disp);
+  emitChar(']');
+}
+
+// Formats a line of assembly into the buffer. Only the conversions the code
+// generator uses are supported: %s, %d, %u, %ld, %lu, %zu and %+ld.
+void println(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  for (const char *p = fmt; *p; p++) {
+    if (*p != '%') {
+      emitChar(*p);
+      continue;
+    }
+    p++;
+    bool plus = false;
+    bool is_long = false;
+    if (*p == '+') {
+      plus = true;
+      p++;
+    }
+    if (*p == 'l' || *p == 'z') {
+      is_long = true;
+      p++;
+    }
+    switch (*p) {
+    case 's':
+      emitStr(va_arg(args, const char *));
+      break;
+    case 'd': {
+      const int64_t val =
+          is_long ? va_arg(args, int64_t) : va_arg(args, int);
+      if (plus && val >= 0) {
+        emitChar('+');
+      }
+      emitInt(val);
+      break;
+    }
+    case 'u':
+      emitUint(is_long ? va_arg(args, uint64_t) : va_arg(args, unsigned int));
+      break;
+    case '%':
+      emitChar('%');
+      break;
+    default:
+      fprintf(stderr, "unsupported conversion in '%s'\n", fmt);
+      exit(EXIT_FAILURE);
+    }
+  }
+  va_end(args);
+  emitChar('\n');
+}
+
+// Hands the buffer to the output stream in one write.
+void emitFlush(void) {
+  if (len && fwrite(buf, 1, len, output) != len) {
+    fprintf(stderr, "failed to write output\n");
+    exit(EXIT_FAILURE);
+  }
+  fflush(output);
+  flushed += len;
+  len = 0;
+}
+
+// Flushes at a convenient boundary once enough has been buffered, so that a
+// piped assembler can work on earlier functions while later ones are
+// generated.
+void emitFlushIfFull(void) {
+  if (len >= FLUSH_THRESHOLD) {
+    emitFlush();
+  }
+}
+
+size_t sizeLog(size_t size) {
+  size_t log = 0;
+  while (size > 1) {
+    size >>= 1;
+    log++;
+  }
+  return log;
+}
+
+const char *regName(int reg, size_t size) {
+  if (reg >= REG_XMM0) {
+    return xmm_names[reg - REG_XMM0];
+  }
+  return gp_names[reg][sizeLog(size)];
+}
+
+PeepOperand regOperand(int reg, size_t size) {
+  return (PeepOperand){.kind = PEEP_REG, .reg = reg, .size = size};
+}
+
+PeepOperand slotOperand(int base, int64_t disp, size_t size) {
+  return (PeepOperand){.kind = PEEP_SLOT, .reg = base, .size = size,
+                       .val = disp};
+}
+
+PeepOperand immOperand(int64_t val) {
+  return (PeepOperand){.kind = PEEP_IMM, .val = val};
+}
+
+void emitOperand(PeepOperand *op) {
+  switch (op->kind) {
+  case PEEP_REG:
+    emitStr(regName(op->reg, op->size));
+    return;
+  case PEEP_SLOT:
+    if (op->size) {
+      emitStr(ptr_names[sizeLog(op->size)]);
+      emitStr(" PTR ");
+    }
+    emitSlot(regName(op->reg, 8), op->val);
+    return;
+  default:
+    emitInt(op->val);
+    return;
+  }
+}
+
+void emitPeepInst(PeepInst *inst) {
+  emitStr("  ");
+  emitStr(opcode_names[inst->opcode]);
+  emitChar(' ');
+  if (inst->label) {
+    emitStr(inst->label);
+  }
+  for (size_t i = 0; i < inst->opnd_cnt; i++) {
+    if (i) {
+      emitStr(", ");
+    }
+    emitOperand(&inst->opnds[i]);
+  }
+  emitChar('\n');
+}
+
+PeepInst *newPeepInst(void) {
+  if (inst_cnt == inst_cap) {
+    inst_cap = inst_cap ? inst_cap * 2 : 256;
+    insts = realloc(insts, inst_cap * sizeof(PeepInst));
+    if (!insts) {
+      fprintf(stderr, "out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  PeepInst *inst = &insts[inst_cnt++];
+  *inst = (PeepInst){0};
+  return inst;
+}
+
+// Ends the piece of text emitted since the last piece, if there is any.
+PeepInst *closeChunk(int kind) {
+  if (len == chunk_start) {
+    return NULL;
+  }
+  PeepInst *inst = newPeepInst();
+  inst->kind = kind;
+  inst->start = chunk_start - func_start;
+  inst->len = len - chunk_start;
+  chunk_start = len;
+  return inst;
+}
+
+// Emits an instruction the peephole optimiser may rewrite. Within a function
+// it is only recorded, and written out by emitEndFunc().
+void emitOp(int opcode, PeepOperand *dst, PeepOperand *src) {
+  PeepInst inst = {.kind = PEEP_INST, .opcode = opcode, .opnd_cnt = 2};
+  inst.opnds[0] = *dst;
+  inst.opnds[1] = *src;
+  if (!in_func) {
+    emitPeepInst(&inst);
+    return;
+  }
+  closeChunk(PEEP_OTHER);
+  *newPeepInst() = inst;
+}
+
+void emitRegs(int opcode, int dst, size_t dst_size, int src, size_t src_size) {
+  PeepOperand dst_op = regOperand(dst, dst_size);
+  PeepOperand src_op = regOperand(src, src_size);
+  emitOp(opcode, &dst_op, &src_op);
+}
+
+void emitRegImm(int opcode, int reg, size_t size, int64_t val) {
+  PeepOperand dst_op = regOperand(reg, size);
+  PeepOperand src_op = immOperand(val);
+  emitOp(opcode, &dst_op, &src_op);
+}
+
+void emitJumpTo(int opcode, const char *label) {
+  PeepInst inst = {.kind = PEEP_INST, .opcode = opcode, .label = label};
+  if (!in_func) {
+    emitPeepInst(&inst);
+    return;
+  }
+  closeChunk(PEEP_OTHER);
+  *newPeepInst() = inst;
+}
+
+void emitLabel(const char *label) {
+  closeChunk(PEEP_OTHER);
+  println("%s:", label);
+  PeepInst *inst = closeChunk(PEEP_LABEL);
+  if (inst) {
+    inst->label = label;
+  }
+}
+
+void emitLoc(int file_no, size_t line) {
+  closeChunk(PEEP_OTHER);
+  println("  .loc %d %zu", file_no, line);
+  closeChunk(PEEP_LOC);
+}
+
+// Marks the start of a function, whose output is held back for the peephole
+// optimiser until emitEndFunc().
+void emitBeginFunc(void) {
+  func_start = len;
+  chunk_start = len;
+  inst_cnt = 0;
+  in_func = true;
+}
+
+// Counts the instructions in a piece of text, which are its indented lines
+// other than directives.
+size_t countInsts(const char *text, size_t n) {
+  size_t cnt = 0;
+  for (size_t i = 0; i + 2 < n; i++) {
+    if ((!i || text[i - 1] == '\n') && text[i] == ' ' && text[i + 1] == ' ' &&
+        text[i + 2] != '.') {
+      cnt++;
+    }
+  }
+  return cnt;
+}
+
+// Runs the peephole optimiser over the function's pieces, and writes back what
+// survives.
+void emitEndFunc(void) {
+  closeChunk(PEEP_OTHER);
+  in_func = false;
+  const size_t n = len - func_start;
+  char *text = arenaAlloc(&fn_arena, n);
+  memcpy(text, buf + func_start, n);
+  peephole(insts, inst_cnt);
+
+  len = func_start;
+  for (size_t i = 0; i < inst_cnt; i++) {
+    PeepInst *inst = &insts[i];
+    if (inst->is_dead) {
+      continue;
+    }
+    if (inst->kind == PEEP_INST) {
+      emitPeepInst(inst);
+      insts_emitted++;
+      continue;
+    }
+    reserve(inst->len);
+    memcpy(buf + len, text + inst->start, inst->len);
+    len += inst->len;
+    if (inst->kind == PEEP_OTHER) {
+      insts_emitted += countInsts(text + inst->start, inst->len);
+    }
+  }
+}
@@ -0,0 +1,32 @@
+#ifndef EMIT_H
+#define EMIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "defs.h"
+
+PeepOperand immOperand(int64_t val);
+PeepOperand regOperand(int reg, size_t size);
+PeepOperand slotOperand(int base, int64_t disp, size_t size);
+const char *regName(int reg, size_t size);
+size_t emitted(void);
+void emitBeginFunc(void);
+void emitBytes(const char *bytes, size_t n);
+void emitChar(char c);
+void emitEndFunc(void);
+void emitFlush(void);
+void emitFlushIfFull(void);
+void emitInt(int64_t val);
+void emitJumpTo(int opcode, const char *label);
+void emitLabel(const char *label);
+void emitLoc(int file_no, size_t line);
+void emitOp(int opcode, PeepOperand *dst, PeepOperand *src);
+void emitRegImm(int opcode, int reg, size_t size, int64_t val);
+void emitRegs(int opcode, int dst, size_t dst_size, int src, size_t src_size);
+void emitSlot(const char *base, int64_t disp);
+void emitStr(const char *str);
+void emitUint(uint64_t val);
+void println(const char *fmt, ...);
+
+#endif // EMIT_H
@@ -0,0 +1,437 @@
+#include "fold.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "defs.h"
+#include "parse.h"
+
+extern Arena ast_arena;
+extern Obj *prog;
+
+static Node *foldBinary(Node *node);
+static Node *foldBranch(Node *node);
+static Node *foldConst(Node *node);
+static Node *foldNode(Node *node);
+static Node *foldPow2(Node *node, Node *x, int64_t c);
+static Node *newFoldNode(NodeKind kind, Node *lhs, Node *rhs, Node *orig);
+static Node *newFoldNum(int64_t val, Node *orig);
+static bool hasLabel(Node *node);
+static bool isConst(Node *node);
+static bool isPlainVar(Node *node);
+static bool isTrue(Node *node);
+static bool sameType(Type *a, Type *b);
+static int64_t wrapValue(Type *ty, int64_t val);
+static int log2Exact(int64_t val);
+static void foldList(Node **link);
+
+void fold(void) {
+  for (Obj *fn = prog; fn; fn = fn->next) {
+    if (fn->body) {
+      fn->body = foldNode(fn->body);
+    }
+  }
+}
+
+void foldList(Node **link) {
+  while (*link) {
+    Node *next = (*link)->next;
+    *link = foldNode(*link);
+    (*link)->next = next;
+    link = &(*link)->next;
+  }
+}
+
+Node *foldNode(Node *node) {
+  if (!node) {
+    return NULL;
+  }
+  node->lhs = foldNode(node->lhs);
+  node->rhs = foldNode(node->rhs);
+  node->cond = foldNode(node->cond);
+  node->then = foldNode(node->then);
+  node->els = foldNode(node->els);
+  node->pre = foldNode(node->pre);
+  node->post = foldNode(node->post);
+  foldList(&node->body);
+  foldList(&node->args);
+
+  switch (node->kind) {
+  case ND_IF:
+  case ND_TERN:
+  case ND_FOR:
+  case ND_WHILE:
+  case ND_LOGAND:
+  case ND_LOGOR:
+  case ND_COMMA:
+    return foldBranch(node);
+  default:
+    break;
+  }
+  if (!node->ty || !(isNumeric(node->ty) || node->ty->kind == TY_PTR)) {
+    return node;
+  }
+  Node *folded = foldConst(node);
+  if (folded != node) {
+    return folded;
+  }
+  return foldBinary(node);
+}
+
+// Evaluates an operator whose operands are all constants, using the same
+// semantics as the initialiser evaluator. Anything that would trap or is
+// undefined at compile time is left for the generated code.
+Node *foldConst(Node *node) {
+  switch (node->kind) {
+  case ND_ADD:
+  case ND_SUB:
+  case ND_MUL:
+  case ND_DIV:
+  case ND_MOD:
+  case ND_BITAND:
+  case ND_BITOR:
+  case ND_BITXOR:
+  case ND_SHL:
+  case ND_SHR:
+  case ND_EQ:
+  case ND_NE:
+  case ND_LT:
+  case ND_LE:
+    if (!isConst(node->lhs) || !isConst(node->rhs)) {
+      return node;
+    }
+    break;
+  case ND_BITNOT:
+  case ND_NOT:
+  case ND_CAST:
+    if (!isConst(node->lhs)) {
+      return node;
+    }
+    break;
+  default:
+    return node;
+  }
+  if (!isNumeric(node->ty)) {
+    return node;
+  }
+
+  if (isInteger(node->lhs->ty) && node->rhs && isInteger(node->rhs->ty)) {
+    const int64_t rhs = node->rhs->val;
+    switch (node->kind) {
+    case ND_DIV:
+    case ND_MOD:
+      if (rhs == 0 || (rhs == -1 && !node->ty->is_unsigned)) {
+        return node;
+      }
+      break;
+    case ND_SHL:
+    case ND_SHR:
+      if (rhs < 0 || rhs >= (int64_t)node->ty->size * 8) {
+        return node;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  Node *num = newFoldNum(0, node);
+  if (isFloat(node->ty)) {
+    if (node->kind == ND_CAST && isInteger(node->lhs->ty) &&
+        node->lhs->ty->is_unsigned) {
+      num->fval = (double)(uint64_t)node->lhs->val;
+    } else {
+      num->fval = evalDouble(node);
+    }
+    if (node->ty->kind == TY_FLOAT) {
+      num->fval = (float)num->fval;
+    }
+    return num;
+  }
+
+  if (node->kind == ND_CAST && node->ty->kind == TY_BOOL) {
+    num->val = isTrue(node->lhs);
+    return num;
+  }
+  if (node->kind == ND_CAST && isFloat(node->lhs->ty)) {
+    // Out of range conversions are left to the generated code, which yields
+    // whatever cvttsd2si does rather than what the host compiler does.
+    const double limit = node->ty->size == 8 ? 9223372036854775807.0
+                                             : 2147483647.0;
+    if (!(node->lhs->fval > -limit && node->lhs->fval < limit)) {
+      return node;
+    }
+  }
+  if (node->kind == ND_NOT) {
+    num->val = !isTrue(node->lhs);
+    return num;
+  }
+  if (node->kind != ND_CAST && isFloat(node->lhs->ty)) {
+    const double lhs = evalDouble(node->lhs);
+    const double rhs = evalDouble(node->rhs);
+    switch (node->kind) {
+    case ND_EQ:
+      num->val = lhs == rhs;
+      return num;
+    case ND_NE:
+      num->val = lhs != rhs;
+      return num;
+    case ND_LT:
+      num->val = lhs < rhs;
+      return num;
+    case ND_LE:
+      num->val = lhs <= rhs;
+      return num;
+    default:
+      return node;
+    }
+  }
+  num->val = wrapValue(node->ty, eval(node));
+  return num;
+}
+
+// Removes arithmetic identities and replaces multiplication, division and
+// remainder by powers of two with shifts and masks.
+Node *foldBinary(Node *node) {
+  if (!isInteger(node->ty) && node->ty->kind != TY_PTR) {
+    return node;
+  }
+  Node *x = NULL;
+  int64_t c = 0;
+  if (node->rhs && isConst(node->rhs) && isInteger(node->rhs->ty)) {
+    x = node->lhs;
+    c = node->rhs->val;
+  } else if (node->lhs && isConst(node->lhs) && isInteger(node->lhs->ty) &&
+             (node->kind == ND_ADD || node->kind == ND_MUL ||
+              node->kind == ND_BITAND || node->kind == ND_BITOR ||
+              node->kind == ND_BITXOR)) {
+    x = node->rhs;
+    c = node->lhs->val;
+  }
+  if (!x || !x->ty || !sameType(x->ty, node->ty)) {
+    return node;
+  }
+
+  switch (node->kind) {
+  case ND_ADD:
+  case ND_BITOR:
+  case ND_BITXOR:
+    return c == 0 ? x : node;
+  case ND_SUB:
+  case ND_SHL:
+  case ND_SHR:
+    return c == 0 ? x : node;
+  case ND_BITAND:
+    return c == wrapValue(node->ty, -1) ? x : node;
+  case ND_MUL:
+  case ND_DIV:
+  case ND_MOD:
+    return foldPow2(node, x, c);
+  default:
+    break;
+  }
+  return node;
+}
+
+Node *foldPow2(Node *node, Node *x, int64_t c) {
+  const int k = log2Exact(c);
+  if (k < 0 || (node->kind != ND_MUL && x != node->lhs)) {
+    return node;
+  }
+  if (k == 0) {
+    return node->kind == ND_MOD ? node : x;
+  }
+  if (node->kind == ND_MUL) {
+    return newFoldNode(ND_SHL, x, newFoldNum(k, node), node);
+  }
+  if (node->ty->is_unsigned) {
+    if (node->kind == ND_DIV) {
+      return newFoldNode(ND_SHR, x, newFoldNum(k, node), node);
+    }
+    return newFoldNode(ND_BITAND, x, newFoldNum(c - 1, node), node);
+  }
+
+  // Signed division rounds towards zero, so negative dividends are biased by
+  // c-1 before shifting. The dividend is read twice, so only plain variables
+  // qualify.
+  if (!isPlainVar(x)) {
+    return node;
+  }
+  Node *sign = newFoldNode(
+      ND_SHR, x, newFoldNum((int64_t)node->ty->size * 8 - 1, node), node);
+  Node *bias = newFoldNode(ND_BITAND, sign, newFoldNum(c - 1, node), node);
+  Node *biased = newFoldNode(ND_ADD, x, bias, node);
+  if (node->kind == ND_DIV) {
+    return newFoldNode(ND_SHR, biased, newFoldNum(k, node), node);
+  }
+  Node *trunc = newFoldNode(ND_BITAND, biased, newFoldNum(-c, node), node);
+  return newFoldNode(ND_SUB, x, trunc, node);
+}
+
+// Drops the arms of conditionals whose condition is a constant. An arm that
+// contains a label or case is kept, since it can be entered by a jump.
+Node *foldBranch(Node *node) {
+  switch (node->kind) {
+  case ND_IF: {
+    if (!isConst(node->cond)) {
+      return node;
+    }
+    Node *live = isTrue(node->cond) ? node->then : node->els;
+    Node *dead = isTrue(node->cond) ? node->els : node->then;
+    if (hasLabel(dead)) {
+      return node;
+    }
+    if (!live) {
+      return newFoldNode(ND_BLK, NULL, NULL, node);
+    }
+    return live;
+  }
+  case ND_TERN: {
+    if (!isConst(node->cond)) {
+      return node;
+    }
+    Node *live = isTrue(node->cond) ? node->then : node->els;
+    if (!live->ty || !sameType(live->ty, node->ty)) {
+      return node;
+    }
+    return live;
+  }
+  case ND_FOR:
+  case ND_WHILE:
+    if (node->cond && isConst(node->cond) && isTrue(node->cond)) {
+      node->cond = NULL;
+    }
+    return node;
+  case ND_LOGAND:
+  case ND_LOGOR: {
+    if (!isConst(node->lhs)) {
+      return node;
+    }
+    const bool lhs = isTrue(node->lhs);
+    if (node->kind == ND_LOGAND ? !lhs : lhs) {
+      return newFoldNum(lhs, node);
+    }
+    if (isConst(node->rhs)) {
+      return newFoldNum(isTrue(node->rhs), node);
+    }
+    return node;
+  }
+  case ND_COMMA:
+    if (isConst(node->lhs)) {
+      return node->rhs;
+    }
+    return node;
+  default:
+    break;
+  }
+  return node;
+}
+
+bool hasLabel(Node *node) {
+  if (!node) {
+    return false;
+  }
+  if (node->kind == ND_LABEL || node->kind == ND_CASE) {
+    return true;
+  }
+  if (hasLabel(node->lhs) || hasLabel(node->rhs) || hasLabel(node->cond) ||
+      hasLabel(node->then) || hasLabel(node->els) || hasLabel(node->pre) ||
+      hasLabel(node->post)) {
+    return true;
+  }
+  for (Node *n = node->body; n; n = n->next) {
+    if (hasLabel(n)) {
+      return true;
+    }
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    if (hasLabel(n)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool isConst(Node *node) {
+  return node && node->kind == ND_NUM && node->ty && isNumeric(node->ty);
+}
+
+bool isPlainVar(Node *node) {
+  while (node->kind == ND_CAST && isInteger(node->lhs->ty)) {
+    node = node->lhs;
+  }
+  return node->kind == ND_VAR;
+}
+
+bool isTrue(Node *node) {
+  if (isFloat(node->ty)) {
+    return node->fval != 0;
+  }
+  return node->val != 0;
+}
+
+bool sameType(Type *a, Type *b) {
+  if (a->kind == TY_PTR || b->kind == TY_PTR) {
+    return a->kind == b->kind;
+  }
+  return a->kind == b->kind && a->size == b->size &&
+         a->is_unsigned == b->is_unsigned;
+}
+
+int64_t wrapValue(Type *ty, int64_t val) {
+  if (ty->kind == TY_BOOL) {
+    return val != 0;
+  }
+  if (ty->is_unsigned) {
+    switch (ty->size) {
+    case 1:
+      return (uint8_t)val;
+    case 2:
+      return (uint16_t)val;
+    case 4:
+      return (uint32_t)val;
+    default:
+      return val;
+    }
+  }
+  switch (ty->size) {
+  case 1:
+    return (int8_t)val;
+  case 2:
+    return (int16_t)val;
+  case 4:
+    return (int32_t)val;
+  default:
+    return val;
+  }
+}
+
+int log2Exact(int64_t val) {
+  if (val <= 0 || (val & (val - 1))) {
+    return -1;
+  }
+  int k = 0;
+  while (val > 1) {
+    val >>= 1;
+    k++;
+  }
+  return k;
+}
+
+Node *newFoldNode(NodeKind kind, Node *lhs, Node *rhs, Node *orig) {
+  Node *node = arenaCalloc(&ast_arena, 1, sizeof(Node));
+  node->kind = kind;
+  node->lhs = lhs;
+  node->rhs = rhs;
+  node->tok = orig->tok;
+  node->ty = orig->ty;
+  return node;
+}
+
+Node *newFoldNum(int64_t val, Node *orig) {
+  Node *node = newFoldNode(ND_NUM, NULL, NULL, orig);
+  node->val = val;
+  return node;
+}
@@ -0,0 +1,6 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+void fold(void);
+
+#endif // FOLD_H
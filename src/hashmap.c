@@ -0,0 +1,102 @@
+#include "hashmap.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "defs.h"
+
+extern Arena token_arena;
+
+static HashMap interned = {0};
+
+static HashEntry *findEntry(HashMap *map, const char *key, size_t len,
+                            bool by_content);
+static uint64_t hashPtr(const char *key);
+static uint64_t hashStr(const char *str, size_t len);
+static void grow(HashMap *map, bool by_content);
+
+// Returns the one copy of `str` shared by every identifier with the same
+// spelling, so that symbols can be compared and hashed by address.
+const char *intern(const char *str, size_t len) {
+  if (interned.cnt * 2 >= interned.cap) {
+    grow(&interned, true);
+  }
+  HashEntry *entry = findEntry(&interned, str, len, true);
+  if (!entry->key) {
+    entry->key = arenaStrndup(&token_arena, str, len);
+    interned.cnt++;
+  }
+  return entry->key;
+}
+
+// Scope maps are keyed on interned names, so lookups only hash and compare
+// pointers.
+void *hashmapGet(HashMap *map, const char *key) {
+  if (!map->cap) {
+    return NULL;
+  }
+  return findEntry(map, key, 0, false)->val;
+}
+
+void hashmapPut(HashMap *map, const char *key, void *val) {
+  if (map->cnt * 2 >= map->cap) {
+    grow(map, false);
+  }
+  HashEntry *entry = findEntry(map, key, 0, false);
+  if (!entry->key) {
+    entry->key = key;
+    map->cnt++;
+  }
+  entry->val = val;
+}
+
+HashEntry *findEntry(HashMap *map, const char *key, size_t len,
+                     bool by_content) {
+  const uint64_t hash = by_content ? hashStr(key, len) : hashPtr(key);
+  for (size_t i = hash & (map->cap - 1);; i = (i + 1) & (map->cap - 1)) {
+    HashEntry *entry = &map->buckets[i];
+    if (!entry->key) {
+      return entry;
+    }
+    if (by_content ? strncmp(entry->key, key, len) == 0 && !entry->key[len]
+                   : entry->key == key) {
+      return entry;
+    }
+  }
+}
+
+void grow(HashMap *map, bool by_content) {
+  HashMap new_map = {0};
+  new_map.cap = map->cap ? map->cap * 2 : 16;
+  new_map.buckets = map->arena
+                        ? arenaCalloc(map->arena, new_map.cap, sizeof(HashEntry))
+                        : calloc(new_map.cap, sizeof(HashEntry));
+  for (size_t i = 0; i < map->cap; i++) {
+    HashEntry *old = &map->buckets[i];
+    if (old->key) {
+      const size_t len = by_content ? strlen(old->key) : 0;
+      *findEntry(&new_map, old->key, len, by_content) = *old;
+    }
+  }
+  if (!map->arena) {
+    free(map->buckets);
+  }
+  map->buckets = new_map.buckets;
+  map->cap = new_map.cap;
+}
+
+uint64_t hashPtr(const char *key) {
+  const uint64_t hash = (uint64_t)key * 0x9e3779b97f4a7c15;
+  return hash ^ (hash >> 32);
+}
+
+uint64_t hashStr(const char *str, size_t len) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ (unsigned char)str[i]) * 0x100000001b3;
+  }
+  return hash;
+}
@@ -0,0 +1,12 @@
+#ifndef HASHMAP_H
+#define HASHMAP_H
+
+#include <stddef.h>
+
+typedef struct HashMap HashMap;
+
+const char *intern(const char *str, size_t len);
+void *hashmapGet(HashMap *map, const char *key);
+void hashmapPut(HashMap *map, const char *key, void *val);
+
+#endif // HASHMAP_H
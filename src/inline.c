@@ -0,0 +1,377 @@
+#include "inline.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "arena.h"
+#include "defs.h"
+#include "hashmap.h"
+#include "parse.h"
+
+// A static function of at most SMALL_MAX_NODES nodes is inlined at every call
+// site. One with a single call site may be larger, since its out-of-line copy
+// is dropped once the call is inlined.
+enum { SMALL_MAX_NODES = 40, SINGLE_CALL_MAX_NODES = 800 };
+
+extern Arena ast_arena;
+extern Arena fn_arena;
+extern Obj *globals;
+extern Obj *prog;
+extern size_t nodes_allocated;
+size_t calls_inlined = 0;
+
+static HashMap funcs = {0};
+static size_t node_cnt = 0;
+// The locals and labels of the callee being inlined, mapped to their copies
+// in the caller. Both maps live in fn_arena, which is reset after each caller.
+static HashMap var_map = {0};
+static HashMap label_map = {0};
+static Obj *ret_var = NULL;
+static char *join_label = NULL;
+static Node *orig_switch = NULL;
+static Node *copy_switch = NULL;
+
+static Node *cloneList(Node *list);
+static Node *cloneNode(Node *node);
+static Node *cloneRet(Node *node);
+static Node *copyNode(Node *node);
+static Node *newInlineNode(NodeKind kind, Node *orig);
+static Node *newInlineVar(Obj *var, Node *orig);
+static Obj *findFunc(const char *name);
+static Obj *inlinable(Obj *caller, Node *node);
+static Obj *remapVar(Obj *var);
+static char *remapLabel(char *label);
+static void countNodes(Node *node, size_t limit);
+static void countRefs(Node *node);
+static void expandCall(Obj *caller, Node *node, Obj *callee);
+static void inlineNode(Obj *caller, Node *node);
+
+// Runs after folding, so that callee sizes are measured on the folded bodies.
+// Callees are inlined into each function in source order, and the copies are
+// not inlined into again, so a function defined before its callers has had
+// its own calls inlined by the time it is copied. Static functions left with
+// no calls and whose address is never taken are not emitted.
+void inlineCalls(void) {
+  for (Obj *fn = prog; fn; fn = fn->next) {
+    if (fn->body) {
+      hashmapPut(&funcs, intern(fn->name, strlen(fn->name)), fn);
+    }
+  }
+  for (Obj *fn = prog; fn; fn = fn->next) {
+    countRefs(fn->body);
+  }
+  for (Obj *var = globals; var; var = var->next) {
+    for (Relocation *rel = var->rel; rel; rel = rel->next) {
+      Obj *fn = findFunc(rel->label);
+      if (fn) {
+        fn->is_addr_taken = true;
+      }
+    }
+  }
+  for (Obj *fn = prog; fn; fn = fn->next) {
+    inlineNode(fn, fn->body);
+    arenaReset(&fn_arena);
+  }
+  for (Obj *fn = prog; fn; fn = fn->next) {
+    if (fn->body && fn->is_static && !fn->is_addr_taken && !fn->call_cnt) {
+      fn->body = NULL;
+    }
+  }
+}
+
+Obj *findFunc(const char *name) {
+  return hashmapGet(&funcs, intern(name, strlen(name)));
+}
+
+// A function named as a value rather than called may be called through a
+// pointer, so it must be kept.
+void countRefs(Node *node) {
+  if (!node) {
+    return;
+  }
+  if (node->kind == ND_FUNCCALL) {
+    Obj *fn = findFunc(node->funcname);
+    if (fn) {
+      fn->call_cnt++;
+    }
+  } else if (node->kind == ND_VAR && node->var->ty->kind == TY_FUNC) {
+    Obj *fn = findFunc(node->var->name);
+    if (fn) {
+      fn->is_addr_taken = true;
+    }
+  }
+  countRefs(node->lhs);
+  countRefs(node->rhs);
+  countRefs(node->cond);
+  countRefs(node->then);
+  countRefs(node->els);
+  countRefs(node->pre);
+  countRefs(node->post);
+  for (Node *n = node->body; n; n = n->next) {
+    countRefs(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    countRefs(n);
+  }
+}
+
+// Calls in the arguments are inlined first, and become part of the argument
+// expressions. The inlined body itself is not walked again.
+void inlineNode(Obj *caller, Node *node) {
+  if (!node) {
+    return;
+  }
+  inlineNode(caller, node->lhs);
+  inlineNode(caller, node->rhs);
+  inlineNode(caller, node->cond);
+  inlineNode(caller, node->then);
+  inlineNode(caller, node->els);
+  inlineNode(caller, node->pre);
+  inlineNode(caller, node->post);
+  for (Node *n = node->body; n; n = n->next) {
+    inlineNode(caller, n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    inlineNode(caller, n);
+  }
+  if (node->kind != ND_FUNCCALL) {
+    return;
+  }
+  Obj *callee = inlinable(caller, node);
+  if (callee) {
+    expandCall(caller, node, callee);
+  }
+}
+
+Obj *inlinable(Obj *caller, Node *node) {
+  Obj *callee = findFunc(node->funcname);
+  if (!callee || callee == caller || !callee->is_static || callee->va_area) {
+    return NULL;
+  }
+  Type *ret_ty = callee->ty->ret_ty;
+  if (ret_ty->kind == TY_STRUCT || ret_ty->kind == TY_UNION) {
+    return NULL;
+  }
+  const size_t limit = callee->call_cnt == 1 && !callee->is_addr_taken
+                           ? SINGLE_CALL_MAX_NODES
+                           : SMALL_MAX_NODES;
+  node_cnt = 0;
+  countNodes(callee->body, limit);
+  return node_cnt <= limit ? callee : NULL;
+}
+
+// Stops counting once past `limit`, so that large functions are not walked in
+// full at every call site.
+void countNodes(Node *node, size_t limit) {
+  if (!node || node_cnt > limit) {
+    return;
+  }
+  node_cnt++;
+  countNodes(node->lhs, limit);
+  countNodes(node->rhs, limit);
+  countNodes(node->cond, limit);
+  countNodes(node->then, limit);
+  countNodes(node->els, limit);
+  countNodes(node->pre, limit);
+  countNodes(node->post, limit);
+  for (Node *n = node->body; n; n = n->next) {
+    countNodes(n, limit);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    countNodes(n, limit);
+  }
+}
+
+// Replaces the call with a statement expression that assigns the arguments to
+// copies of the callee's parameters, runs a copy of its body in which each
+// return stores to `ret_var` and jumps to the join label, and then yields
+// `ret_var`. The copies of the callee's locals are added to the caller's.
+void expandCall(Obj *caller, Node *node, Obj *callee) {
+  var_map = (HashMap){.arena = &fn_arena};
+  Obj head = {0};
+  Obj *cur = &head;
+  for (Obj *var = callee->locals; var; var = var->next) {
+    Obj *copy = newObj();
+    *copy = *var;
+    copy->scope_begin = copy->scope_end = 0;
+    hashmapPut(&var_map, (const char *)var, copy);
+    cur = cur->next = copy;
+  }
+  ret_var = NULL;
+  if (node->ty->kind != TY_VOID) {
+    ret_var = newObj();
+    ret_var->name = callee->name;
+    ret_var->ty = node->ty;
+    ret_var->align = node->ty->align;
+    cur = cur->next = ret_var;
+  }
+  cur->next = caller->locals;
+  caller->locals = head.next;
+
+  label_map = (HashMap){.arena = &fn_arena};
+  join_label = newUniqueLabel();
+
+  Obj **params = arenaCalloc(&fn_arena, callee->param_cnt + 1, sizeof(Obj *));
+  size_t i = callee->param_cnt;
+  for (Obj *param = callee->params; param; param = param->next) {
+    params[--i] = remapVar(param);
+  }
+  Node body_head = {0};
+  Node *tail = &body_head;
+  i = 0;
+  for (Node *arg = node->args; arg;) {
+    Node *next = arg->next;
+    arg->next = NULL;
+    Node *ass = newInlineNode(ND_ASS, node);
+    ass->lhs = newInlineVar(params[i++], node);
+    ass->rhs = arg;
+    ass->ty = ass->lhs->ty;
+    tail = tail->next = ass;
+    arg = next;
+  }
+  tail = tail->next = cloneNode(callee->body);
+  Node *join = newInlineNode(ND_LABEL, node);
+  join->unique_label = join_label;
+  join->lhs = ret_var ? newInlineVar(ret_var, node)
+                      : newInlineNode(ND_NULL_EXPR, node);
+  tail->next = join;
+
+  Node *next = node->next;
+  Node *expr = newInlineNode(ND_STMT_EXPR, node);
+  expr->body = body_head.next;
+  *node = *expr;
+  node->next = next;
+  callee->call_cnt--;
+  calls_inlined++;
+}
+
+Node *cloneList(Node *list) {
+  Node head = {0};
+  Node *cur = &head;
+  for (Node *n = list; n; n = n->next) {
+    cur = cur->next = cloneNode(n);
+  }
+  return head.next;
+}
+
+// Cases are linked into the copy of their switch as they are completed, which
+// is the order in which the parser linked the originals.
+Node *cloneNode(Node *node) {
+  if (!node) {
+    return NULL;
+  }
+  if (node->kind == ND_RET) {
+    return cloneRet(node);
+  }
+  Node *copy = copyNode(node);
+  Node *outer_orig = orig_switch;
+  Node *outer_copy = copy_switch;
+  if (node->kind == ND_SWITCH) {
+    orig_switch = node;
+    copy_switch = copy;
+    copy->case_next = NULL;
+    copy->default_case = NULL;
+  }
+  copy->lhs = cloneNode(node->lhs);
+  copy->rhs = cloneNode(node->rhs);
+  copy->cond = cloneNode(node->cond);
+  copy->then = cloneNode(node->then);
+  copy->els = cloneNode(node->els);
+  copy->pre = cloneNode(node->pre);
+  copy->post = cloneNode(node->post);
+  copy->body = cloneList(node->body);
+  copy->args = cloneList(node->args);
+  orig_switch = outer_orig;
+  copy_switch = outer_copy;
+
+  copy->var = remapVar(node->var);
+  copy->unique_label = remapLabel(node->unique_label);
+  copy->brk_label = remapLabel(node->brk_label);
+  copy->cont_label = remapLabel(node->cont_label);
+  if (node->kind == ND_CASE) {
+    copy->label = remapLabel(node->label);
+    if (node == orig_switch->default_case) {
+      copy_switch->default_case = copy;
+    } else {
+      copy->case_next = copy_switch->case_next;
+      copy_switch->case_next = copy;
+    }
+  }
+  if (node->kind == ND_FUNCCALL) {
+    Obj *fn = findFunc(node->funcname);
+    if (fn) {
+      fn->call_cnt++;
+    }
+  }
+  return copy;
+}
+
+Node *cloneRet(Node *node) {
+  Node *blk = newInlineNode(ND_BLK, node);
+  Node head = {0};
+  Node *cur = &head;
+  if (node->lhs) {
+    Node *val = cloneNode(node->lhs);
+    if (ret_var) {
+      Node *ass = newInlineNode(ND_ASS, node);
+      ass->lhs = newInlineVar(ret_var, node);
+      ass->rhs = val;
+      ass->ty = ret_var->ty;
+      val = ass;
+    }
+    cur = cur->next = val;
+  }
+  Node *jmp = newInlineNode(ND_GOTO, node);
+  jmp->unique_label = join_label;
+  cur->next = jmp;
+  blk->body = head.next;
+  return blk;
+}
+
+Node *copyNode(Node *node) {
+  nodes_allocated++;
+  Node *copy = arenaCalloc(&ast_arena, 1, sizeof(Node));
+  *copy = *node;
+  copy->next = NULL;
+  copy->goto_next = NULL;
+  return copy;
+}
+
+Node *newInlineNode(NodeKind kind, Node *orig) {
+  nodes_allocated++;
+  Node *node = arenaCalloc(&ast_arena, 1, sizeof(Node));
+  node->kind = kind;
+  node->tok = orig->tok;
+  node->ty = orig->ty;
+  return node;
+}
+
+Node *newInlineVar(Obj *var, Node *orig) {
+  Node *node = newInlineNode(ND_VAR, orig);
+  node->var = var;
+  node->ty = var->ty;
+  return node;
+}
+
+Obj *remapVar(Obj *var) {
+  if (!var || var->is_global) {
+    return var;
+  }
+  Obj *copy = hashmapGet(&var_map, (const char *)var);
+  return copy ? copy : var;
+}
+
+// Labels are compared by address, so every label of the copy is replaced by a
+// fresh one, the same for each use of the original.
+char *remapLabel(char *label) {
+  if (!label) {
+    return NULL;
+  }
+  char *copy = hashmapGet(&label_map, label);
+  if (!copy) {
+    copy = newUniqueLabel();
+    hashmapPut(&label_map, label, copy);
+  }
+  return copy;
+}
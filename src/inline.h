@@ -0,0 +1,6 @@
+#ifndef INLINE_H
+#define INLINE_H
+
+void inlineCalls(void);
+
+#endif // INLINE_H
@@ -0,0 +1,996 @@
+#include "ir.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "codegen.h"
+#include "comp_err.h"
+#include "defs.h"
+#include "parse.h"
+
+extern Arena fn_arena;
+extern FILE *output;
+extern Obj *prog;
+extern Type *ty_int;
+static IRFunc *cur_ir = NULL;
+static BasicBlock *cur_bb = NULL;
+static BasicBlock *tail_bb = NULL;
+static const char *op_names[] = {
+    "add",  "addi",    "gaddr", "laddr", "and", "not", "or",  "xor",
+    "br",   "call",    "cast",  "div",   "eq",  "imm", "jmp", "le",
+    "load", "lt",      "memzero", "mod", "mov", "mul", "ne",  "lnot",
+    "ret",  "rmw",     "shl",   "shr",   "store", "sub", "switch"};
+
+static BasicBlock *bbForLabel(const char *label);
+static BasicBlock *newBlock(void);
+static IRInst *newInst(IROp op, Node *node);
+static IRInst *newBinary(IROp op, Node *node, size_t lhs, size_t rhs);
+static IROp binaryOp(Node *node);
+static Node *compoundRead(Node *node);
+static bool canRmw(Node *node, Node *op);
+static bool isPureInst(IRInst *inst);
+static bool isScalar(Type *ty);
+static bool sameExpr(Node *a, Node *b);
+static const char *typeName(Type *ty);
+static size_t lowerAddr(Node *node);
+static size_t lowerAssign(Node *node);
+static size_t lowerBinary(Node *node);
+static size_t lowerCast(Node *node, size_t val);
+static size_t lowerExpr(Node *node);
+static size_t lowerLoad(Node *node, size_t addr);
+static size_t lowerRmw(Node *node, Node *op);
+static size_t lowerStmt(Node *node);
+static size_t newBinaryOp(Node *node, size_t lhs, size_t rhs);
+static size_t newVreg(bool is_fp);
+static void dumpFunc(Obj *fn);
+static void dumpInst(IRInst *inst);
+static void lowerArgs(Node *arg, size_t *vregs, size_t idx);
+static void lowerBr(Node *cond, BasicBlock *then, BasicBlock *els);
+static void lowerJmp(Node *node, BasicBlock *bb);
+static void markAddrTaken(Node *node);
+static void pruneUnreachable(IRFunc *ir);
+static void removeDeadInsts(IRFunc *ir);
+static void scanAddrTaken(Node *node);
+static void startBlock(BasicBlock *bb);
+
+// Scalar locals whose address is never taken are promoted to virtual
+// registers, every other local is accessed through explicit loads and stores.
+IRFunc *lowerFunc(Obj *fn) {
+  cur_ir = arenaCalloc(&fn_arena, 1, sizeof(IRFunc));
+  newVreg(false);
+
+  scanAddrTaken(fn->body);
+  for (Obj *var = fn->locals; var; var = var->next) {
+    if (var == fn->va_area || var->is_addr_taken || !isScalar(var->ty)) {
+      continue;
+    }
+    var->vreg = newVreg(isFloat(var->ty));
+    cur_ir->vreg_var[var->vreg] = var;
+  }
+
+  cur_bb = tail_bb = cur_ir->blocks = newBlock();
+  lowerStmt(fn->body);
+  if (!isTerminator(cur_bb->last)) {
+    newInst(IR_RET, fn->body);
+  }
+  pruneUnreachable(cur_ir);
+  removeDeadInsts(cur_ir);
+  return cur_ir;
+}
+
+bool isScalar(Type *ty) {
+  return isNumeric(ty) || ty->kind == TY_PTR;
+}
+
+void scanAddrTaken(Node *node) {
+  if (!node) {
+    return;
+  }
+  if (node->kind == ND_ADDR) {
+    markAddrTaken(node->body);
+  } else if (node->kind == ND_ASS && node->lhs->kind != ND_VAR) {
+    markAddrTaken(node->lhs);
+  }
+  scanAddrTaken(node->lhs);
+  scanAddrTaken(node->rhs);
+  scanAddrTaken(node->cond);
+  scanAddrTaken(node->then);
+  scanAddrTaken(node->els);
+  scanAddrTaken(node->pre);
+  scanAddrTaken(node->post);
+  for (Node *n = node->body; n; n = n->next) {
+    scanAddrTaken(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    scanAddrTaken(n);
+  }
+}
+
+void markAddrTaken(Node *node) {
+  switch (node->kind) {
+  case ND_VAR:
+    node->var->is_addr_taken = true;
+    return;
+  case ND_COMMA:
+    markAddrTaken(node->rhs);
+    return;
+  case ND_MEMBER:
+    markAddrTaken(node->lhs);
+    return;
+  default:
+    return;
+  }
+}
+
+size_t newVreg(bool is_fp) {
+  IRFunc *ir = cur_ir;
+  if (ir->vreg_cnt == ir->vreg_cap) {
+    ir->vreg_cap = ir->vreg_cap ? ir->vreg_cap * 2 : 16;
+    ir->vreg_is_fp = arenaRealloc(&fn_arena, ir->vreg_is_fp,
+                                  ir->vreg_cnt * sizeof(bool),
+                                  ir->vreg_cap * sizeof(bool));
+    ir->vreg_var = arenaRealloc(&fn_arena, ir->vreg_var,
+                                ir->vreg_cnt * sizeof(Obj *),
+                                ir->vreg_cap * sizeof(Obj *));
+  }
+  ir->vreg_is_fp[ir->vreg_cnt] = is_fp;
+  ir->vreg_var[ir->vreg_cnt] = NULL;
+  return ir->vreg_cnt++;
+}
+
+BasicBlock *newBlock(void) {
+  IRFunc *ir = cur_ir;
+  if (ir->block_cnt == ir->block_cap) {
+    ir->block_cap = ir->block_cap ? ir->block_cap * 2 : 16;
+    ir->all_blocks = arenaRealloc(&fn_arena, ir->all_blocks,
+                                  ir->block_cnt * sizeof(BasicBlock *),
+                                  ir->block_cap * sizeof(BasicBlock *));
+  }
+  BasicBlock *bb = arenaCalloc(&fn_arena, 1, sizeof(BasicBlock));
+  bb->id = ir->block_cnt;
+  ir->all_blocks[ir->block_cnt++] = bb;
+  return bb;
+}
+
+BasicBlock *bbForLabel(const char *label) {
+  for (size_t i = 0; i < cur_ir->block_cnt; i++) {
+    if (cur_ir->all_blocks[i]->label == label) {
+      return cur_ir->all_blocks[i];
+    }
+  }
+  BasicBlock *bb = newBlock();
+  bb->label = label;
+  return bb;
+}
+
+bool isTerminator(IRInst *inst) {
+  return inst && (inst->op == IR_BR || inst->op == IR_JMP ||
+                  inst->op == IR_RET || inst->op == IR_SWITCH);
+}
+
+void startBlock(BasicBlock *bb) {
+  if (!isTerminator(cur_bb->last)) {
+    IRInst *inst = arenaCalloc(&fn_arena, 1, sizeof(IRInst));
+    inst->op = IR_JMP;
+    inst->then = bb;
+    if (cur_bb->last) {
+      inst->file_no = cur_bb->last->file_no;
+      inst->line_num = cur_bb->last->line_num;
+      cur_bb->last = cur_bb->last->next = inst;
+    } else {
+      cur_bb->insts = cur_bb->last = inst;
+    }
+  }
+  tail_bb = tail_bb->next = bb;
+  cur_bb = bb;
+}
+
+// Code following a terminator is unreachable, but still gets a block of its
+// own so that every block ends with exactly one terminator.
+IRInst *newInst(IROp op, Node *node) {
+  if (isTerminator(cur_bb->last)) {
+    startBlock(newBlock());
+  }
+  IRInst *inst = arenaCalloc(&fn_arena, 1, sizeof(IRInst));
+  inst->op = op;
+  inst->file_no = node->tok->file ? node->tok->file->file_no : 0;
+  inst->line_num = node->tok->line_num;
+  if (cur_bb->last) {
+    cur_bb->last = cur_bb->last->next = inst;
+  } else {
+    cur_bb->insts = cur_bb->last = inst;
+  }
+  return inst;
+}
+
+IRInst *newBinary(IROp op, Node *node, size_t lhs, size_t rhs) {
+  IRInst *inst = newInst(op, node);
+  inst->lhs = lhs;
+  inst->rhs = rhs;
+  return inst;
+}
+
+void lowerJmp(Node *node, BasicBlock *bb) {
+  IRInst *inst = newInst(IR_JMP, node);
+  inst->then = bb;
+}
+
+void lowerBr(Node *cond, BasicBlock *then, BasicBlock *els) {
+  size_t c = lowerExpr(cond);
+  IRInst *inst = newInst(IR_BR, cond);
+  inst->lhs = c;
+  inst->ty = cond->ty;
+  inst->then = then;
+  inst->els = els;
+}
+
+size_t lowerStmt(Node *node) {
+  switch (node->kind) {
+  case ND_BLK:
+    for (Node *n = node->body; n; n = n->next) {
+      lowerStmt(n);
+    }
+    return 0;
+  case ND_IF: {
+    BasicBlock *then = newBlock();
+    BasicBlock *els = newBlock();
+    BasicBlock *end = newBlock();
+    lowerBr(node->cond, then, els);
+    startBlock(then);
+    lowerStmt(node->then);
+    lowerJmp(node, end);
+    startBlock(els);
+    if (node->els) {
+      lowerStmt(node->els);
+    }
+    startBlock(end);
+    return 0;
+  }
+  case ND_FOR: {
+    BasicBlock *begin = newBlock();
+    BasicBlock *body = newBlock();
+    BasicBlock *brk = bbForLabel(node->brk_label);
+    BasicBlock *cont = bbForLabel(node->cont_label);
+    if (node->pre) {
+      lowerStmt(node->pre);
+    }
+    startBlock(begin);
+    if (node->cond) {
+      lowerBr(node->cond, body, brk);
+    }
+    startBlock(body);
+    lowerStmt(node->body);
+    startBlock(cont);
+    if (node->post) {
+      lowerExpr(node->post);
+    }
+    lowerJmp(node, begin);
+    startBlock(brk);
+    return 0;
+  }
+  case ND_WHILE: {
+    BasicBlock *body = newBlock();
+    BasicBlock *brk = bbForLabel(node->brk_label);
+    BasicBlock *cont = bbForLabel(node->cont_label);
+    startBlock(cont);
+    if (node->cond) {
+      lowerBr(node->cond, body, brk);
+    }
+    startBlock(body);
+    lowerStmt(node->body);
+    lowerJmp(node, cont);
+    startBlock(brk);
+    return 0;
+  }
+  case ND_DO: {
+    BasicBlock *begin = newBlock();
+    BasicBlock *brk = bbForLabel(node->brk_label);
+    BasicBlock *cont = bbForLabel(node->cont_label);
+    startBlock(begin);
+    lowerStmt(node->then);
+    startBlock(cont);
+    lowerBr(node->cond, begin, brk);
+    startBlock(brk);
+    return 0;
+  }
+  case ND_GOTO:
+    lowerJmp(node, bbForLabel(node->unique_label));
+    return 0;
+  case ND_LABEL:
+    startBlock(bbForLabel(node->unique_label));
+    return lowerStmt(node->lhs);
+  case ND_RET: {
+    size_t val = node->lhs ? lowerExpr(node->lhs) : 0;
+    IRInst *inst = newInst(IR_RET, node);
+    inst->lhs = val;
+    return 0;
+  }
+  case ND_SWITCH: {
+    size_t c = lowerExpr(node->cond);
+    IRInst *inst = newInst(IR_SWITCH, node);
+    inst->lhs = c;
+    inst->ty = node->cond->ty;
+    for (Node *n = node->case_next; n; n = n->case_next) {
+      inst->case_cnt++;
+    }
+    inst->case_vals = arenaCalloc(&fn_arena, inst->case_cnt, sizeof(int64_t));
+    inst->case_bbs = arenaCalloc(&fn_arena, inst->case_cnt, sizeof(BasicBlock *));
+    size_t i = 0;
+    for (Node *n = node->case_next; n; n = n->case_next) {
+      inst->case_vals[i] = n->val;
+      inst->case_bbs[i++] = bbForLabel(n->label);
+    }
+    if (node->default_case) {
+      inst->els = bbForLabel(node->default_case->label);
+    } else {
+      inst->els = bbForLabel(node->brk_label);
+    }
+    lowerStmt(node->then);
+    startBlock(bbForLabel(node->brk_label));
+    return 0;
+  }
+  case ND_CASE:
+    startBlock(bbForLabel(node->label));
+    return lowerStmt(node->lhs);
+  default:
+    break;
+  }
+  return lowerExpr(node);
+}
+
+size_t lowerExpr(Node *node) {
+  switch (node->kind) {
+  case ND_NULL_EXPR:
+    return 0;
+  case ND_NUM: {
+    IRInst *inst = newInst(IR_IMM, node);
+    inst->dst = newVreg(isFloat(node->ty));
+    inst->ty = node->ty;
+    inst->imm = node->val;
+    inst->fval = node->fval;
+    return inst->dst;
+  }
+  case ND_VAR:
+    if (node->var->vreg) {
+      return node->var->vreg;
+    }
+    return lowerLoad(node, lowerAddr(node));
+  case ND_MEMBER:
+    return lowerLoad(node, lowerAddr(node));
+  case ND_DEREF:
+    return lowerLoad(node, lowerExpr(node->body));
+  case ND_ASS:
+    return lowerAssign(node);
+  case ND_STMT_EXPR: {
+    size_t val = 0;
+    for (Node *n = node->body; n; n = n->next) {
+      val = lowerStmt(n);
+    }
+    return val;
+  }
+  case ND_ADDR:
+    return lowerAddr(node->body);
+  case ND_COMMA:
+    lowerExpr(node->lhs);
+    return lowerExpr(node->rhs);
+  case ND_CAST:
+    return lowerCast(node, lowerExpr(node->lhs));
+  case ND_TERN: {
+    BasicBlock *then = newBlock();
+    BasicBlock *els = newBlock();
+    BasicBlock *end = newBlock();
+    size_t dst = 0;
+    if (node->ty->kind != TY_VOID) {
+      dst = newVreg(isFloat(node->ty));
+    }
+    lowerBr(node->cond, then, els);
+    startBlock(then);
+    size_t val = lowerExpr(node->then);
+    if (dst) {
+      IRInst *inst = newBinary(IR_MOV, node, val, 0);
+      inst->dst = dst;
+    }
+    lowerJmp(node, end);
+    startBlock(els);
+    val = lowerExpr(node->els);
+    if (dst) {
+      IRInst *inst = newBinary(IR_MOV, node, val, 0);
+      inst->dst = dst;
+    }
+    startBlock(end);
+    return dst;
+  }
+  case ND_NOT: {
+    size_t val = lowerExpr(node->lhs);
+    IRInst *inst = newBinary(IR_NOT, node, val, 0);
+    inst->dst = newVreg(false);
+    inst->ty = node->lhs->ty;
+    return inst->dst;
+  }
+  case ND_BITNOT: {
+    size_t val = lowerExpr(node->lhs);
+    IRInst *inst = newBinary(IR_BITNOT, node, val, 0);
+    inst->dst = newVreg(false);
+    inst->ty = node->ty;
+    return inst->dst;
+  }
+  case ND_LOGAND:
+  case ND_LOGOR: {
+    BasicBlock *rhs = newBlock();
+    BasicBlock *t = newBlock();
+    BasicBlock *f = newBlock();
+    BasicBlock *end = newBlock();
+    size_t dst = newVreg(false);
+    if (node->kind == ND_LOGAND) {
+      lowerBr(node->lhs, rhs, f);
+    } else {
+      lowerBr(node->lhs, t, rhs);
+    }
+    startBlock(rhs);
+    lowerBr(node->rhs, t, f);
+    startBlock(t);
+    IRInst *inst = newInst(IR_IMM, node);
+    inst->dst = dst;
+    inst->ty = ty_int;
+    inst->imm = 1;
+    lowerJmp(node, end);
+    startBlock(f);
+    inst = newInst(IR_IMM, node);
+    inst->dst = dst;
+    inst->ty = ty_int;
+    startBlock(end);
+    return dst;
+  }
+  case ND_FUNCCALL: {
+    size_t gp = 0;
+    size_t fp = 0;
+    size_t cnt = 0;
+    for (Node *arg = node->args; arg; arg = arg->next) {
+      if (isFloat(arg->ty)) {
+        fp++;
+      } else {
+        gp++;
+      }
+      cnt++;
+    }
+    if (gp > 6 || fp > 8) {
+      compErrorToken(node->tok->str, "too many arguments");
+    }
+    size_t *args = arenaCalloc(&fn_arena, cnt, sizeof(size_t));
+    lowerArgs(node->args, args, 0);
+    IRInst *inst = newInst(IR_CALL, node);
+    if (node->ty->kind != TY_VOID) {
+      inst->dst = newVreg(isFloat(node->ty));
+    }
+    inst->args = args;
+    inst->arg_cnt = cnt;
+    inst->ty = node->ty;
+    inst->func_ty = node->func_ty;
+    inst->funcname = node->funcname;
+    return inst->dst;
+  }
+  case ND_MEMZERO: {
+    if (node->var->vreg) {
+      IRInst *inst = newInst(IR_IMM, node);
+      inst->dst = node->var->vreg;
+      inst->ty = node->var->ty;
+      return 0;
+    }
+    IRInst *inst = newInst(IR_MEMZERO, node);
+    inst->var = node->var;
+    return 0;
+  }
+  default:
+    break;
+  }
+  return lowerBinary(node);
+}
+
+void lowerArgs(Node *arg, size_t *vregs, size_t idx) {
+  if (arg) {
+    lowerArgs(arg->next, vregs, idx + 1);
+    vregs[idx] = lowerExpr(arg);
+  }
+}
+
+// `A = A op B`, which is also what the parser makes of `A op= B`, reads A
+// through the address computed for the store. Adding, subtracting or
+// combining bits in an integer is done in place in memory instead, since
+// truncating the result to A's type leaves the same low bits either way.
+size_t lowerAssign(Node *node) {
+  Node *lhs = node->lhs;
+  if (lhs->kind == ND_VAR && lhs->var->vreg) {
+    size_t val = lowerExpr(node->rhs);
+    IRInst *inst = newInst(IR_MOV, node);
+    inst->dst = lhs->var->vreg;
+    inst->lhs = val;
+    inst->ty = node->ty;
+    return inst->dst;
+  }
+  Node *read = compoundRead(node);
+  if (!read) {
+    size_t addr = lowerAddr(lhs);
+    size_t val = lowerExpr(node->rhs);
+    IRInst *inst = newBinary(IR_STORE, node, addr, val);
+    inst->ty = node->ty;
+    return val;
+  }
+  Node *op = node->rhs->kind == ND_CAST ? node->rhs->lhs : node->rhs;
+  if (canRmw(node, op)) {
+    return lowerRmw(node, op);
+  }
+  size_t addr = lowerAddr(lhs);
+  size_t rhs = lowerExpr(op->rhs);
+  size_t val = lowerLoad(read, addr);
+  if (op->lhs != read) {
+    val = lowerCast(op->lhs, val);
+  }
+  val = newBinaryOp(op, val, rhs);
+  if (op != node->rhs) {
+    val = lowerCast(node->rhs, val);
+  }
+  IRInst *inst = newBinary(IR_STORE, node, addr, val);
+  inst->ty = node->ty;
+  return val;
+}
+
+// Finds the read of the left side in `A = A op B` or `A = (T)((U)A op B)`.
+Node *compoundRead(Node *node) {
+  Node *op = node->rhs->kind == ND_CAST ? node->rhs->lhs : node->rhs;
+  switch (op->kind) {
+  case ND_ADD:
+  case ND_SUB:
+  case ND_MUL:
+  case ND_DIV:
+  case ND_MOD:
+  case ND_BITAND:
+  case ND_BITOR:
+  case ND_BITXOR:
+  case ND_SHL:
+  case ND_SHR:
+    break;
+  default:
+    return NULL;
+  }
+  Node *read = op->lhs->kind == ND_CAST ? op->lhs->lhs : op->lhs;
+  return sameExpr(read, node->lhs) ? read : NULL;
+}
+
+// Whether two expressions compute the same value. The parser shares one node
+// between both sides of a compound assignment, but inlining copies each side
+// separately, so side-effect free trees are also compared node by node.
+bool sameExpr(Node *a, Node *b) {
+  if (a == b) {
+    return true;
+  }
+  if (a->kind != b->kind || a->ty->kind != b->ty->kind ||
+      a->ty->size != b->ty->size || a->ty->is_unsigned != b->ty->is_unsigned) {
+    return false;
+  }
+  switch (a->kind) {
+  case ND_NUM:
+    return a->val == b->val && !isFloat(a->ty);
+  case ND_VAR:
+    return a->var == b->var;
+  case ND_ADDR:
+  case ND_DEREF:
+    return sameExpr(a->body, b->body);
+  case ND_MEMBER:
+    return a->var == b->var && sameExpr(a->lhs, b->lhs);
+  case ND_CAST:
+    return sameExpr(a->lhs, b->lhs);
+  case ND_ADD:
+  case ND_SUB:
+  case ND_MUL:
+  case ND_SHL:
+  case ND_SHR:
+  case ND_BITAND:
+  case ND_BITOR:
+  case ND_BITXOR:
+    return sameExpr(a->lhs, b->lhs) && sameExpr(a->rhs, b->rhs);
+  default:
+    return false;
+  }
+}
+
+bool canRmw(Node *node, Node *op) {
+  Type *ty = node->lhs->ty;
+  if (ty->kind == TY_BOOL || (!isInteger(ty) && ty->kind != TY_PTR) ||
+      (!isInteger(op->ty) && op->ty->kind != TY_PTR)) {
+    return false;
+  }
+  return op->kind == ND_ADD || op->kind == ND_SUB || op->kind == ND_BITAND ||
+         op->kind == ND_BITOR || op->kind == ND_BITXOR;
+}
+
+// Variables are addressed directly, and constants that fit in an immediate
+// are not loaded into a register.
+size_t lowerRmw(Node *node, Node *op) {
+  Node *lhs = node->lhs;
+  size_t addr = 0;
+  if (lhs->kind != ND_VAR) {
+    addr = lowerAddr(lhs);
+  }
+  size_t val = 0;
+  if (op->rhs->kind != ND_NUM || op->rhs->val != (int32_t)op->rhs->val) {
+    val = lowerExpr(op->rhs);
+  }
+  IRInst *inst = newBinary(IR_RMW, node, addr, val);
+  inst->rmw_op = binaryOp(op);
+  inst->dst = newVreg(false);
+  inst->ty = lhs->ty;
+  if (!val) {
+    inst->imm = op->rhs->val;
+  }
+  if (lhs->kind == ND_VAR) {
+    inst->var = lhs->var;
+  }
+  return inst->dst;
+}
+
+size_t lowerCast(Node *node, size_t val) {
+  if (node->ty->kind == TY_VOID || castIsNop(node->lhs->ty, node->ty)) {
+    return val;
+  }
+  IRInst *inst = newInst(IR_CAST, node);
+  inst->dst = newVreg(isFloat(node->ty));
+  inst->lhs = val;
+  inst->ty = node->lhs->ty;
+  inst->to = node->ty;
+  return inst->dst;
+}
+
+size_t lowerBinary(Node *node) {
+  size_t rhs = lowerExpr(node->rhs);
+  size_t lhs = lowerExpr(node->lhs);
+  return newBinaryOp(node, lhs, rhs);
+}
+
+size_t newBinaryOp(Node *node, size_t lhs, size_t rhs) {
+  IROp op = binaryOp(node);
+  IRInst *inst = newBinary(op, node, lhs, rhs);
+  inst->ty = node->lhs->ty;
+  inst->to = node->ty;
+  bool is_cmp = op == IR_EQ || op == IR_NE || op == IR_LT || op == IR_LE;
+  inst->dst = newVreg(isFloat(node->lhs->ty) && !is_cmp);
+  return inst->dst;
+}
+
+IROp binaryOp(Node *node) {
+  IROp op = IR_ADD;
+  switch (node->kind) {
+  case ND_ADD:
+    op = IR_ADD;
+    break;
+  case ND_SUB:
+    op = IR_SUB;
+    break;
+  case ND_MUL:
+    op = IR_MUL;
+    break;
+  case ND_DIV:
+    op = IR_DIV;
+    break;
+  case ND_MOD:
+    op = IR_MOD;
+    break;
+  case ND_BITAND:
+    op = IR_BITAND;
+    break;
+  case ND_BITOR:
+    op = IR_BITOR;
+    break;
+  case ND_BITXOR:
+    op = IR_BITXOR;
+    break;
+  case ND_EQ:
+    op = IR_EQ;
+    break;
+  case ND_NE:
+    op = IR_NE;
+    break;
+  case ND_LT:
+    op = IR_LT;
+    break;
+  case ND_LE:
+    op = IR_LE;
+    break;
+  case ND_SHL:
+    op = IR_SHL;
+    break;
+  case ND_SHR:
+    op = IR_SHR;
+    break;
+  default:
+    compErrorToken(node->tok->str, "invalid expression");
+  }
+  return op;
+}
+
+size_t lowerLoad(Node *node, size_t addr) {
+  switch (node->ty->kind) {
+  case TY_ARR:
+  case TY_FUNC:
+  case TY_STRUCT:
+  case TY_UNION:
+    return addr;
+  default:
+    break;
+  }
+  IRInst *inst = newBinary(IR_LOAD, node, addr, 0);
+  inst->dst = newVreg(isFloat(node->ty));
+  inst->ty = node->ty;
+  return inst->dst;
+}
+
+size_t lowerAddr(Node *node) {
+  switch (node->kind) {
+  case ND_VAR: {
+    assert(!node->var->vreg);
+    IRInst *inst =
+        newInst(node->var->is_global ? IR_ADDR_GLOBAL : IR_ADDR_LOCAL, node);
+    inst->dst = newVreg(false);
+    inst->var = node->var;
+    return inst->dst;
+  }
+  case ND_DEREF:
+    return lowerExpr(node->body);
+  case ND_COMMA:
+    lowerExpr(node->lhs);
+    return lowerAddr(node->rhs);
+  case ND_MEMBER: {
+    size_t base = lowerAddr(node->lhs);
+    if (node->var->offset == 0) {
+      return base;
+    }
+    IRInst *inst = newBinary(IR_ADDI, node, base, 0);
+    inst->dst = newVreg(false);
+    inst->imm = (int64_t)node->var->offset;
+    return inst->dst;
+  }
+  default:
+    break;
+  }
+  compErrorToken(node->tok->str, "not an lvalue");
+  return 0;
+}
+
+void pruneUnreachable(IRFunc *ir) {
+  BasicBlock **stack = arenaCalloc(&fn_arena, ir->block_cnt, sizeof(BasicBlock *));
+  size_t depth = 0;
+  ir->blocks->is_reachable = true;
+  stack[depth++] = ir->blocks;
+  while (depth > 0) {
+    IRInst *inst = stack[--depth]->last;
+    if (!inst) {
+      continue;
+    }
+    size_t cnt = inst->op == IR_SWITCH ? inst->case_cnt : 0;
+    for (size_t i = 0; i <= cnt + 1; i++) {
+      BasicBlock *succ = NULL;
+      if (i < cnt) {
+        succ = inst->case_bbs[i];
+      } else if (i == cnt) {
+        succ = inst->then;
+      } else {
+        succ = inst->els;
+      }
+      if (succ && !succ->is_reachable) {
+        succ->is_reachable = true;
+        stack[depth++] = succ;
+      }
+    }
+  }
+
+  BasicBlock *cur = ir->blocks;
+  while (cur->next) {
+    if (cur->next->is_reachable) {
+      cur = cur->next;
+    } else {
+      cur->next = cur->next->next;
+    }
+  }
+}
+
+// Drops instructions whose results are never read, such as the value of a
+// postfix increment used as a statement, until none are left. Calls and
+// read-modify-writes still run, but no longer produce their results.
+void removeDeadInsts(IRFunc *ir) {
+  size_t *uses = arenaCalloc(&fn_arena, ir->vreg_cnt, sizeof(size_t));
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t v = 0; v < ir->vreg_cnt; v++) {
+      uses[v] = 0;
+    }
+    for (BasicBlock *bb = ir->blocks; bb; bb = bb->next) {
+      for (IRInst *inst = bb->insts; inst; inst = inst->next) {
+        uses[inst->lhs]++;
+        uses[inst->rhs]++;
+        for (size_t i = 0; i < inst->arg_cnt; i++) {
+          uses[inst->args[i]]++;
+        }
+      }
+    }
+    for (BasicBlock *bb = ir->blocks; bb; bb = bb->next) {
+      IRInst *prev = NULL;
+      for (IRInst *inst = bb->insts; inst; inst = inst->next) {
+        if (!inst->dst || uses[inst->dst]) {
+          prev = inst;
+        } else if (!isPureInst(inst)) {
+          inst->dst = 0;
+          prev = inst;
+        } else {
+          if (prev) {
+            prev->next = inst->next;
+          } else {
+            bb->insts = inst->next;
+          }
+          if (bb->last == inst) {
+            bb->last = prev;
+          }
+          changed = true;
+        }
+      }
+    }
+  }
+}
+
+bool isPureInst(IRInst *inst) {
+  switch (inst->op) {
+  case IR_CALL:
+  case IR_DIV:
+  case IR_MOD:
+  case IR_RMW:
+    return false;
+  default:
+    return true;
+  }
+}
+
+void dumpIR(void) {
+  for (Obj *fn = prog; fn; fn = fn->next) {
+    if (fn->body) {
+      fn->ir = lowerFunc(fn);
+      dumpFunc(fn);
+      fn->ir = NULL;
+      arenaReset(&fn_arena);
+    }
+  }
+}
+
+void dumpFunc(Obj *fn) {
+  IRFunc *ir = fn->ir;
+  fprintf(output, "function %s\n", fn->name);
+  for (size_t v = 1; v < ir->vreg_cnt; v++) {
+    if (ir->vreg_var[v]) {
+      fprintf(output, "  ; v%zu = %s\n", v, ir->vreg_var[v]->name);
+    }
+  }
+  for (BasicBlock *bb = ir->blocks; bb; bb = bb->next) {
+    fprintf(output, "bb%zu:\n", bb->id);
+    for (IRInst *inst = bb->insts; inst; inst = inst->next) {
+      dumpInst(inst);
+    }
+  }
+  fprintf(output, "\n");
+}
+
+void dumpInst(IRInst *inst) {
+  fprintf(output, "  ");
+  if (inst->dst) {
+    fprintf(output, "v%zu = ", inst->dst);
+  }
+  fprintf(output, "%s", op_names[inst->op]);
+  if (inst->op == IR_RMW) {
+    fprintf(output, ".%s", op_names[inst->rmw_op]);
+  }
+  if (inst->ty) {
+    fprintf(output, ".%s", typeName(inst->ty));
+  }
+  if (inst->to) {
+    fprintf(output, ".%s", typeName(inst->to));
+  }
+  switch (inst->op) {
+  case IR_IMM:
+    if (isFloat(inst->ty)) {
+      fprintf(output, " %g", inst->fval);
+    } else {
+      fprintf(output, " %ld", inst->imm);
+    }
+    break;
+  case IR_ADDI:
+    fprintf(output, " v%zu, %ld", inst->lhs, inst->imm);
+    break;
+  case IR_ADDR_GLOBAL:
+  case IR_ADDR_LOCAL:
+  case IR_MEMZERO:
+    fprintf(output, " %s", inst->var->name);
+    break;
+  case IR_CALL:
+    fprintf(output, " %s(", inst->funcname);
+    for (size_t i = 0; i < inst->arg_cnt; i++) {
+      fprintf(output, "%sv%zu", i ? ", " : "", inst->args[i]);
+    }
+    fprintf(output, ")");
+    break;
+  case IR_JMP:
+    fprintf(output, " bb%zu", inst->then->id);
+    break;
+  case IR_BR:
+    fprintf(output, " v%zu, bb%zu, bb%zu", inst->lhs, inst->then->id,
+            inst->els->id);
+    break;
+  case IR_SWITCH:
+    fprintf(output, " v%zu", inst->lhs);
+    for (size_t i = 0; i < inst->case_cnt; i++) {
+      fprintf(output, ", %ld: bb%zu", inst->case_vals[i],
+              inst->case_bbs[i]->id);
+    }
+    fprintf(output, ", default: bb%zu", inst->els->id);
+    break;
+  case IR_STORE:
+    fprintf(output, " [v%zu], v%zu", inst->lhs, inst->rhs);
+    break;
+  case IR_LOAD:
+    fprintf(output, " [v%zu]", inst->lhs);
+    break;
+  case IR_RMW:
+    if (inst->var) {
+      fprintf(output, " %s", inst->var->name);
+    } else {
+      fprintf(output, " [v%zu]", inst->lhs);
+    }
+    if (inst->rhs) {
+      fprintf(output, ", v%zu", inst->rhs);
+    } else {
+      fprintf(output, ", %ld", inst->imm);
+    }
+    break;
+  default:
+    if (inst->lhs) {
+      fprintf(output, " v%zu", inst->lhs);
+    }
+    if (inst->rhs) {
+      fprintf(output, ", v%zu", inst->rhs);
+    }
+    break;
+  }
+  fprintf(output, "\n");
+}
+
+const char *typeName(Type *ty) {
+  switch (ty->kind) {
+  case TY_BOOL:
+    return "bool";
+  case TY_CHAR:
+    return ty->is_unsigned ? "u8" : "i8";
+  case TY_SHORT:
+    return ty->is_unsigned ? "u16" : "i16";
+  case TY_INT:
+  case TY_ENUM:
+    return ty->is_unsigned ? "u32" : "i32";
+  case TY_LONG:
+    return ty->is_unsigned ? "u64" : "i64";
+  case TY_FLOAT:
+    return "f32";
+  case TY_DOUBLE:
+    return "f64";
+  case TY_PTR:
+    return "ptr";
+  case TY_ARR:
+    return "arr";
+  case TY_STRUCT:
+    return "struct";
+  case TY_UNION:
+    return "union";
+  case TY_FUNC:
+    return "func";
+  case TY_VOID:
+    return "void";
+  }
+  return "?";
+}
@@ -0,0 +1,14 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdbool.h>
+
+typedef struct IRFunc IRFunc;
+typedef struct IRInst IRInst;
+typedef struct Obj Obj;
+
+IRFunc *lowerFunc(Obj *fn);
+bool isTerminator(IRInst *inst);
+void dumpIR(void);
+
+#endif // IR_H
@@ -4,56 +4,158 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "arena.h"
+#include "asm.h"
 #include "codegen.h"
 #include "comp_err.h"
+#include "fold.h"
+#include "inline.h"
+#include "ir.h"
 #include "parse.h"
+#include "peephole.h"
+#include "preprocess.h"
 #include "tokenise.h"
 
 static char output_file_path[PATH_MAX] = {0};
-static bool do_cc1 = false;
+static char trace_file_path[PATH_MAX] = {0};
 static bool do_argprint = false;
+static bool do_emit_ir = false;
+static bool do_mem_stats = false;
+static bool do_time_report = false;
+static bool do_time_trace = false;
+static bool do_inline = true;
 static bool do_assemble = true;
 static bool do_link = true;
+static bool do_integrated_as = false;
+static bool do_peephole_stats = false;
+static char **input_paths = NULL;
+static int input_cnt = 0;
+static int jobs = 1;
 char *input_file_path = NULL;
 FILE *output = NULL;
+int assembler_pid = 0;
+bool do_emit_stats = false;
+int gen_jobs = 1;
+bool do_omit_frame_pointer = false;
+extern size_t tokens_lexed;
+extern size_t nodes_allocated;
+extern size_t types_allocated;
+extern size_t objs_allocated;
+extern size_t scope_lookups;
+extern size_t scope_steps;
+extern size_t calls_inlined;
+extern size_t insts_emitted;
+extern size_t frame_bytes;
+extern size_t frame_bytes_saved;
 
-static char *createTmpfile(void);
-static void assemble(char *input_path, char *output_path);
+enum {
+  STAGE_TOKENISE,
+  STAGE_PARSE,
+  STAGE_FOLD,
+  STAGE_INLINE,
+  STAGE_GEN,
+  STAGE_AS,
+  STAGE_LINK,
+  STAGE_CNT
+};
+static const char *stage_names[STAGE_CNT] = {
+    "tokenise", "parse", "fold", "inline", "gen", "as", "link"};
+static long start_ns = 0;
+static long stage_begin_ns[STAGE_CNT] = {0};
+static long stage_begin_cpu_ns[STAGE_CNT] = {0};
+static long stage_ns[STAGE_CNT] = {0};
+static long stage_cpu_ns[STAGE_CNT] = {0};
+static long stage_rss_kib[STAGE_CNT] = {0};
+
+static int compileFiles(void);
+static int parseJobs(const char *arg);
+static int startWorker(int idx, FILE **log);
+static long cpuNs(void);
+static long maxRssKib(void);
+static long nowNs(void);
+static void beginStage(int stage);
 static void cc1(void);
 static void cleanUp(void);
+static void compileFile(void);
+static void defaultOutputPath(void);
+static void defineCmdMacro(char *def);
+static void endStage(int stage);
 static void openOutput(void);
 static void parseArgs(int argc, char *argv[]);
-static void preprocess(char *input_path, char *output_path);
+static void printArgs(char **argv);
+static void printCounters(void);
+static void printStageTimes(void);
 static void replaceExt(char (*path)[PATH_MAX], char *ext);
+static void replayLog(FILE *log);
 static void runSubprocess(char **argv);
-static void runcc1(char *arg0, char *input, char *output);
+static void startAssembler(char *output_path);
 static void usage(void);
+static void waitChild(int pid);
+static void writeTrace(void);
 static void dolink(char **argv);
 
 void usage(void) {
   // clang-format off
-  puts("Usage: ucc [options] file\n"
+  puts("Usage: ucc [options] file...\n"
        "Options:\n"
        "\t-c              Compile and assemble, but do not link. Outputs an object file.\n"
        "\t-S              Compile only, do not assemble. Outputs assembly code.\n"
+       "\t-j <n>          Compile up to <n> files at once.\n"
+       "\t-I <dir>        Add <dir> to the directories searched for included files.\n"
+       "\t-D <name>[=val] Define the macro <name> as <val>, or as 1 if no value is given.\n"
+       "\t--emit-ir       Compile only, do not generate code. Outputs the intermediate representation.\n"
+       "\t--mem-stats     Print the compiler's memory usage per arena to stderr.\n"
+       "\t--ftime-report  Print the wall-clock and CPU time of each stage, and counts of what\n"
+       "\t                each stage produced, to stderr. --time-stages is an alias.\n"
+       "\t--ftime-trace[=<file>] Write the stage times as Chrome trace JSON to <file>, or by\n"
+       "\t                default to the output file with its extension replaced by '.json'.\n"
+       "\t--integrated-as Assemble with the built-in assembler instead of running 'as'.\n"
+       "\t--emit-stats    Print the bytes of assembly emitted for each function to stderr.\n"
+       "\t--peephole-stats Print how often each peephole rule was applied to stderr.\n"
+       "\t--fno-inline    Do not inline calls to small or single-call static functions.\n"
+       "\t--fomit-frame-pointer Address locals from rsp and allocate rbp as a register,\n"
+       "\t                except in variadic functions.\n"
+       "\t--codegen-jobs <n> Generate code for up to <n> runs of each file's functions at once.\n"
        "\t-o <file>       Optional. If unspecified the default output filename: '<input-file-stem>.<ext>'\n" \
        "\t                will be used. If '-' is passed as <file>, then the output will be written\n" \
        "\t                to stdout (only applicable if -S is also applied).");
   // clang-format on
 }
 
+int parseJobs(const char *arg) {
+  const int n = (int)strtoul(arg, NULL, 10);
+  if (n < 1) {
+    fprintf(stderr, "invalid job count: '%s'\n", arg);
+    exit(EXIT_FAILURE);
+  }
+  return n;
+}
+
 void parseArgs(int argc, char *argv[]) {
   int opt = 0;
   struct option longopts[] = {{"help", no_argument, NULL, 'h'},
                               {"output", required_argument, NULL, 'o'},
-                              {"cc1", no_argument, NULL, 0},
                               {"###", no_argument, NULL, 1},
+                              {"emit-ir", no_argument, NULL, 2},
+                              {"mem-stats", no_argument, NULL, 3},
+                              {"time-stages", no_argument, NULL, 4},
+                              {"ftime-report", no_argument, NULL, 4},
+                              {"integrated-as", no_argument, NULL, 5},
+                              {"emit-stats", no_argument, NULL, 6},
+                              {"peephole-stats", no_argument, NULL, 7},
+                              {"ftime-trace", optional_argument, NULL, 8},
+                              {"fno-inline", no_argument, NULL, 9},
+                              {"fomit-frame-pointer", no_argument, NULL, 10},
+                              {"codegen-jobs", required_argument, NULL, 11},
                               {"", no_argument, NULL, 'S'},
                               {0, 0, 0, 0}};
-  while ((opt = getopt_long(argc, argv, "hcSo:", longopts, NULL)) != -1) {
+  while ((opt = getopt_long(argc, argv, "hcSo:I:D:j:", longopts, NULL)) !=
+         -1) {
     switch (opt) {
     case 'h':
       usage();
@@ -62,18 +164,61 @@ void parseArgs(int argc, char *argv[]) {
       strncpy(output_file_path, optarg, sizeof(output_file_path));
       output_file_path[sizeof(output_file_path) - 1] = '\0';
       break;
-    case 0:
-      do_cc1 = true;
-      break;
     case 1:
       do_argprint = true;
       break;
+    case 2:
+      do_emit_ir = true;
+      do_assemble = false;
+      do_link = false;
+      break;
+    case 3:
+      do_mem_stats = true;
+      break;
+    case 4:
+      do_time_report = true;
+      break;
+    case 5:
+      do_integrated_as = true;
+      break;
+    case 6:
+      do_emit_stats = true;
+      break;
+    case 7:
+      do_peephole_stats = true;
+      break;
+    case 8:
+      do_time_trace = true;
+      if (optarg) {
+        strncpy(trace_file_path, optarg, sizeof(trace_file_path));
+        trace_file_path[sizeof(trace_file_path) - 1] = '\0';
+      }
+      break;
+    case 9:
+      do_inline = false;
+      break;
+    case 10:
+      do_omit_frame_pointer = true;
+      break;
+    case 11:
+      gen_jobs = parseJobs(optarg);
+      break;
     case 'S':
       do_assemble = false;
+      do_link = false;
       break;
     case 'c':
       do_link = false;
       break;
+    case 'I':
+      addIncludePath(optarg);
+      break;
+    case 'D':
+      defineCmdMacro(optarg);
+      break;
+    case 'j':
+      jobs = parseJobs(optarg);
+      break;
     case '?':
     case ':':
     default:
@@ -86,14 +231,40 @@ void parseArgs(int argc, char *argv[]) {
     usage();
     exit(EXIT_FAILURE);
   }
-  input_file_path = argv[optind];
+  input_paths = &argv[optind];
+  input_cnt = argc - optind;
+  input_file_path = input_paths[0];
+  if (input_cnt > 1 && output_file_path[0] && !do_link) {
+    fprintf(stderr, "cannot specify -o with multiple files\n");
+    exit(EXIT_FAILURE);
+  }
+  if (input_cnt > 1 && trace_file_path[0] && !do_link) {
+    fprintf(stderr, "cannot specify a trace file with multiple files\n");
+    exit(EXIT_FAILURE);
+  }
   if (output_file_path[0] == 0) {
-    strncpy(output_file_path, input_file_path, PATH_MAX);
-    if (do_assemble) {
-      replaceExt(&output_file_path, "o");
-    } else {
-      replaceExt(&output_file_path, "s");
-    }
+    defaultOutputPath();
+  }
+}
+
+void defaultOutputPath(void) {
+  strncpy(output_file_path, input_file_path, PATH_MAX);
+  output_file_path[PATH_MAX - 1] = '\0';
+  if (do_emit_ir) {
+    replaceExt(&output_file_path, "ir");
+  } else if (do_assemble) {
+    replaceExt(&output_file_path, "o");
+  } else {
+    replaceExt(&output_file_path, "s");
+  }
+}
+
+void defineCmdMacro(char *def) {
+  char *eq = strchr(def, '=');
+  if (eq) {
+    defineMacro(strndup(def, eq - def), eq + 1);
+  } else {
+    defineMacro(def, "1");
   }
 }
 
@@ -103,25 +274,160 @@ void cleanUp(void) {
   }
 }
 
+// Preprocessing happens as the tokens are read, so it is timed as part of
+// tokenising.
 void cc1(void) {
+  beginStage(STAGE_TOKENISE);
   tokenise(input_file_path);
+  endStage(STAGE_TOKENISE);
+  beginStage(STAGE_PARSE);
   parse();
-  gen();
+  endStage(STAGE_PARSE);
+  beginStage(STAGE_FOLD);
+  fold();
+  endStage(STAGE_FOLD);
+  if (do_inline) {
+    beginStage(STAGE_INLINE);
+    inlineCalls();
+    endStage(STAGE_INLINE);
+  }
+  beginStage(STAGE_GEN);
+  if (do_emit_ir) {
+    dumpIR();
+  } else {
+    gen();
+  }
+  endStage(STAGE_GEN);
+}
+
+long nowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// The CPU time of this process and of every child it has waited for, so that
+// a stage is charged for the subprocesses it runs.
+long cpuNs(void) {
+  struct timespec ts;
+  struct rusage ru;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  getrusage(RUSAGE_CHILDREN, &ru);
+  return ts.tv_sec * 1000000000 + ts.tv_nsec +
+         (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000 +
+         (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000;
+}
+
+// The high-water mark of the resident set of this process or of any child it
+// has waited for, in KiB.
+long maxRssKib(void) {
+  struct rusage self;
+  struct rusage children;
+  getrusage(RUSAGE_SELF, &self);
+  getrusage(RUSAGE_CHILDREN, &children);
+  return self.ru_maxrss > children.ru_maxrss ? self.ru_maxrss
+                                             : children.ru_maxrss;
+}
+
+void beginStage(int stage) {
+  stage_begin_ns[stage] = nowNs();
+  stage_begin_cpu_ns[stage] = cpuNs();
+}
+
+void endStage(int stage) {
+  stage_ns[stage] += nowNs() - stage_begin_ns[stage];
+  stage_cpu_ns[stage] += cpuNs() - stage_begin_cpu_ns[stage];
+  stage_rss_kib[stage] = maxRssKib();
 }
 
-void runcc1(char *arg0, char *input, char *output) {
-  char **args = calloc(6, sizeof(char *));
-  args[0] = arg0;
-  int argc = 1;
-  args[argc++] = "--cc1";
-  if (input) {
-    args[argc++] = input;
+// The assembler runs alongside code generation, so its time is only what is
+// left after the last of the assembly has been written. The peak RSS is a
+// high-water mark, so a stage's figure is the most used by the end of it.
+void printStageTimes(void) {
+  long total = 0;
+  long total_cpu = 0;
+  long peak = 0;
+  fprintf(stderr, "stage       wall (ms)   cpu (ms)  peak rss (KiB)\n");
+  for (int i = 0; i < STAGE_CNT; i++) {
+    if (!stage_begin_ns[i]) {
+      continue;
+    }
+    total += stage_ns[i];
+    total_cpu += stage_cpu_ns[i];
+    fprintf(stderr, "%-10s %6ld.%03ld", stage_names[i], stage_ns[i] / 1000000,
+            stage_ns[i] / 1000 % 1000);
+    fprintf(stderr, " %6ld.%03ld %15ld\n", stage_cpu_ns[i] / 1000000,
+            stage_cpu_ns[i] / 1000 % 1000, stage_rss_kib[i]);
+    peak = stage_rss_kib[i] > peak ? stage_rss_kib[i] : peak;
   }
-  if (output) {
-    args[argc++] = "-o";
-    args[argc++] = output;
+  fprintf(stderr, "%-10s %6ld.%03ld", "total", total / 1000000,
+          total / 1000 % 1000);
+  fprintf(stderr, " %6ld.%03ld %15ld\n", total_cpu / 1000000,
+          total_cpu / 1000 % 1000, peak);
+}
+
+void printCounters(void) {
+  fprintf(stderr, "%-24s %10zu\n", "tokens lexed", tokens_lexed);
+  fprintf(stderr, "%-24s %10zu\n", "nodes allocated", nodes_allocated);
+  fprintf(stderr, "%-24s %10zu\n", "types allocated", types_allocated);
+  fprintf(stderr, "%-24s %10zu\n", "objs allocated", objs_allocated);
+  fprintf(stderr, "%-24s %10zu\n", "scope lookups", scope_lookups);
+  const size_t avg = scope_lookups ? scope_steps * 100 / scope_lookups : 0;
+  fprintf(stderr, "%-24s %7zu.%02zu\n", "scopes per lookup", avg / 100,
+          avg % 100);
+  fprintf(stderr, "%-24s %10zu\n", "calls inlined", calls_inlined);
+  fprintf(stderr, "%-24s %10zu\n", "instructions emitted", insts_emitted);
+  fprintf(stderr, "%-24s %10zu\n", "frame bytes for locals", frame_bytes);
+  fprintf(stderr, "%-24s %10zu\n", "frame bytes saved", frame_bytes_saved);
+}
+
+// Writes the stages as complete ("X") events and the counters as one counter
+// ("C") event, in the Trace Event Format read by chrome://tracing and
+// Perfetto. Times are in microseconds from the start of the process.
+void writeTrace(void) {
+  if (!trace_file_path[0]) {
+    strncpy(trace_file_path,
+            strcmp(output_file_path, "-") ? output_file_path : input_file_path,
+            PATH_MAX);
+    trace_file_path[PATH_MAX - 1] = '\0';
+    replaceExt(&trace_file_path, "json");
   }
-  runSubprocess(args);
+  FILE *fp = fopen(trace_file_path, "w");
+  if (!fp) {
+    fprintf(stderr, "failed to open trace file: '%s'\n", trace_file_path);
+    exit(EXIT_FAILURE);
+  }
+  const int pid = getpid();
+  fprintf(fp, "{\"traceEvents\": [\n");
+  fprintf(fp, "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, ",
+          pid);
+  fprintf(fp, "\"tid\": 0, \"args\": {\"name\": \"ucc %s\"}},\n",
+          input_file_path);
+  for (int i = 0; i < STAGE_CNT; i++) {
+    if (!stage_begin_ns[i]) {
+      continue;
+    }
+    fprintf(fp, "  {\"name\": \"%s\", \"cat\": \"stage\", \"ph\": \"X\", ",
+            stage_names[i]);
+    fprintf(fp, "\"pid\": %d, \"tid\": 0, \"ts\": %ld, \"dur\": %ld, ", pid,
+            (stage_begin_ns[i] - start_ns) / 1000, stage_ns[i] / 1000);
+    fprintf(fp, "\"args\": {\"cpu_us\": %ld, \"peak_rss_kib\": %ld}},\n",
+            stage_cpu_ns[i] / 1000, stage_rss_kib[i]);
+  }
+  fprintf(fp, "  {\"name\": \"counters\", \"ph\": \"C\", \"pid\": %d, ", pid);
+  fprintf(fp, "\"tid\": 0, \"ts\": %ld, \"args\": {",
+          (nowNs() - start_ns) / 1000);
+  fprintf(fp, "\"tokens\": %zu, \"nodes\": %zu, \"types\": %zu, ",
+          tokens_lexed, nodes_allocated, types_allocated);
+  fprintf(fp, "\"objs\": %zu, \"scope_lookups\": %zu, ", objs_allocated,
+          scope_lookups);
+  fprintf(fp, "\"scope_steps\": %zu, \"calls_inlined\": %zu, ", scope_steps,
+          calls_inlined);
+  fprintf(fp, "\"instructions\": %zu, \"frame_bytes\": %zu, ", insts_emitted,
+          frame_bytes);
+  fprintf(fp, "\"frame_bytes_saved\": %zu}}\n", frame_bytes_saved);
+  fprintf(fp, "], \"displayTimeUnit\": \"ms\"}\n");
+  fclose(fp);
 }
 
 void replaceExt(char (*path)[PATH_MAX], char *ext) {
@@ -134,36 +440,32 @@ void replaceExt(char (*path)[PATH_MAX], char *ext) {
   strncat(*path, ext, PATH_MAX - (p - *path));
 }
 
-char *createTmpfile(void) {
-  char *path = strdup("/tmp/ucc-XXXXXX");
-  int fd = mkstemp(path);
-  if (fd == -1) {
-    compError("mkstemp failed: %s", strerror(errno));
+void printArgs(char **argv) {
+  size_t idx = 0;
+  printf("args = [ ");
+  for (const char *arg = argv[idx]; arg; arg = argv[++idx]) {
+    printf("%s%s", arg, argv[idx + 1] ? ", " : "");
   }
-  close(fd);
-  return path;
+  puts(" ]");
 }
 
 void runSubprocess(char **argv) {
   if (do_argprint) {
-    size_t idx = 0;
-    printf("args = [ ");
-    for (const char *arg = argv[idx]; arg; arg = argv[++idx]) {
-      printf("%s%s", arg, argv[idx + 1] ? ", " : "");
-    }
-    puts(" ]");
+    printArgs(argv);
     exit(EXIT_SUCCESS);
   }
-  if (fork() == 0) {
+  int pid = fork();
+  if (pid == 0) {
     execvp(argv[0], argv);
-    compError("exec failed: %s: %s", argv[0], strerror(errno));
+    fprintf(stderr, "exec failed: %s: %s\n", argv[0], strerror(errno));
     exit(EXIT_FAILURE);
   }
+  waitChild(pid);
+}
+
+void waitChild(int pid) {
   int status = 0;
-  // clang-format off
-  while (wait(&status) > 0);
-  // clang-format on
-  if (status != 0) {
+  if (waitpid(pid, &status, 0) == -1 || status != 0) {
     exit(EXIT_FAILURE);
   }
 }
@@ -180,48 +482,189 @@ void openOutput(void) {
   }
 }
 
-void assemble(char *input_path, char *output_path) {
-  char *cmd[] = {"as", "-c", input_path, "-o", output_path, NULL};
-  runSubprocess(cmd);
-}
-
-void preprocess(char *input_path, char *output_path) {
-  char *cmd[] = {"cpp", "-E", "-P", "-C", input_path, output_path, NULL};
-  runSubprocess(cmd);
+// The generated code is streamed to the assembler through a pipe as it is
+// written, rather than going through a temporary file.
+void startAssembler(char *output_path) {
+  char *cmd[] = {"as", "-c", "-o", output_path, NULL};
+  if (do_argprint) {
+    printArgs(cmd);
+    exit(EXIT_SUCCESS);
+  }
+  int fds[2] = {0};
+  if (pipe(fds) == -1) {
+    fprintf(stderr, "pipe failed: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  assembler_pid = fork();
+  if (assembler_pid == 0) {
+    dup2(fds[0], STDIN_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    execvp(cmd[0], cmd);
+    fprintf(stderr, "exec failed: %s: %s\n", cmd[0], strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  close(fds[0]);
+  output = fdopen(fds[1], "w");
+  if (!output) {
+    fprintf(stderr, "fdopen failed: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
 }
 
+// The driver's own long options and -j mean nothing to cc, so they are
+// dropped from the command line that is passed on.
 void dolink(char **argv) {
   char **cmd = argv;
-  cmd[0] = "cc";
+  size_t cnt = 0;
+  cmd[cnt++] = "cc";
+  for (size_t i = 1; argv[i]; i++) {
+    if (!strcmp(argv[i], "-j")) {
+      i++;
+    } else if (strncmp(argv[i], "--", 2) && strncmp(argv[i], "-j", 2)) {
+      cmd[cnt++] = argv[i];
+    }
+  }
+  cmd[cnt] = NULL;
   runSubprocess(cmd);
 }
 
-int main(int argc, char *argv[]) {
-  parseArgs(argc, argv);
-
-  if (do_cc1) {
-    openOutput();
-    cc1();
-    return EXIT_SUCCESS;
+// Each file is compiled by a worker process of its own, with at most `jobs`
+// running at once. A worker's diagnostics are captured and replayed in input
+// order once it and every file before it have finished, so the output reads
+// as if the files had been compiled one after another.
+int compileFiles(void) {
+  int *pids = calloc(input_cnt, sizeof(int));
+  FILE **logs = calloc(input_cnt, sizeof(FILE *));
+  bool *done = calloc(input_cnt, sizeof(bool));
+  bool failed = false;
+  int next = 0;
+  int running = 0;
+  int reported = 0;
+  long start = nowNs();
+  while (reported < input_cnt) {
+    for (; running < jobs && next < input_cnt; next++, running++) {
+      pids[next] = startWorker(next, &logs[next]);
+    }
+    int status = 0;
+    int pid = wait(&status);
+    if (pid == -1) {
+      fprintf(stderr, "wait failed: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < next; i++) {
+      if (pids[i] == pid) {
+        done[i] = true;
+        failed = failed || status != 0;
+        running--;
+      }
+    }
+    for (; reported < next && done[reported]; reported++) {
+      replayLog(logs[reported]);
+    }
   }
+  if (do_time_report) {
+    long ns = nowNs() - start;
+    fprintf(stderr, "%d files in %ld.%03ld ms with %d jobs: ", input_cnt,
+            ns / 1000000, ns / 1000 % 1000, jobs);
+    fprintf(stderr, "%ld files/s\n",
+            ns ? (long)input_cnt * 1000000000 / ns : 0);
+  }
+  free(pids);
+  free(logs);
+  free(done);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
 
-  if (do_link) {
-    dolink(argv);
-    return EXIT_SUCCESS;
+int startWorker(int idx, FILE **log) {
+  *log = tmpfile();
+  if (!*log) {
+    fprintf(stderr, "tmpfile failed: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  fflush(stdout);
+  fflush(stderr);
+  int pid = fork();
+  if (pid == -1) {
+    fprintf(stderr, "fork failed: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    dup2(fileno(*log), STDERR_FILENO);
+    input_file_path = input_paths[idx];
+    defaultOutputPath();
+    compileFile();
+    exit(EXIT_SUCCESS);
   }
+  return pid;
+}
 
-  char *compiler_input = createTmpfile();
-  preprocess(input_file_path, compiler_input);
+void replayLog(FILE *log) {
+  char buf[4096];
+  size_t len = 0;
+  fseek(log, 0, SEEK_SET);
+  while ((len = fread(buf, 1, sizeof(buf), log)) > 0) {
+    fwrite(buf, 1, len, stderr);
+  }
+  fclose(log);
+}
 
-  if (do_assemble) {
-    char *compiler_output = createTmpfile();
-    runcc1(argv[0], compiler_input, compiler_output);
-    assemble(compiler_output, output_file_path);
+void compileFile(void) {
+  char *asm_buf = NULL;
+  size_t asm_len = 0;
+  if (do_assemble && do_integrated_as) {
+    output = open_memstream(&asm_buf, &asm_len);
+  } else if (do_assemble) {
+    startAssembler(output_file_path);
   } else {
-    runcc1(argv[0], compiler_input, output_file_path);
+    openOutput();
   }
-
+  cc1();
   cleanUp();
 
+  if (asm_buf) {
+    beginStage(STAGE_AS);
+    assemble(asm_buf, asm_len, output_file_path);
+    free(asm_buf);
+    endStage(STAGE_AS);
+  }
+  if (assembler_pid) {
+    beginStage(STAGE_AS);
+    waitChild(assembler_pid);
+    assembler_pid = 0;
+    endStage(STAGE_AS);
+  }
+  if (do_mem_stats) {
+    printMemStats();
+  }
+  if (do_peephole_stats) {
+    printPeepholeStats();
+  }
+  if (do_time_report) {
+    printStageTimes();
+    printCounters();
+  }
+  if (do_time_trace) {
+    writeTrace();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  start_ns = nowNs();
+  parseArgs(argc, argv);
+
+  if (do_link) {
+    beginStage(STAGE_LINK);
+    dolink(argv);
+    endStage(STAGE_LINK);
+    if (do_time_report) {
+      printStageTimes();
+    }
+    return EXIT_SUCCESS;
+  }
+  if (input_cnt > 1) {
+    return compileFiles();
+  }
+  compileFile();
   return EXIT_SUCCESS;
 }
@@ -6,15 +6,19 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "comp_err.h"
 #include "defs.h"
+#include "hashmap.h"
 #include "tokenise.h"
 
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
 
+extern Arena ast_arena;
 extern Type *ty_int;
 extern Token *token;
 static Obj *cur_fn = NULL;
+static size_t scope_clock = 0;
 static Obj *fn_decls = NULL;
 static Scope *scopes = &(Scope){0};
 static Node *gotos = NULL;
@@ -24,6 +28,11 @@ static char *cur_cont_label = NULL;
 static Node *cur_switch = NULL;
 Obj *prog = NULL;
 Obj *globals = NULL;
+size_t nodes_allocated = 0;
+size_t types_allocated = 0;
+size_t objs_allocated = 0;
+size_t scope_lookups = 0;
+size_t scope_steps = 0;
 Type *ty_char = &(Type){.kind = TY_CHAR, .size = 1, .align = 1};
 Type *ty_bool = &(Type){.kind = TY_BOOL, .size = 1, .align = 1};
 Type *ty_int = &(Type){.kind = TY_INT, .size = 4, .align = 4};
@@ -125,15 +134,15 @@ static Type *typeSuffix(Type *ty);
 static Type *typename(void);
 static Type *unionDecl(Type *ty);
 static VarScope *findVarScope(Token *tok);
+static VarScope *pushScope(const char *name, Obj *var, Type *type_def);
 static bool atInitialiserListEnd(void);
 static bool consumeInitialiserListEnd(void);
-static bool equal(Token *tok, const char *str);
+static bool initCoversAll(Initialiser *init, Type *ty);
 static bool isFunc(void);
+static bool isPure(Node *node);
+static bool isReadOnly(Type *ty, Type *basety, VarAttr *attr);
 static bool isTypename(Token *tok);
-static char *newUniqueLabel(void);
-static double evalDouble(Node *node);
 static int64_t constExpr(void);
-static int64_t eval(Node *node);
 static int64_t eval2(Node *node, char **label);
 static int64_t evalRval(Node *node, char **label);
 static size_t countInitialserElems(Type *ty);
@@ -148,7 +157,6 @@ static void globalVarInitialiser(Obj *var);
 static void initialiser2(Initialiser *init);
 static void newParam(Type *ty, Token *ident);
 static void parseTypedef(Type *basety);
-static void pushScope(char *name, Obj *var, Type *type_def);
 static void pushTagScope(Token *tok, Type *ty);
 static void resolveGotoLabels(void);
 static void skipExcessInitialiserElems(void);
@@ -299,8 +307,14 @@ Node *stmt(void) {
   return node;
 }
 
+Obj *newObj(void) {
+  objs_allocated++;
+  return arenaCalloc(&ast_arena, 1, sizeof(Obj));
+}
+
 Node *newNode(NodeKind kind) {
-  Node *node = calloc(1, sizeof(Node));
+  nodes_allocated++;
+  Node *node = arenaCalloc(&ast_arena, 1, sizeof(Node));
   node->kind = kind;
   node->tok = token;
   return node;
@@ -308,7 +322,7 @@ Node *newNode(NodeKind kind) {
 
 Node *newNodeGoto(Token *label) {
   Node *node = newNode(ND_GOTO);
-  node->label = strndup(label->str, label->len);
+  node->label = arenaStrndup(&ast_arena, label->str, label->len);
   node->goto_next = gotos;
   gotos = node;
   return node;
@@ -316,7 +330,7 @@ Node *newNodeGoto(Token *label) {
 
 Node *newNodeLabel(Token *label) {
   Node *node = newNode(ND_LABEL);
-  node->label = strndup(label->str, label->len);
+  node->label = arenaStrndup(&ast_arena, label->str, label->len);
   node->unique_label = newUniqueLabel();
   node->lhs = stmt();
   node->goto_next = labels;
@@ -415,35 +429,37 @@ Type *typeSuffix(Type *ty) {
 }
 
 Obj *newVar(Type *ty, Token *ident, Obj **vars) {
-  Obj *var = calloc(1, sizeof(Obj));
+  Obj *var = newObj();
   var->next = *vars;
   if (ident) {
-    var->name = strndup(ident->str, ident->len);
+    var->name = arenaStrndup(&ast_arena, ident->str, ident->len);
   }
   var->ty = ty;
   var->align = ty->align;
   *vars = var;
-  pushScope(var->name, var, NULL);
+  if (ident) {
+    pushScope(ident->name, var, NULL);
+  }
   return var;
 }
 
 Obj *newGlobalVar(Type *ty, Token *ident) {
-  Obj *var = calloc(1, sizeof(Obj));
+  Obj *var = newObj();
   var->next = globals;
-  var->name = strndup(ident->str, ident->len);
+  var->name = arenaStrndup(&ast_arena, ident->str, ident->len);
   var->ty = ty;
   var->align = ty->align;
   var->is_static = true;
   var->is_global = true;
   var->is_definition = true;
   globals = var;
-  pushScope(var->name, var, NULL);
+  pushScope(ident->name, var, NULL);
   return var;
 }
 
 char *newUniqueLabel(void) {
   static size_t id = 0;
-  char *label = calloc(1, 20); // TODO: 20?
+  char *label = arenaCalloc(&ast_arena, 1, 20); // TODO: 20?
   sprintf(label, ".lbl..%zu", id++);
   return label;
 }
@@ -451,7 +467,8 @@ char *newUniqueLabel(void) {
 Obj *newStrLitVar(Token *tok, Type *ty) {
   Obj *var = newAnonGlobalVar(ty);
   var->init_data = tok->str;
-  pushScope(var->name, var, NULL);
+  var->is_str_lit = true;
+  pushScope(intern(var->name, strlen(var->name)), var, NULL);
   return var;
 }
 
@@ -490,9 +507,9 @@ Type *declspec(VarAttr *attr) {
     bool is_typedef = false;
     bool is_static = false;
     bool is_extern = false;
-    if ((is_typedef = equal(tok, "typedef")) ||
-        (is_static = equal(tok, "static")) ||
-        (is_extern = equal(tok, "extern"))) {
+    if ((is_typedef = tok->kwd == KW_TYPEDEF) ||
+        (is_static = tok->kwd == KW_STATIC) ||
+        (is_extern = tok->kwd == KW_EXTERN)) {
       if (!attr) {
         compErrorToken(
             tok->str, "storage class specifier is not allowed in this context");
@@ -509,14 +526,17 @@ Type *declspec(VarAttr *attr) {
       continue;
     }
 
-    if (equal(tok, "const") || equal(tok, "volatile") || equal(tok, "auto") ||
-        equal(tok, "register") || equal(tok, "restrict") ||
-        equal(tok, "__restrict") || equal(tok, "__restrict__") ||
-        equal(tok, "_Noreturn")) {
+    if (tok->kwd == KW_CONST && attr) {
+      attr->is_const = true;
+      continue;
+    }
+    if (tok->kwd == KW_CONST || tok->kwd == KW_VOLATILE ||
+        tok->kwd == KW_AUTO || tok->kwd == KW_REGISTER ||
+        tok->kwd == KW_RESTRICT || tok->kwd == KW_NORETURN) {
       continue;
     }
 
-    if (equal(tok, "_Alignas")) {
+    if (tok->kwd == KW_ALIGNAS) {
       if (!attr) {
         compErrorToken(tok->str, "_Alignas is not allowed in this context");
       }
@@ -534,9 +554,9 @@ Type *declspec(VarAttr *attr) {
     bool isStructKwd = false;
     bool isUnionKwd = false;
     bool isEnumKwd = false;
-    if ((isStructKwd = equal(tok, "struct")) ||
-        (isUnionKwd = equal(tok, "union")) ||
-        (isEnumKwd = equal(tok, "enum")) || (typedef_ty = findTypedef(tok))) {
+    if ((isStructKwd = tok->kwd == KW_STRUCT) ||
+        (isUnionKwd = tok->kwd == KW_UNION) ||
+        (isEnumKwd = tok->kwd == KW_ENUM) || (typedef_ty = findTypedef(tok))) {
       if (counter) {
         token = tok;
         break;
@@ -554,25 +574,25 @@ Type *declspec(VarAttr *attr) {
       continue;
     }
 
-    if (equal(tok, "void")) {
+    if (tok->kwd == KW_VOID) {
       counter += VOID;
-    } else if (equal(tok, "_Bool")) {
+    } else if (tok->kwd == KW_BOOL) {
       counter += BOOL;
-    } else if (equal(tok, "char")) {
+    } else if (tok->kwd == KW_CHAR) {
       counter += CHAR;
-    } else if (equal(tok, "short")) {
+    } else if (tok->kwd == KW_SHORT) {
       counter += SHORT;
-    } else if (equal(tok, "int")) {
+    } else if (tok->kwd == KW_INT) {
       counter += INT;
-    } else if (equal(tok, "long")) {
+    } else if (tok->kwd == KW_LONG) {
       counter += LONG;
-    } else if (equal(tok, "float")) {
+    } else if (tok->kwd == KW_FLOAT) {
       counter += FLOAT;
-    } else if (equal(tok, "double")) {
+    } else if (tok->kwd == KW_DOUBLE) {
       counter += DOUBLE;
-    } else if (equal(tok, "signed")) {
+    } else if (tok->kwd == KW_SIGNED) {
       counter |= SIGNED;
-    } else if (equal(tok, "unsigned")) {
+    } else if (tok->kwd == KW_UNSIGNED) {
       counter |= UNSIGNED;
     } else {
       assert(false);
@@ -669,11 +689,11 @@ Type *structUnionDecl(Type *ty) {
         expect(",");
       }
       first = false;
-      Obj *mem = calloc(1, sizeof(Obj));
+      Obj *mem = newObj();
       Token *ident = NULL;
       mem->ty = declarator(mem_ty, &ident);
       mem->align = attr.align ? attr.align : mem->ty->align;
-      mem->name = strndup(ident->str, ident->len);
+      mem->name = arenaStrndup(&ast_arena, ident->str, ident->len);
       cur = cur->next = mem;
     }
   }
@@ -685,12 +705,10 @@ Type *structUnionDecl(Type *ty) {
   ty->align = 1;
 
   if (tag) {
-    for (TagScope *ts = scopes->tags; ts; ts = ts->next) {
-      if (strlen(ts->name) == tag->len &&
-          memcmp(tag->str, ts->name, tag->len) == 0) {
-        *ts->ty = *ty;
-        return ts->ty;
-      }
+    Type *prev = hashmapGet(&scopes->tags, tag->name);
+    if (prev) {
+      *prev = *ty;
+      return prev;
     }
     pushTagScope(tag, ty);
   }
@@ -770,6 +788,15 @@ Type *declarator(Type *ty, Token **ident) {
   return ty;
 }
 
+// Only the declaration specifiers' const is tracked, so `const int t[4]` is
+// read-only but neither `const char *p` nor `char *const p` is.
+bool isReadOnly(Type *ty, Type *basety, VarAttr *attr) {
+  while (ty->kind == TY_ARR) {
+    ty = ty->base;
+  }
+  return attr->is_const && ty == basety;
+}
+
 Obj *function(Type *ty, VarAttr *attr) {
   Token *fn_ident = NULL;
   ty = declarator(ty, &fn_ident);
@@ -777,13 +804,14 @@ Obj *function(Type *ty, VarAttr *attr) {
     compErrorToken(ty->tok->str, "function name omitted");
   }
 
-  Obj *fn = calloc(1, sizeof(Obj));
+  Obj *fn = newObj();
   fn->ty = newType(TY_FUNC, 0, 0);
   fn->align = fn->ty->align;
   fn->ty->ret_ty = ty;
-  fn->name = strndup(fn_ident->str, fn_ident->len);
+  fn->name = arenaStrndup(&ast_arena, fn_ident->str, fn_ident->len);
   fn->is_static = attr->is_static;
   fn->is_global = !attr->is_static;
+  Obj *outer_fn = cur_fn;
   cur_fn = fn;
 
   for (Obj *fn_decl = fn_decls; fn_decl; fn_decl = fn_decl->next) {
@@ -794,18 +822,18 @@ Obj *function(Type *ty, VarAttr *attr) {
     }
   }
 
-  Obj *var = calloc(1, sizeof(Obj));
-  var->name = strndup(fn_ident->str, fn_ident->len);
+  Obj *var = newObj();
+  var->name = arenaStrndup(&ast_arena, fn_ident->str, fn_ident->len);
   var->ty = fn->ty;
   var->align = var->ty->align;
   var->is_global = fn->is_global;
-  pushScope(var->name, var, NULL);
+  pushScope(fn_ident->name, var, NULL);
 
   enterScope();
 
   bool is_variadic = false;
   expect("(");
-  if (equal(token, "void") && equal(token->next, ")")) {
+  if (token->kwd == KW_VOID && equal(token->next, ")")) {
     token = token->next->next;
   } else {
     bool first = true;
@@ -835,7 +863,8 @@ Obj *function(Type *ty, VarAttr *attr) {
 
   Type *param_ty = NULL;
   for (Obj *param = fn->params; param; param = param->next) {
-    Type *new_param_ty = calloc(1, sizeof(Type));
+    types_allocated++;
+    Type *new_param_ty = arenaCalloc(&ast_arena, 1, sizeof(Type));
     *new_param_ty = *param->ty;
     new_param_ty->next = param_ty;
     param_ty = new_param_ty;
@@ -856,7 +885,7 @@ Obj *function(Type *ty, VarAttr *attr) {
     }
     fn->body = cmpndStmt();
   } else {
-    Obj *fn_decl = calloc(1, sizeof(Obj));
+    Obj *fn_decl = newObj();
     *fn_decl = *fn;
     fn_decl->next = fn_decls;
     fn_decls = fn_decl;
@@ -864,6 +893,11 @@ Obj *function(Type *ty, VarAttr *attr) {
 
   exitScope();
   resolveGotoLabels();
+  // A declaration inside a function body must not take over that function's
+  // locals.
+  if (!fn->body) {
+    cur_fn = outer_fn;
+  }
   return fn;
 }
 
@@ -889,7 +923,8 @@ Node *declaration(Type *basety, VarAttr *attr) {
 
     if (attr && attr->is_static) {
       Obj *gvar = newAnonGlobalVar(ty);
-      pushScope(strndup(ident->str, ident->len), gvar, NULL);
+      gvar->is_readonly = isReadOnly(ty, basety, attr);
+      pushScope(ident->name, gvar, NULL);
 
       if (consume("=")) {
         globalVarInitialiser(gvar);
@@ -924,14 +959,33 @@ Node *declaration(Type *basety, VarAttr *attr) {
 }
 
 Node *primary(void) {
+  // va_arg in include/stdarg.h reads floating point arguments from the saved
+  // xmm registers and all others from the general purpose ones.
+  if (equal(token, "__builtin_reg_class")) {
+    token = token->next;
+    expect("(");
+    Type *ty = typename();
+    expect(")");
+    return newNodeNum(isFloat(ty));
+  }
   Token *tok = consumeIdent();
   if (tok) {
     return newNodeIdent(tok);
   }
   if (consume("(")) {
     if (consume("{")) {
+      // The value of a statement expression may be one of its locals, read
+      // after the block has ended, so they take the span of the enclosing
+      // block instead. Locals of blocks nested within it keep their own.
+      Obj *outer_locals = cur_fn->locals;
+      const size_t begin = scope_clock + 1;
       Node *node = newNode(ND_STMT_EXPR);
       node->body = cmpndStmt()->body;
+      for (Obj *var = cur_fn->locals; var != outer_locals; var = var->next) {
+        if (var->scope_begin == begin) {
+          var->scope_begin = var->scope_end = 0;
+        }
+      }
       expect(")");
       return node;
     }
@@ -1077,24 +1131,24 @@ Node *unary(void) {
 }
 
 VarScope *findVarScope(Token *tok) {
+  scope_lookups++;
   for (Scope *sc = scopes; sc; sc = sc->next) {
-    for (VarScope *vs = sc->vars; vs; vs = vs->next) {
-      if (vs->name && strlen(vs->name) == tok->len &&
-          memcmp(tok->str, vs->name, strlen(vs->name)) == 0) {
-        return vs;
-      }
+    scope_steps++;
+    VarScope *vs = hashmapGet(&sc->vars, tok->name);
+    if (vs) {
+      return vs;
     }
   }
   return NULL;
 }
 
 Type *findTag(Token *tok) {
+  scope_lookups++;
   for (Scope *sc = scopes; sc; sc = sc->next) {
-    for (TagScope *ts = sc->tags; ts; ts = ts->next) {
-      if (strlen(ts->name) == tok->len &&
-          memcmp(tok->str, ts->name, tok->len) == 0) {
-        return ts->ty;
-      }
+    scope_steps++;
+    Type *ty = hashmapGet(&sc->tags, tok->name);
+    if (ty) {
+      return ty;
     }
   }
   return NULL;
@@ -1225,9 +1279,8 @@ Type *pointers(Type *ty) {
   while (consume("*")) {
     ty = pointerTo(ty);
     // clang-format off
-    while (consumeKwdMatch("const") || consumeKwdMatch("volatile") ||
-           consumeKwdMatch("restrict") || consumeKwdMatch("__restrict") ||
-           consumeKwdMatch("__restrict__"));
+    while (consumeKwdMatch(KW_CONST) || consumeKwdMatch(KW_VOLATILE) ||
+           consumeKwdMatch(KW_RESTRICT));
     // clang-format on
   }
   return ty;
@@ -1376,7 +1429,7 @@ Node *funcCall(Token *tok) {
   }
 
   Node *node = newNode(ND_FUNCCALL);
-  node->funcname = strndup(tok->str, tok->len);
+  node->funcname = arenaStrndup(&ast_arena, tok->str, tok->len);
   node->args = head.next;
   node->func_ty = ty;
   node->ty = ty->ret_ty;
@@ -1465,6 +1518,7 @@ void globalVar(Type *base_ty, VarAttr *attr) {
     Obj *var = newGlobalVar(ty, ident);
     var->is_definition = !attr->is_extern;
     var->is_static = attr->is_static;
+    var->is_readonly = isReadOnly(ty, base_ty, attr);
     if (attr->align) {
       var->align = attr->align;
     }
@@ -1475,20 +1529,36 @@ void globalVar(Type *base_ty, VarAttr *attr) {
 }
 
 void enterScope(void) {
-  Scope *sc = calloc(1, sizeof(Scope));
+  Scope *sc = arenaCalloc(&ast_arena, 1, sizeof(Scope));
   sc->next = scopes;
+  sc->locals = cur_fn ? cur_fn->locals : NULL;
+  sc->begin = ++scope_clock;
   scopes = sc;
 }
 
-void exitScope(void) { scopes = scopes->next; }
+// The locals declared in the block, and in blocks within it that were not
+// given a span of their own, get the span of the block, so that the code
+// generator can overlap the slots of locals whose blocks are disjoint.
+void exitScope(void) {
+  const size_t end = ++scope_clock;
+  if (cur_fn) {
+    for (Obj *var = cur_fn->locals; var && var != scopes->locals;
+         var = var->next) {
+      if (!var->scope_end) {
+        var->scope_begin = scopes->begin;
+        var->scope_end = end;
+      }
+    }
+  }
+  scopes = scopes->next;
+}
 
-void pushScope(char *name, Obj *var, Type *type_def) {
-  VarScope *sc = calloc(1, sizeof(VarScope));
-  sc->name = name;
+VarScope *pushScope(const char *name, Obj *var, Type *type_def) {
+  VarScope *sc = arenaCalloc(&ast_arena, 1, sizeof(VarScope));
   sc->var = var;
   sc->type_def = type_def;
-  sc->next = scopes->vars;
-  scopes->vars = sc;
+  hashmapPut(&scopes->vars, name, sc);
+  return sc;
 }
 
 size_t alignTo(size_t n, size_t align) {
@@ -1496,7 +1566,8 @@ size_t alignTo(size_t n, size_t align) {
 }
 
 Type *newType(TypeKind kind, ssize_t size, size_t align) {
-  Type *ty = calloc(1, sizeof(Type));
+  types_allocated++;
+  Type *ty = arenaCalloc(&ast_arena, 1, sizeof(Type));
   ty->kind = kind;
   ty->size = size;
   ty->align = align;
@@ -1504,15 +1575,7 @@ Type *newType(TypeKind kind, ssize_t size, size_t align) {
 }
 
 void pushTagScope(Token *tok, Type *ty) {
-  TagScope *sc = calloc(1, sizeof(TagScope));
-  sc->name = strndup(tok->str, tok->len);
-  sc->ty = ty;
-  sc->next = scopes->tags;
-  scopes->tags = sc;
-}
-
-bool equal(Token *tok, const char *str) {
-  return tok->len == strlen(str) && strncmp(tok->str, str, tok->len) == 0;
+  hashmapPut(&scopes->tags, tok->name, ty);
 }
 
 void parseTypedef(Type *basety) {
@@ -1530,7 +1593,7 @@ void parseTypedef(Type *basety) {
       compErrorToken(ty->tok->str, "typedef name omitted");
     }
 
-    pushScope(strndup(ident->str, ident->len), NULL, ty);
+    pushScope(ident->name, NULL, ty);
   }
 }
 
@@ -1545,19 +1608,34 @@ Type *findTypedef(Token *tok) {
 }
 
 bool isTypename(Token *tok) {
-  static const char *kwds[] = {
-      "_Bool",      "char",         "enum",      "int",      "long",
-      "short",      "static",       "struct",    "typedef",  "union",
-      "void",       "extern",       "_Alignas",  "signed",   "unsigned",
-      "const",      "volatile",     "auto",      "register", "restrict",
-      "__restrict", "__restrict__", "_Noreturn", "float",    "double"};
-  for (size_t i = 0; i < sizeof(kwds) / sizeof(*kwds); ++i) {
-    if (strlen(kwds[i]) == tok->len &&
-        strncmp(tok->str, kwds[i], tok->len) == 0) {
-      return true;
-    }
+  switch (tok->kwd) {
+  case KW_ALIGNAS:
+  case KW_AUTO:
+  case KW_BOOL:
+  case KW_CHAR:
+  case KW_CONST:
+  case KW_DOUBLE:
+  case KW_ENUM:
+  case KW_EXTERN:
+  case KW_FLOAT:
+  case KW_INT:
+  case KW_LONG:
+  case KW_NORETURN:
+  case KW_REGISTER:
+  case KW_RESTRICT:
+  case KW_SHORT:
+  case KW_SIGNED:
+  case KW_STATIC:
+  case KW_STRUCT:
+  case KW_TYPEDEF:
+  case KW_UNION:
+  case KW_UNSIGNED:
+  case KW_VOID:
+  case KW_VOLATILE:
+    return true;
+  default:
+    return findTypedef(tok) != NULL;
   }
-  return findTypedef(tok) != NULL;
 }
 
 Type *typename(void) {
@@ -1655,8 +1733,7 @@ Type *enumSpec() {
     if (consume("=")) {
       val = (int)constExpr();
     }
-    pushScope(strndup(econst->str, econst->len), NULL, NULL);
-    VarScope *sc = scopes->vars;
+    VarScope *sc = pushScope(econst->name, NULL, NULL);
     sc->enum_ty = ty;
     sc->enum_val = val++;
     if (consumeInitialiserListEnd()) {
@@ -1672,10 +1749,18 @@ Type *enumSpec() {
   return ty;
 }
 
+// Converts `A op= B` to `A = A op B` when A can be evaluated twice, with both
+// sides sharing A's node, and to `tmp = &A, *tmp = *tmp op B` otherwise. The
+// IR lowering computes A's address only once in the first form, and turns it
+// into a single read-modify-write instruction where it can.
 Node *toAssign(Node *node) {
   addType(node->lhs);
   addType(node->rhs);
 
+  if (isPure(node->lhs)) {
+    return newNodeBinary(ND_ASS, node->lhs, node);
+  }
+
   Token *ident = createIdent("");
   Obj *var = newLocalVar(pointerTo(node->lhs->ty), ident);
 
@@ -1686,6 +1771,33 @@ Node *toAssign(Node *node) {
   return newNodeBinary(ND_COMMA, expr1, expr2);
 }
 
+// Whether evaluating an expression twice is the same as evaluating it once:
+// it only reads variables and does arithmetic that cannot trap.
+bool isPure(Node *node) {
+  switch (node->kind) {
+  case ND_NUM:
+  case ND_VAR:
+    return true;
+  case ND_ADDR:
+  case ND_DEREF:
+    return isPure(node->body);
+  case ND_CAST:
+  case ND_MEMBER:
+    return isPure(node->lhs);
+  case ND_ADD:
+  case ND_SUB:
+  case ND_MUL:
+  case ND_SHL:
+  case ND_SHR:
+  case ND_BITAND:
+  case ND_BITOR:
+  case ND_BITXOR:
+    return isPure(node->lhs) && isPure(node->rhs);
+  default:
+    return false;
+  }
+}
+
 Node *newNodeVar(Obj *var) {
   Node *node = newNode(ND_VAR);
   node->var = var;
@@ -1747,7 +1859,7 @@ Node *logor(void) {
 
 Type *arrayDimensions(Type *ty) {
   // clang-format off
-  while (consumeKwdMatch("static") || consumeKwdMatch("restrict"));
+  while (consumeKwdMatch(KW_STATIC) || consumeKwdMatch(KW_RESTRICT));
   // clang-format on
   if (consume("]")) {
     ty = typeSuffix(ty);
@@ -1861,6 +1973,16 @@ int64_t constExpr(void) {
   return eval(node);
 }
 
+// Evaluates a preprocessor #if condition, which is its own token list.
+int64_t parseConstExpr(Token *tok, Token **end) {
+  Token *saved = token;
+  token = tok;
+  const int64_t val = constExpr();
+  *end = token;
+  token = saved;
+  return val;
+}
+
 int64_t eval(Node *node) { return eval2(node, NULL); }
 
 int64_t eval2(Node *node, char **label) {
@@ -1888,7 +2010,10 @@ int64_t eval2(Node *node, char **label) {
       case 2:
         return node->ty->is_unsigned ? (uint16_t)val : (int16_t)val;
       case 4:
-        return node->ty->is_unsigned ? (uint32_t)val : (int32_t)val;
+        if (node->ty->is_unsigned) {
+          return (uint32_t)val;
+        }
+        return (int32_t)val;
       }
     }
     return val;
@@ -1933,7 +2058,7 @@ int64_t eval2(Node *node, char **label) {
   case ND_NUM:
     return node->val;
   case ND_SHL:
-    return eval(node->lhs) << eval(node->rhs);
+    return (int64_t)((uint64_t)eval(node->lhs) << eval(node->rhs));
   case ND_SHR:
     if (node->ty->is_unsigned && node->ty->size == 8) {
       return (uint64_t)eval(node->lhs) >> eval(node->rhs);
@@ -1968,14 +2093,14 @@ int64_t eval2(Node *node, char **label) {
 }
 
 Initialiser *newInitialiser(Type *ty, bool is_flexible) {
-  Initialiser *init = calloc(1, sizeof(Initialiser));
+  Initialiser *init = arenaCalloc(&ast_arena, 1, sizeof(Initialiser));
   init->ty = ty;
   if (ty->kind == TY_ARR) {
     if (is_flexible && ty->size < 0) {
       init->is_flexible = true;
       return init;
     }
-    init->children = calloc(ty->arr_len, sizeof(*init->children));
+    init->children = arenaCalloc(&ast_arena, ty->arr_len, sizeof(*init->children));
     for (ssize_t i = 0; i < ty->arr_len; i++) {
       init->children[i] = newInitialiser(ty->base, false);
     }
@@ -1986,11 +2111,11 @@ Initialiser *newInitialiser(Type *ty, bool is_flexible) {
     for (Obj *mem = ty->members; mem; mem = mem->next) {
       len++;
     }
-    init->children = calloc(len, sizeof(*init->children));
+    init->children = arenaCalloc(&ast_arena, len, sizeof(*init->children));
     size_t idx = 0;
     for (Obj *mem = ty->members; mem; mem = mem->next) {
       if (is_flexible && ty->is_flexible && !mem->next) {
-        Initialiser *child = calloc(1, sizeof(Initialiser));
+        Initialiser *child = arenaCalloc(&ast_arena, 1, sizeof(Initialiser));
         child->ty = mem->ty;
         child->is_flexible = true;
         init->children[idx++] = child;
@@ -2072,12 +2197,47 @@ void initialiser2(Initialiser *init) {
 Node *lvalInitialiser(Obj *var) {
   Initialiser *init = initialiser(&var->ty);
   InitDesg desg = {.next = NULL, .idx = 0, .var = var, .is_member = false};
+  Node *rhs = createLvalInit(init, var->ty, &desg);
+  if (initCoversAll(init, var->ty)) {
+    return rhs;
+  }
   Node *lhs = newNode(ND_MEMZERO);
   lhs->var = var;
-  Node *rhs = createLvalInit(init, var->ty, &desg);
   return newNodeBinary(ND_COMMA, lhs, rhs);
 }
 
+// Whether the initialiser writes every byte of the object, in which case it
+// need not be zeroed first.
+bool initCoversAll(Initialiser *init, Type *ty) {
+  if (ty->kind == TY_ARR) {
+    for (ssize_t i = 0; i < ty->arr_len; i++) {
+      if (!initCoversAll(init->children[i], ty->base)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  if (ty->kind == TY_STRUCT && !init->expr) {
+    // Padding is only zeroed by the memzero, so any gap between members
+    // counts as uncovered.
+    ssize_t end = 0;
+    size_t idx = 0;
+    for (Obj *mem = ty->members; mem; mem = mem->next) {
+      if ((ssize_t)mem->offset != end ||
+          !initCoversAll(init->children[idx++], mem->ty)) {
+        return false;
+      }
+      end = (ssize_t)mem->offset + mem->ty->size;
+    }
+    return end == ty->size;
+  }
+  if (ty->kind == TY_UNION) {
+    return ty->members && ty->members->ty->size == ty->size &&
+           initCoversAll(init->children[0], ty->members->ty);
+  }
+  return init->expr != NULL;
+}
+
 Node *createLvalInit(Initialiser *init, Type *ty, InitDesg *desg) {
   if (ty->kind == TY_ARR) {
     Node *node = newNode(ND_NULL_EXPR);
@@ -2244,7 +2404,7 @@ void unionInitialiser(Initialiser *init) {
 void globalVarInitialiser(Obj *var) {
   Initialiser *init = initialiser(&var->ty);
   Relocation head = {0};
-  char *buf = calloc(1, var->ty->size);
+  char *buf = arenaCalloc(&ast_arena, 1, var->ty->size);
   writeGlobalVarData(&head, init, var->ty, buf, 0);
   var->init_data = buf;
   var->rel = head.next;
@@ -2289,7 +2449,7 @@ Relocation *writeGlobalVarData(Relocation *cur, Initialiser *init, Type *ty,
     writeBuf(buf + offset, val, ty->size);
     return cur;
   }
-  Relocation *rel = calloc(1, sizeof(Relocation));
+  Relocation *rel = arenaCalloc(&ast_arena, 1, sizeof(Relocation));
   rel->offset = offset;
   rel->label = label;
   rel->addend = val;
@@ -2352,13 +2512,14 @@ bool consumeInitialiserListEnd(void) {
 }
 
 Type *copyStructType(Type *src) {
-  Type *ty = calloc(1, sizeof(Type));
+  types_allocated++;
+  Type *ty = arenaCalloc(&ast_arena, 1, sizeof(Type));
   *ty = *src;
 
   Obj head = {0};
   Obj *cur = &head;
   for (Obj *mem = ty->members; mem; mem = mem->next) {
-    Obj *m = calloc(1, sizeof(Obj));
+    Obj *m = newObj();
     *m = *mem;
     cur = cur->next = m;
   }
@@ -2368,7 +2529,7 @@ Type *copyStructType(Type *src) {
 }
 
 Obj *newAnonGlobalVar(Type *ty) {
-  Obj *var = calloc(1, sizeof(Obj));
+  Obj *var = newObj();
   var->next = globals;
   var->name = newUniqueLabel();
   var->ty = ty;
@@ -2402,9 +2563,10 @@ Node *newNodeDo(void) {
 }
 
 Token *createIdent(const char *name) {
-  Token *ident = calloc(1, sizeof(Token));
+  Token *ident = arenaCalloc(&ast_arena, 1, sizeof(Token));
   ident->str = name;
   ident->len = strlen(name);
+  ident->name = intern(name, ident->len);
   return ident;
 }
 
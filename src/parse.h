@@ -3,13 +3,22 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
+typedef struct Node Node;
+typedef struct Obj Obj;
+typedef struct Token Token;
 typedef struct Type Type;
 
 size_t alignTo(size_t n, size_t align);
+Obj *newObj(void);
+char *newUniqueLabel(void);
 void parse(void);
 bool isInteger(Type *ty);
 bool isFloat(Type *ty);
 bool isNumeric(Type *ty);
+double evalDouble(Node *node);
+int64_t eval(Node *node);
+int64_t parseConstExpr(Token *tok, Token **end);
 
 #endif // PARSE_H
@@ -0,0 +1,193 @@
+#include "peephole.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+
+enum {
+  RULE_JUMP_NEXT,
+  RULE_SELF_MOVE,
+  RULE_MOVE_BACK,
+  RULE_CMP_ZERO,
+  RULE_REDUNDANT_EXTEND,
+  RULE_CNT,
+};
+
+static const char *rule_names[RULE_CNT] = {
+    "jump-to-next", "self-move", "move-back", "cmp-zero", "redundant-extend"};
+static size_t rule_hits[RULE_CNT] = {0};
+
+static bool applyRule(int rule, PeepInst *insts, size_t i, size_t cnt);
+static bool isFullReg(PeepOperand *op);
+static bool isJump(PeepInst *inst);
+static bool isMoveBackPair(PeepInst *a, PeepInst *b);
+static bool sameOperand(PeepOperand *a, PeepOperand *b);
+static size_t nextInst(PeepInst *insts, size_t i, size_t cnt);
+
+// Rewrites a function's instructions in place, marking those that can be
+// dropped as dead. The rules run until none applies, as one rewrite can expose
+// another.
+void peephole(PeepInst *insts, size_t cnt) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 0; i < cnt; i++) {
+      for (int rule = 0; rule < RULE_CNT; rule++) {
+        if (insts[i].kind == PEEP_INST && !insts[i].is_dead &&
+            applyRule(rule, insts, i, cnt)) {
+          rule_hits[rule]++;
+          changed = true;
+        }
+      }
+    }
+  }
+}
+
+void printPeepholeStats(void) {
+  size_t total = 0;
+  fprintf(stderr, "%-20s %10s\n", "rule", "hits");
+  for (int rule = 0; rule < RULE_CNT; rule++) {
+    fprintf(stderr, "%-20s %10zu\n", rule_names[rule], rule_hits[rule]);
+    total += rule_hits[rule];
+  }
+  fprintf(stderr, "%-20s %10zu\n", "total", total);
+}
+
+// Writes the rule hit counts to `fp`, for a parallel code generator's parent
+// to add to its own with addPeepholeHits().
+void writePeepholeHits(FILE *fp) {
+  fwrite(rule_hits, sizeof(size_t), RULE_CNT, fp);
+}
+
+void addPeepholeHits(FILE *fp) {
+  size_t hits[RULE_CNT] = {0};
+  if (fread(hits, sizeof(size_t), RULE_CNT, fp) != RULE_CNT) {
+    fprintf(stderr, "failed to read peephole rule hits\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int rule = 0; rule < RULE_CNT; rule++) {
+    rule_hits[rule] += hits[rule];
+  }
+}
+
+// Returns the index of the next live piece after `i`, looking through line
+// number directives, which do not affect the machine state.
+size_t nextInst(PeepInst *insts, size_t i, size_t cnt) {
+  for (i++; i < cnt; i++) {
+    if (!insts[i].is_dead && insts[i].kind != PEEP_LOC) {
+      return i;
+    }
+  }
+  return cnt;
+}
+
+bool sameOperand(PeepOperand *a, PeepOperand *b) {
+  return a->kind == b->kind && a->reg == b->reg && a->size == b->size &&
+         a->val == b->val;
+}
+
+bool isFullReg(PeepOperand *op) {
+  return op->kind == PEEP_REG && op->reg < REG_XMM0 && op->size == 8;
+}
+
+bool isJump(PeepInst *inst) {
+  return inst->opcode == OPC_JMP || inst->opcode == OPC_JE ||
+         inst->opcode == OPC_JNE || inst->opcode == OPC_JA;
+}
+
+// Whether `b` moves back the value `a` has just copied, with both sides full
+// width so that neither move zero-extends. Only stack slots are memory
+// operands, so no register used in an address can change between the two
+// moves unless `a` loads the slot's own base register.
+bool isMoveBackPair(PeepInst *a, PeepInst *b) {
+  if (a->opcode != b->opcode || a->opnd_cnt != 2 || b->opnd_cnt != 2 ||
+      !sameOperand(&a->opnds[0], &b->opnds[1]) ||
+      !sameOperand(&a->opnds[1], &b->opnds[0])) {
+    return false;
+  }
+  PeepOperand *dst = &a->opnds[0];
+  PeepOperand *src = &a->opnds[1];
+  if (a->opcode == OPC_MOVAPS) {
+    return dst->kind == PEEP_REG && src->kind == PEEP_REG;
+  }
+  if (a->opcode != OPC_MOV) {
+    return false;
+  }
+  if (isFullReg(dst) && src->kind == PEEP_SLOT) {
+    return !src->size && src->reg != dst->reg;
+  }
+  return isFullReg(dst) ? isFullReg(src)
+                        : dst->kind == PEEP_SLOT && !dst->size &&
+                              isFullReg(src);
+}
+
+bool applyRule(int rule, PeepInst *insts, size_t i, size_t cnt) {
+  PeepInst *inst = &insts[i];
+  const size_t j = nextInst(insts, i, cnt);
+  PeepInst *next = j < cnt ? &insts[j] : NULL;
+
+  switch (rule) {
+  case RULE_JUMP_NEXT:
+    // A jump, conditional or not, to the label that follows it.
+    if (isJump(inst) && next && next->kind == PEEP_LABEL &&
+        !strcmp(next->label, inst->label)) {
+      inst->is_dead = true;
+      return true;
+    }
+    return false;
+  case RULE_SELF_MOVE:
+    // `mov rax, rax`; a 32-bit self move zero-extends and must stay.
+    if (inst->opnd_cnt == 2 && sameOperand(&inst->opnds[0], &inst->opnds[1]) &&
+        ((inst->opcode == OPC_MOV && isFullReg(&inst->opnds[0])) ||
+         (inst->opcode == OPC_MOVAPS && inst->opnds[0].kind == PEEP_REG))) {
+      inst->is_dead = true;
+      return true;
+    }
+    return false;
+  case RULE_MOVE_BACK:
+    // `mov r12, rax` then `mov rax, r12`.
+    if (next && next->kind == PEEP_INST && isMoveBackPair(inst, next)) {
+      next->is_dead = true;
+      return true;
+    }
+    return false;
+  case RULE_CMP_ZERO:
+    // `cmp eax, 0` sets the flags just as `test eax, eax` does.
+    if (inst->opcode == OPC_CMP && inst->opnds[0].kind == PEEP_REG &&
+        inst->opnds[1].kind == PEEP_IMM && !inst->opnds[1].val) {
+      inst->opcode = OPC_TEST;
+      inst->opnds[1] = inst->opnds[0];
+      return true;
+    }
+    return false;
+  case RULE_REDUNDANT_EXTEND:
+    // A zero-extension to a 32-bit register leaves bit 31 clear, so
+    // sign-extending the result again changes nothing; nor does repeating an
+    // extension of a register. One that loads from memory may read something
+    // else the second time, but those are never PEEP_INSTs.
+    if (!next || next->kind != PEEP_INST) {
+      return false;
+    }
+    if (inst->opcode == OPC_MOVZX && inst->opnds[0].size == 4 &&
+        next->opcode == OPC_MOVSXD &&
+        sameOperand(&next->opnds[1], &inst->opnds[0]) &&
+        next->opnds[0].reg == inst->opnds[0].reg) {
+      next->is_dead = true;
+      return true;
+    }
+    if ((inst->opcode == OPC_MOVZX || inst->opcode == OPC_MOVSX) &&
+        next->opcode == inst->opcode &&
+        inst->opnds[1].kind == PEEP_REG &&
+        sameOperand(&inst->opnds[0], &next->opnds[0]) &&
+        sameOperand(&inst->opnds[1], &next->opnds[1])) {
+      next->is_dead = true;
+      return true;
+    }
+    return false;
+  default:
+    return false;
+  }
+}
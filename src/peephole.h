@@ -0,0 +1,14 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+typedef struct PeepInst PeepInst;
+
+void addPeepholeHits(FILE *fp);
+void peephole(PeepInst *insts, size_t cnt);
+void printPeepholeStats(void);
+void writePeepholeHits(FILE *fp);
+
+#endif // PEEPHOLE_H
@@ -0,0 +1,1029 @@
+#include "preprocess.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "comp_err.h"
+#include "defs.h"
+#include "hashmap.h"
+#include "parse.h"
+#include "tokenise.h"
+
+enum { IN_THEN, IN_ELIF, IN_ELSE };
+enum { BUILTIN_NONE, BUILTIN_FILE, BUILTIN_LINE };
+
+extern Arena token_arena;
+extern Type *ty_int;
+extern Type *ty_long;
+extern Type *ty_uchar;
+extern Type *ty_uint;
+extern Type *ty_ushort;
+static HashMap macros = {0};
+static HashMap include_guards = {0};
+static HashMap pragma_once = {0};
+static HashMap file_ids = {0};
+static CondIncl *cond_incl = NULL;
+static const char **include_paths = NULL;
+static size_t include_path_cnt = 0;
+static size_t include_path_cap = 0;
+static bool macros_ready = false;
+static const char *builtin_include_path = NULL;
+static const char *default_include_paths[] = {
+    "/usr/local/include", "/usr/include/x86_64-linux-gnu", "/usr/include"};
+
+static Hideset *hidesetIntersection(Hideset *hs1, Hideset *hs2);
+static Hideset *hidesetUnion(Hideset *hs1, Hideset *hs2);
+static Hideset *newHideset(const char *name);
+static Macro *addMacro(const char *name, bool is_objlike, Token *body);
+static Macro *findMacro(Token *tok);
+static MacroArg *findArg(MacroArg *args, Token *tok);
+static MacroArg *readMacroArg(Token **rest, Token *tok, bool read_rest);
+static MacroArg *readMacroArgs(Token **rest, Token *tok, Macro *m);
+static MacroParam *readMacroParams(Token **rest, Token *tok,
+                                   const char **va_args_name);
+static Token *addHideset(Token *tok, Hideset *hs);
+static Token *append(Token *tok1, Token *tok2);
+static Token *copyLine(Token **rest, Token *tok);
+static Token *copyToken(Token *tok);
+static Token *expandBuiltin(Macro *m, Token *tok);
+static Token *includeFile(Token *tok, const char *path);
+static Token *newEOF(Token *tok);
+static Token *newNumToken(int64_t val, Token *tmpl);
+static Token *paste(Token *lhs, Token *rhs);
+static Token *preprocess2(Token *tok);
+static Token *readConstExpr(Token **rest, Token *tok);
+static Token *retokenise(const char *text, Token *tmpl);
+static Token *skipCondIncl(Token *tok);
+static Token *skipCondInclNested(Token *tok);
+static Token *skipLine(Token *tok);
+static Token *skipPunct(Token *tok, const char *op);
+static Token *stringise(Token *hash, Token *arg);
+static Type *charPrefixType(Token *tok);
+static Token *subst(Token *tok, MacroArg *args);
+static bool expandMacro(Token **rest, Token *tok);
+static bool fileExists(const char *path);
+static bool hidesetContains(Hideset *hs, const char *name);
+static bool isCondStart(Token *tok);
+static bool isHash(Token *tok);
+static char *joinPath(const char *dir, size_t dir_len, const char *name);
+static char *joinTokens(Token *tok, Token *end);
+static char *quoteString(const char *str);
+static const char *builtinIncludePath(void);
+static const char *detectIncludeGuard(Token *tok);
+static const char *fileIdentity(const char *path);
+static const char *readIncludeFilename(Token **rest, Token *tok,
+                                       bool *is_dquote);
+static const char *searchIncludePaths(const char *filename);
+static int64_t evalConstExpr(Token **rest, Token *tok);
+static void addBuiltin(const char *name, int builtin);
+static void initMacros(void);
+static void predefine(const char *name, const char *body);
+static void pushCondIncl(Token *tok, bool included);
+static void readMacroDefinition(Token **rest, Token *tok);
+
+Token *preprocess(Token *tok) {
+  initMacros();
+  tok = preprocess2(tok);
+  if (cond_incl) {
+    compErrorToken(cond_incl->tok->str, "unterminated conditional directive");
+  }
+  return tok;
+}
+
+void addIncludePath(const char *path) {
+  if (include_path_cnt == include_path_cap) {
+    include_path_cap = include_path_cap ? include_path_cap * 2 : 8;
+    include_paths = arenaRealloc(&token_arena, include_paths,
+                                 include_path_cnt * sizeof(char *),
+                                 include_path_cap * sizeof(char *));
+  }
+  include_paths[include_path_cnt++] = path;
+}
+
+void defineMacro(const char *name, const char *body) {
+  initMacros();
+  predefine(name, body);
+}
+
+void predefine(const char *name, const char *body) {
+  addMacro(intern(name, strlen(name)), true,
+           tokeniseString("<built-in>", body));
+}
+
+void addBuiltin(const char *name, int builtin) {
+  Macro *m = addMacro(intern(name, strlen(name)), true, NULL);
+  m->builtin = builtin;
+}
+
+void initMacros(void) {
+  if (macros_ready) {
+    return;
+  }
+  macros_ready = true;
+  predefine("__STDC__", "1");
+  predefine("__STDC_HOSTED__", "1");
+  predefine("__STDC_VERSION__", "201112L");
+  predefine("__ELF__", "1");
+  predefine("__LP64__", "1");
+  predefine("__SIZEOF_INT__", "4");
+  predefine("__SIZEOF_LONG__", "8");
+  predefine("__SIZEOF_POINTER__", "8");
+  predefine("__linux__", "1");
+  predefine("__ucc__", "1");
+  predefine("__unix__", "1");
+  predefine("__x86_64__", "1");
+  addBuiltin("__FILE__", BUILTIN_FILE);
+  addBuiltin("__LINE__", BUILTIN_LINE);
+}
+
+// Tokens are expanded and directives executed in a single pass over the list.
+// Every directive's tokens are dropped from the output.
+Token *preprocess2(Token *tok) {
+  Token head = {0};
+  Token *cur = &head;
+  while (tok->kind != TK_EOF) {
+    if (expandMacro(&tok, tok)) {
+      continue;
+    }
+    if (!isHash(tok)) {
+      cur = cur->next = tok;
+      tok = tok->next;
+      continue;
+    }
+    Token *start = tok;
+    tok = tok->next;
+
+    if (equal(tok, "include")) {
+      bool is_dquote = false;
+      const char *filename = readIncludeFilename(&tok, tok->next, &is_dquote);
+      const char *path = NULL;
+      if (filename[0] != '/' && is_dquote) {
+        const char *slash = strrchr(start->file->name, '/');
+        path = filename;
+        if (slash) {
+          path = joinPath(start->file->name, slash - start->file->name,
+                          filename);
+        }
+        if (!fileExists(path)) {
+          path = NULL;
+        }
+      }
+      if (!path) {
+        path = searchIncludePaths(filename);
+      }
+      if (!path) {
+        compErrorToken(start->next->next->str, "file not found: '%s'",
+                       filename);
+      }
+      tok = includeFile(tok, path);
+      continue;
+    }
+    if (equal(tok, "define")) {
+      readMacroDefinition(&tok, tok->next);
+      continue;
+    }
+    if (equal(tok, "undef")) {
+      tok = tok->next;
+      if (!tok->name || tok->at_bol) {
+        compErrorToken(tok->str, "macro name must be an identifier");
+      }
+      hashmapPut(&macros, tok->name, NULL);
+      tok = skipLine(tok->next);
+      continue;
+    }
+    if (equal(tok, "if")) {
+      const int64_t val = evalConstExpr(&tok, tok);
+      pushCondIncl(start, val != 0);
+      if (!val) {
+        tok = skipCondIncl(tok);
+      }
+      continue;
+    }
+    if (equal(tok, "ifdef") || equal(tok, "ifndef")) {
+      const bool is_defined = findMacro(tok->next) != NULL;
+      const bool included = equal(tok, "ifdef") ? is_defined : !is_defined;
+      pushCondIncl(start, included);
+      tok = skipLine(tok->next->next);
+      if (!included) {
+        tok = skipCondIncl(tok);
+      }
+      continue;
+    }
+    if (equal(tok, "elif")) {
+      if (!cond_incl || cond_incl->ctx == IN_ELSE) {
+        compErrorToken(start->str, "stray #elif");
+      }
+      cond_incl->ctx = IN_ELIF;
+      if (!cond_incl->included && evalConstExpr(&tok, tok)) {
+        cond_incl->included = true;
+      } else {
+        tok = skipCondIncl(tok);
+      }
+      continue;
+    }
+    if (equal(tok, "else")) {
+      if (!cond_incl || cond_incl->ctx == IN_ELSE) {
+        compErrorToken(start->str, "stray #else");
+      }
+      cond_incl->ctx = IN_ELSE;
+      tok = skipLine(tok->next);
+      if (cond_incl->included) {
+        tok = skipCondIncl(tok);
+      }
+      continue;
+    }
+    if (equal(tok, "endif")) {
+      if (!cond_incl) {
+        compErrorToken(start->str, "stray #endif");
+      }
+      cond_incl = cond_incl->next;
+      tok = skipLine(tok->next);
+      continue;
+    }
+    if (equal(tok, "pragma") && equal(tok->next, "once")) {
+      const char *name = start->file->name;
+      hashmapPut(&pragma_once, fileIdentity(name), (void *)name);
+      tok = skipLine(tok->next->next);
+      continue;
+    }
+    if (equal(tok, "error")) {
+      compErrorToken(start->str, "#error");
+    }
+    if (equal(tok, "pragma") || equal(tok, "line") || equal(tok, "ident") ||
+        equal(tok, "warning") || tok->kind == TK_NUM) {
+      tok = skipLine(tok->next);
+      continue;
+    }
+    // A '#' on a line of its own is the null directive.
+    if (tok->at_bol) {
+      continue;
+    }
+    compErrorToken(tok->str, "invalid preprocessor directive");
+  }
+  cur->next = tok;
+  return head.next;
+}
+
+// A header whose contents are all inside `#ifndef X #define X ... #endif` is
+// not read again once X is defined.
+const char *detectIncludeGuard(Token *tok) {
+  if (!isHash(tok) || !equal(tok->next, "ifndef")) {
+    return NULL;
+  }
+  tok = tok->next->next;
+  if (tok->kind != TK_IDENT) {
+    return NULL;
+  }
+  const char *guard = tok->name;
+  tok = tok->next;
+  if (!isHash(tok) || !equal(tok->next, "define") ||
+      tok->next->next->name != guard) {
+    return NULL;
+  }
+  while (tok->kind != TK_EOF) {
+    if (!isHash(tok)) {
+      tok = tok->next;
+      continue;
+    }
+    if (equal(tok->next, "endif") && tok->next->next->kind == TK_EOF) {
+      return guard;
+    }
+    if (isCondStart(tok)) {
+      tok = skipCondInclNested(tok->next->next);
+    } else {
+      tok = tok->next;
+    }
+  }
+  return NULL;
+}
+
+Token *includeFile(Token *tok, const char *path) {
+  const char *id = fileIdentity(path);
+  if (hashmapGet(&pragma_once, id)) {
+    return tok;
+  }
+  const char *guard = hashmapGet(&include_guards, id);
+  if (guard && hashmapGet(&macros, guard)) {
+    return tok;
+  }
+  Token *included = tokeniseFile(path);
+  guard = detectIncludeGuard(included);
+  if (guard) {
+    hashmapPut(&include_guards, id, (void *)guard);
+  }
+  if (included->kind == TK_EOF) {
+    return tok;
+  }
+  Token *last = included;
+  while (last->next->kind != TK_EOF) {
+    last = last->next;
+  }
+  last->next = tok;
+  return included;
+}
+
+// A header reached by different spellings of its path, such as "inc/o.h"
+// and "./inc/o.h", is the same file to #pragma once and the include guard
+// table. Each spelling is resolved only once.
+const char *fileIdentity(const char *path) {
+  path = intern(path, strlen(path));
+  const char *id = hashmapGet(&file_ids, path);
+  if (id) {
+    return id;
+  }
+  char buf[PATH_MAX];
+  id = realpath(path, buf) ? intern(buf, strlen(buf)) : path;
+  hashmapPut(&file_ids, path, (void *)id);
+  return id;
+}
+
+const char *readIncludeFilename(Token **rest, Token *tok, bool *is_dquote) {
+  if (tok->kind == TK_STR && !tok->at_bol) {
+    *is_dquote = true;
+    *rest = skipLine(tok->next);
+    return arenaStrndup(&token_arena, tok->str + 1, tok->len - 2);
+  }
+  if (equal(tok, "<") && !tok->at_bol) {
+    Token *start = tok;
+    for (tok = tok->next; !equal(tok, ">"); tok = tok->next) {
+      if (tok->at_bol || tok->kind == TK_EOF) {
+        compErrorToken(start->str, "expected '>'");
+      }
+    }
+    *is_dquote = false;
+    *rest = skipLine(tok->next);
+    return joinTokens(start->next, tok);
+  }
+  if (tok->kind == TK_IDENT && !tok->at_bol) {
+    Token *expanded = preprocess2(copyLine(rest, tok));
+    return readIncludeFilename(&expanded, expanded, is_dquote);
+  }
+  compErrorToken(tok->str, "expected a filename");
+  return NULL;
+}
+
+const char *searchIncludePaths(const char *filename) {
+  if (filename[0] == '/') {
+    return filename;
+  }
+  for (size_t i = 0; i < include_path_cnt; i++) {
+    char *path =
+        joinPath(include_paths[i], strlen(include_paths[i]), filename);
+    if (fileExists(path)) {
+      return path;
+    }
+  }
+  const char *builtin = builtinIncludePath();
+  if (builtin) {
+    char *path = joinPath(builtin, strlen(builtin), filename);
+    if (fileExists(path)) {
+      return path;
+    }
+  }
+  const size_t cnt =
+      sizeof(default_include_paths) / sizeof(*default_include_paths);
+  for (size_t i = 0; i < cnt; i++) {
+    const char *dir = default_include_paths[i];
+    char *path = joinPath(dir, strlen(dir), filename);
+    if (fileExists(path)) {
+      return path;
+    }
+  }
+  return NULL;
+}
+
+// ucc's own stddef.h, stdarg.h and other freestanding headers live in the
+// include directory beside the one holding the executable, and are searched
+// before the system directories.
+const char *builtinIncludePath(void) {
+  if (builtin_include_path) {
+    return builtin_include_path;
+  }
+  char exe[PATH_MAX];
+  const ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+  if (len <= 0) {
+    return NULL;
+  }
+  exe[len] = '\0';
+  char *slash = strrchr(exe, '/');
+  if (!slash) {
+    return NULL;
+  }
+  builtin_include_path = joinPath(exe, slash - exe, "../include");
+  return builtin_include_path;
+}
+
+char *joinPath(const char *dir, size_t dir_len, const char *name) {
+  const size_t name_len = strlen(name);
+  char *path = arenaAlloc(&token_arena, dir_len + name_len + 2);
+  memcpy(path, dir, dir_len);
+  path[dir_len] = '/';
+  memcpy(path + dir_len + 1, name, name_len);
+  path[dir_len + name_len + 1] = '\0';
+  return path;
+}
+
+bool fileExists(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    return false;
+  }
+  fclose(file);
+  return true;
+}
+
+void readMacroDefinition(Token **rest, Token *tok) {
+  if (!tok->name || tok->at_bol) {
+    compErrorToken(tok->str, "macro name must be an identifier");
+  }
+  const char *name = tok->name;
+  tok = tok->next;
+  if (!tok->has_space && !tok->at_bol && equal(tok, "(")) {
+    const char *va_args_name = NULL;
+    MacroParam *params = readMacroParams(&tok, tok->next, &va_args_name);
+    Macro *m = addMacro(name, false, copyLine(rest, tok));
+    m->params = params;
+    m->va_args_name = va_args_name;
+  } else {
+    addMacro(name, true, copyLine(rest, tok));
+  }
+}
+
+MacroParam *readMacroParams(Token **rest, Token *tok,
+                            const char **va_args_name) {
+  MacroParam head = {0};
+  MacroParam *cur = &head;
+  while (!equal(tok, ")")) {
+    if (cur != &head) {
+      tok = skipPunct(tok, ",");
+    }
+    if (equal(tok, "...")) {
+      *va_args_name = intern("__VA_ARGS__", 11);
+      *rest = skipPunct(tok->next, ")");
+      return head.next;
+    }
+    if (tok->kind != TK_IDENT) {
+      compErrorToken(tok->str, "expected an identifier");
+    }
+    if (equal(tok->next, "...")) {
+      *va_args_name = tok->name;
+      *rest = skipPunct(tok->next->next, ")");
+      return head.next;
+    }
+    MacroParam *param = arenaCalloc(&token_arena, 1, sizeof(MacroParam));
+    param->name = tok->name;
+    cur = cur->next = param;
+    tok = tok->next;
+  }
+  *rest = tok->next;
+  return head.next;
+}
+
+Macro *addMacro(const char *name, bool is_objlike, Token *body) {
+  Macro *m = arenaCalloc(&token_arena, 1, sizeof(Macro));
+  m->name = name;
+  m->is_objlike = is_objlike;
+  m->body = body;
+  hashmapPut(&macros, name, m);
+  return m;
+}
+
+Macro *findMacro(Token *tok) {
+  if (!tok->name) {
+    return NULL;
+  }
+  return hashmapGet(&macros, tok->name);
+}
+
+// Each expanded token remembers the macros it came from in its hideset, so
+// that a macro is never expanded again inside its own expansion.
+bool expandMacro(Token **rest, Token *tok) {
+  if (hidesetContains(tok->hideset, tok->name)) {
+    return false;
+  }
+  Macro *m = findMacro(tok);
+  if (!m) {
+    return false;
+  }
+  if (m->builtin) {
+    Token *expanded = expandBuiltin(m, tok);
+    expanded->next = tok->next;
+    *rest = expanded;
+    return true;
+  }
+
+  Token *body = NULL;
+  if (m->is_objlike) {
+    Hideset *hs = hidesetUnion(tok->hideset, newHideset(m->name));
+    body = addHideset(m->body, hs);
+    *rest = tok->next;
+  } else {
+    if (!equal(tok->next, "(")) {
+      return false;
+    }
+    MacroArg *args = readMacroArgs(rest, tok, m);
+    Token *rparen = *rest;
+    Hideset *hs = hidesetIntersection(tok->hideset, rparen->hideset);
+    hs = hidesetUnion(hs, newHideset(m->name));
+    body = addHideset(subst(m->body, args), hs);
+    *rest = rparen->next;
+  }
+  for (Token *t = body; t->kind != TK_EOF; t = t->next) {
+    t->origin = tok;
+  }
+  if (body->kind != TK_EOF) {
+    body->at_bol = tok->at_bol;
+    body->has_space = tok->has_space;
+  }
+  *rest = append(body, *rest);
+  return true;
+}
+
+Token *expandBuiltin(Macro *m, Token *tok) {
+  Token *start = tok;
+  while (start->origin) {
+    start = start->origin;
+  }
+  if (m->builtin == BUILTIN_FILE) {
+    return retokenise(quoteString(start->file->name), tok);
+  }
+  char *buf = arenaCalloc(&token_arena, 1, 24);
+  sprintf(buf, "%zu", start->line_num);
+  return retokenise(buf, tok);
+}
+
+MacroArg *readMacroArgs(Token **rest, Token *tok, Macro *m) {
+  tok = tok->next->next;
+  MacroArg head = {0};
+  MacroArg *cur = &head;
+  MacroParam *param = m->params;
+  for (; param; param = param->next) {
+    if (cur != &head) {
+      tok = skipPunct(tok, ",");
+    }
+    cur = cur->next = readMacroArg(&tok, tok, false);
+    cur->name = param->name;
+  }
+  if (m->va_args_name) {
+    MacroArg *arg = NULL;
+    if (equal(tok, ")")) {
+      arg = arenaCalloc(&token_arena, 1, sizeof(MacroArg));
+      arg->tok = newEOF(tok);
+    } else {
+      if (m->params) {
+        tok = skipPunct(tok, ",");
+      }
+      arg = readMacroArg(&tok, tok, true);
+    }
+    arg->name = m->va_args_name;
+    arg->is_va_args = true;
+    cur = cur->next = arg;
+  }
+  if (!equal(tok, ")")) {
+    compErrorToken(tok->str, "too many arguments");
+  }
+  *rest = tok;
+  return head.next;
+}
+
+MacroArg *readMacroArg(Token **rest, Token *tok, bool read_rest) {
+  Token head = {0};
+  Token *cur = &head;
+  int level = 0;
+  for (;;) {
+    if (level == 0 && equal(tok, ")")) {
+      break;
+    }
+    if (level == 0 && !read_rest && equal(tok, ",")) {
+      break;
+    }
+    if (tok->kind == TK_EOF) {
+      compErrorToken(tok->str, "premature end of input");
+    }
+    if (equal(tok, "(")) {
+      level++;
+    } else if (equal(tok, ")")) {
+      level--;
+    }
+    cur = cur->next = copyToken(tok);
+    tok = tok->next;
+  }
+  cur->next = newEOF(tok);
+  MacroArg *arg = arenaCalloc(&token_arena, 1, sizeof(MacroArg));
+  arg->tok = head.next;
+  *rest = tok;
+  return arg;
+}
+
+MacroArg *findArg(MacroArg *args, Token *tok) {
+  if (!tok->name) {
+    return NULL;
+  }
+  for (MacroArg *arg = args; arg; arg = arg->next) {
+    if (arg->name == tok->name) {
+      return arg;
+    }
+  }
+  return NULL;
+}
+
+// Replaces the parameters in a function-like macro's body with its arguments.
+// Arguments are fully expanded first, except where they are stringised or
+// pasted.
+Token *subst(Token *tok, MacroArg *args) {
+  Token head = {0};
+  Token *cur = &head;
+  while (tok->kind != TK_EOF) {
+    if (equal(tok, "#")) {
+      MacroArg *arg = findArg(args, tok->next);
+      if (!arg) {
+        compErrorToken(tok->next->str,
+                       "'#' is not followed by a macro parameter");
+      }
+      cur = cur->next = stringise(tok, arg->tok);
+      tok = tok->next->next;
+      continue;
+    }
+    // `, ## __VA_ARGS__` drops the comma when there are no variadic arguments.
+    if (equal(tok, ",") && equal(tok->next, "##")) {
+      MacroArg *arg = findArg(args, tok->next->next);
+      if (arg && arg->is_va_args) {
+        if (arg->tok->kind == TK_EOF) {
+          tok = tok->next->next->next;
+        } else {
+          cur = cur->next = copyToken(tok);
+          tok = tok->next->next;
+        }
+        continue;
+      }
+    }
+    if (equal(tok, "##")) {
+      if (cur == &head) {
+        compErrorToken(tok->str,
+                       "'##' cannot appear at start of macro expansion");
+      }
+      if (tok->next->kind == TK_EOF) {
+        compErrorToken(tok->str,
+                       "'##' cannot appear at end of macro expansion");
+      }
+      MacroArg *arg = findArg(args, tok->next);
+      if (arg) {
+        if (arg->tok->kind != TK_EOF) {
+          *cur = *paste(cur, arg->tok);
+          for (Token *t = arg->tok->next; t->kind != TK_EOF; t = t->next) {
+            cur = cur->next = copyToken(t);
+          }
+        }
+        tok = tok->next->next;
+        continue;
+      }
+      *cur = *paste(cur, tok->next);
+      tok = tok->next->next;
+      continue;
+    }
+    MacroArg *arg = findArg(args, tok);
+    if (arg && equal(tok->next, "##")) {
+      Token *rhs = tok->next->next;
+      if (arg->tok->kind == TK_EOF) {
+        MacroArg *arg2 = findArg(args, rhs);
+        if (arg2) {
+          for (Token *t = arg2->tok; t->kind != TK_EOF; t = t->next) {
+            cur = cur->next = copyToken(t);
+          }
+        } else {
+          cur = cur->next = copyToken(rhs);
+        }
+        tok = rhs->next;
+        continue;
+      }
+      for (Token *t = arg->tok; t->kind != TK_EOF; t = t->next) {
+        cur = cur->next = copyToken(t);
+      }
+      tok = tok->next;
+      continue;
+    }
+    // Expansion relinks the tokens it is given, so work on a copy to leave the
+    // argument intact for any later '#' or '##'.
+    if (arg) {
+      Token *t = preprocess2(append(arg->tok, newEOF(tok)));
+      if (t->kind != TK_EOF) {
+        t->at_bol = tok->at_bol;
+        t->has_space = tok->has_space;
+      }
+      for (; t->kind != TK_EOF; t = t->next) {
+        cur = cur->next = copyToken(t);
+      }
+      tok = tok->next;
+      continue;
+    }
+    cur = cur->next = copyToken(tok);
+    tok = tok->next;
+  }
+  cur->next = tok;
+  return head.next;
+}
+
+Token *stringise(Token *hash, Token *arg) {
+  return retokenise(quoteString(joinTokens(arg, NULL)), hash);
+}
+
+Token *paste(Token *lhs, Token *rhs) {
+  char *buf = arenaCalloc(&token_arena, 1, lhs->len + rhs->len + 1);
+  memcpy(buf, lhs->str, lhs->len);
+  memcpy(buf + lhs->len, rhs->str, rhs->len);
+  Token *tok = retokenise(buf, lhs);
+  if (tok->next->kind != TK_EOF) {
+    compErrorToken(lhs->str, "pasting forms '%s', an invalid token", buf);
+  }
+  return tok;
+}
+
+// Made-up tokens take their position from the token they replace, so that
+// line information and directive detection are unaffected.
+Token *retokenise(const char *text, Token *tmpl) {
+  Token *tok = tokeniseString(tmpl->file->name, text);
+  for (Token *t = tok; t; t = t->next) {
+    t->file = tmpl->file;
+    t->line_num = tmpl->line_num;
+  }
+  tok->at_bol = tmpl->at_bol;
+  tok->has_space = tmpl->has_space;
+  tok->hideset = tmpl->hideset;
+  return tok;
+}
+
+char *joinTokens(Token *tok, Token *end) {
+  size_t len = 1;
+  for (Token *t = tok; t != end && t->kind != TK_EOF; t = t->next) {
+    if (t != tok && t->has_space) {
+      len++;
+    }
+    len += t->len;
+  }
+  char *buf = arenaCalloc(&token_arena, 1, len);
+  size_t pos = 0;
+  for (Token *t = tok; t != end && t->kind != TK_EOF; t = t->next) {
+    if (t != tok && t->has_space) {
+      buf[pos++] = ' ';
+    }
+    memcpy(buf + pos, t->str, t->len);
+    pos += t->len;
+  }
+  return buf;
+}
+
+char *quoteString(const char *str) {
+  size_t len = 3;
+  for (const char *p = str; *p; p++) {
+    len += (*p == '\\' || *p == '"') ? 2 : 1;
+  }
+  char *buf = arenaCalloc(&token_arena, 1, len);
+  size_t pos = 0;
+  buf[pos++] = '"';
+  for (const char *p = str; *p; p++) {
+    if (*p == '\\' || *p == '"') {
+      buf[pos++] = '\\';
+    }
+    buf[pos++] = *p;
+  }
+  buf[pos] = '"';
+  return buf;
+}
+
+// `defined X` and `defined(X)` are replaced before macro expansion, and any
+// identifier left after it evaluates to 0.
+int64_t evalConstExpr(Token **rest, Token *tok) {
+  Token *start = tok;
+  Token *expr = preprocess2(readConstExpr(rest, tok->next));
+  if (expr->kind == TK_EOF) {
+    compErrorToken(start->str, "no expression");
+  }
+  for (Token *t = expr; t->kind != TK_EOF; t = t->next) {
+    Type *ty = charPrefixType(t);
+    if (ty) {
+      t->kind = TK_NUM;
+      t->val = (uint8_t)t->next->val;
+      t->ty = ty;
+      t->next = t->next->next;
+    } else if (t->kind == TK_IDENT) {
+      t->kind = TK_NUM;
+      t->val = 0;
+      t->ty = ty_long;
+    }
+  }
+  Token *end = NULL;
+  const int64_t val = parseConstExpr(expr, &end);
+  if (end->kind != TK_EOF) {
+    compErrorToken(end->str, "extra token");
+  }
+  return val;
+}
+
+// The type of a character constant with an encoding prefix, as in L'\0',
+// which the lexer reads as an identifier directly followed by the constant.
+// wchar_t is int, char16_t and char32_t are unsigned and u8 is unsigned char,
+// and an escape such as \xff gives the value 255 in all of them.
+Type *charPrefixType(Token *tok) {
+  Token *lit = tok->next;
+  if (tok->kind != TK_IDENT || lit->kind != TK_NUM || *lit->str != '\'' ||
+      lit->has_space) {
+    return NULL;
+  }
+  if (equal(tok, "L")) {
+    return ty_int;
+  }
+  if (equal(tok, "u")) {
+    return ty_ushort;
+  }
+  if (equal(tok, "U")) {
+    return ty_uint;
+  }
+  if (equal(tok, "u8")) {
+    return ty_uchar;
+  }
+  return NULL;
+}
+
+Token *readConstExpr(Token **rest, Token *tok) {
+  tok = copyLine(rest, tok);
+  Token head = {0};
+  Token *cur = &head;
+  while (tok->kind != TK_EOF) {
+    if (equal(tok, "defined")) {
+      Token *start = tok;
+      const bool has_paren = equal(tok->next, "(");
+      tok = has_paren ? tok->next->next : tok->next;
+      if (!tok->name) {
+        compErrorToken(tok->str, "macro name must be an identifier");
+      }
+      const bool is_defined = findMacro(tok) != NULL;
+      tok = tok->next;
+      if (has_paren) {
+        tok = skipPunct(tok, ")");
+      }
+      cur = cur->next = newNumToken(is_defined, start);
+      continue;
+    }
+    cur = cur->next = tok;
+    tok = tok->next;
+  }
+  cur->next = tok;
+  return head.next;
+}
+
+void pushCondIncl(Token *tok, bool included) {
+  CondIncl *ci = arenaCalloc(&token_arena, 1, sizeof(CondIncl));
+  ci->next = cond_incl;
+  ci->ctx = IN_THEN;
+  ci->tok = tok;
+  ci->included = included;
+  cond_incl = ci;
+}
+
+// Skips to the #elif, #else or #endif that ends the current group.
+Token *skipCondIncl(Token *tok) {
+  while (tok->kind != TK_EOF) {
+    if (isCondStart(tok)) {
+      tok = skipCondInclNested(tok->next->next);
+      continue;
+    }
+    if (isHash(tok) && (equal(tok->next, "elif") ||
+                        equal(tok->next, "else") || equal(tok->next, "endif"))) {
+      break;
+    }
+    tok = tok->next;
+  }
+  return tok;
+}
+
+// Skips past the #endif of a nested conditional.
+Token *skipCondInclNested(Token *tok) {
+  while (tok->kind != TK_EOF) {
+    if (isCondStart(tok)) {
+      tok = skipCondInclNested(tok->next->next);
+      continue;
+    }
+    if (isHash(tok) && equal(tok->next, "endif")) {
+      return tok->next->next;
+    }
+    tok = tok->next;
+  }
+  return tok;
+}
+
+bool isCondStart(Token *tok) {
+  return isHash(tok) && (equal(tok->next, "if") || equal(tok->next, "ifdef") ||
+                         equal(tok->next, "ifndef"));
+}
+
+bool isHash(Token *tok) { return tok->at_bol && equal(tok, "#"); }
+
+Token *skipLine(Token *tok) {
+  while (!tok->at_bol) {
+    tok = tok->next;
+  }
+  return tok;
+}
+
+Token *skipPunct(Token *tok, const char *op) {
+  if (!equal(tok, op)) {
+    compErrorToken(tok->str, "expected '%s'", op);
+  }
+  return tok->next;
+}
+
+// Copies the rest of the line, ending the copy with an EOF token.
+Token *copyLine(Token **rest, Token *tok) {
+  Token head = {0};
+  Token *cur = &head;
+  for (; !tok->at_bol; tok = tok->next) {
+    cur = cur->next = copyToken(tok);
+  }
+  cur->next = newEOF(tok);
+  *rest = tok;
+  return head.next;
+}
+
+Token *copyToken(Token *tok) {
+  Token *copy = arenaAlloc(&token_arena, sizeof(Token));
+  *copy = *tok;
+  copy->next = NULL;
+  return copy;
+}
+
+Token *newEOF(Token *tok) {
+  Token *eof = copyToken(tok);
+  eof->kind = TK_EOF;
+  eof->len = 0;
+  return eof;
+}
+
+Token *newNumToken(int64_t val, Token *tmpl) {
+  Token *tok = copyToken(tmpl);
+  tok->kind = TK_NUM;
+  tok->val = val;
+  tok->ty = ty_long;
+  return tok;
+}
+
+Token *append(Token *tok1, Token *tok2) {
+  Token head = {0};
+  Token *cur = &head;
+  for (; tok1->kind != TK_EOF; tok1 = tok1->next) {
+    cur = cur->next = copyToken(tok1);
+  }
+  cur->next = tok2;
+  return head.next;
+}
+
+Token *addHideset(Token *tok, Hideset *hs) {
+  Token head = {0};
+  Token *cur = &head;
+  for (; tok; tok = tok->next) {
+    Token *t = copyToken(tok);
+    t->hideset = hidesetUnion(t->hideset, hs);
+    cur = cur->next = t;
+  }
+  return head.next;
+}
+
+Hideset *newHideset(const char *name) {
+  Hideset *hs = arenaCalloc(&token_arena, 1, sizeof(Hideset));
+  hs->name = name;
+  return hs;
+}
+
+Hideset *hidesetUnion(Hideset *hs1, Hideset *hs2) {
+  Hideset head = {0};
+  Hideset *cur = &head;
+  for (; hs1; hs1 = hs1->next) {
+    cur = cur->next = newHideset(hs1->name);
+  }
+  cur->next = hs2;
+  return head.next;
+}
+
+Hideset *hidesetIntersection(Hideset *hs1, Hideset *hs2) {
+  Hideset head = {0};
+  Hideset *cur = &head;
+  for (; hs1; hs1 = hs1->next) {
+    if (hidesetContains(hs2, hs1->name)) {
+      cur = cur->next = newHideset(hs1->name);
+    }
+  }
+  return head.next;
+}
+
+bool hidesetContains(Hideset *hs, const char *name) {
+  for (; hs; hs = hs->next) {
+    if (hs->name == name) {
+      return true;
+    }
+  }
+  return false;
+}
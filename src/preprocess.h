@@ -0,0 +1,10 @@
+#ifndef PREPROCESS_H
+#define PREPROCESS_H
+
+typedef struct Token Token;
+
+Token *preprocess(Token *tok);
+void addIncludePath(const char *path);
+void defineMacro(const char *name, const char *body);
+
+#endif // PREPROCESS_H
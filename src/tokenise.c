@@ -7,9 +7,15 @@
 #include <string.h>
 #include <strings.h>
 
+#include "arena.h"
 #include "comp_err.h"
 #include "defs.h"
+#include "hashmap.h"
+#include "preprocess.h"
 
+enum { CC_OTHER, CC_SPACE, CC_PUNCT, CC_DIGIT, CC_ALPHA };
+
+extern Arena token_arena;
 extern Type *ty_char;
 extern Type *ty_bool;
 extern Type *ty_int;
@@ -24,22 +30,91 @@ extern Type *ty_float;
 extern Type *ty_double;
 
 Token *token = NULL;
-const char *file_content = NULL;
-
+size_t tokens_lexed = 0;
+File *files = NULL;
+static File *last_file = NULL;
+static int file_cnt = 0;
+static File *cur_file = NULL;
+static bool at_bol = false;
+static bool has_space = false;
+// Identifier characters are the two classes at the end, so that isIdentChar
+// is a single comparison. Bytes outside ASCII are CC_OTHER.
+static const unsigned char char_class[256] = {
+    CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER,
+    CC_OTHER, CC_SPACE, CC_SPACE, CC_SPACE, CC_SPACE, CC_SPACE, CC_OTHER, CC_OTHER,
+    CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER,
+    CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER, CC_OTHER,
+    CC_SPACE, CC_PUNCT, CC_OTHER, CC_PUNCT, CC_OTHER, CC_PUNCT, CC_PUNCT, CC_OTHER,
+    CC_PUNCT, CC_PUNCT, CC_PUNCT, CC_PUNCT, CC_PUNCT, CC_PUNCT, CC_PUNCT, CC_PUNCT,
+    CC_DIGIT, CC_DIGIT, CC_DIGIT, CC_DIGIT, CC_DIGIT, CC_DIGIT, CC_DIGIT, CC_DIGIT,
+    CC_DIGIT, CC_DIGIT, CC_PUNCT, CC_PUNCT, CC_PUNCT, CC_PUNCT, CC_PUNCT, CC_PUNCT,
+    CC_OTHER, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA,
+    CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA,
+    CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA,
+    CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_PUNCT, CC_OTHER, CC_PUNCT, CC_PUNCT, CC_ALPHA,
+    CC_OTHER, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA,
+    CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA,
+    CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_ALPHA,
+    CC_ALPHA, CC_ALPHA, CC_ALPHA, CC_PUNCT, CC_PUNCT, CC_PUNCT, CC_PUNCT, CC_OTHER,
+};
+// Keywords are found through a perfect hash of their first two characters,
+// last character and length: kwd_slots maps every hash to one plus the index
+// of the only keyword that can have it, or 0. Adding a keyword means finding
+// it an empty slot, or new multipliers in keywordHash.
+static const char *kwd_names[] = {
+    "_Alignas",   "_Alignof",     "_Bool",  "_Noreturn",
+    "__restrict", "__restrict__", "auto",   "break",
+    "case",       "char",         "const",  "continue",
+    "default",    "do",           "double", "else",
+    "enum",       "extern",       "float",  "for",
+    "goto",       "if",           "int",    "long",
+    "register",   "restrict",     "return", "short",
+    "signed",     "sizeof",       "static", "struct",
+    "switch",     "typedef",      "union",  "unsigned",
+    "void",       "volatile",     "while"};
+static const Keyword kwd_ids[] = {
+    KW_ALIGNAS,  KW_ALIGNOF,  KW_BOOL,   KW_NORETURN,
+    KW_RESTRICT, KW_RESTRICT, KW_AUTO,   KW_BREAK,
+    KW_CASE,     KW_CHAR,     KW_CONST,  KW_CONTINUE,
+    KW_DEFAULT,  KW_DO,       KW_DOUBLE, KW_ELSE,
+    KW_ENUM,     KW_EXTERN,   KW_FLOAT,  KW_FOR,
+    KW_GOTO,     KW_IF,       KW_INT,    KW_LONG,
+    KW_REGISTER, KW_RESTRICT, KW_RETURN, KW_SHORT,
+    KW_SIGNED,   KW_SIZEOF,   KW_STATIC, KW_STRUCT,
+    KW_SWITCH,   KW_TYPEDEF,  KW_UNION,  KW_UNSIGNED,
+    KW_VOID,     KW_VOLATILE, KW_WHILE};
+static const char *kwd_interned[sizeof(kwd_names) / sizeof(*kwd_names)];
+static const unsigned char kwd_slots[128] = {
+    0,  0,  0,  3,  0,  16, 0,  0,  22, 28, 0, 0,  15, 26, 0,  0,
+    12, 0,  0,  0,  0,  0,  0,  0,  32, 0,  0, 0,  0,  29, 0,  0,
+    0,  31, 0,  37, 24, 0,  0,  0,  39, 4,  0, 30, 36, 0,  0,  0,
+    0,  0,  8,  0,  0,  0,  38, 0,  0,  0,  0, 0,  1,  0,  0,  17,
+    34, 0,  0,  0,  0,  0,  14, 33, 0,  0,  0, 0,  7,  0,  0,  0,
+    0,  0,  21, 0,  0,  0,  18, 0,  10, 0,  6, 0,  0,  27, 0,  0,
+    0,  2,  20, 0,  0,  0,  0,  5,  0,  35, 0, 0,  0,  0,  13, 0,
+    11, 0,  0,  19, 0,  23, 9,  0,  0,  0,  0, 0,  0,  0,  0,  25};
+
+static File *newFile(const char *name, const char *contents, int file_no);
 static Token *newIdent(Token *cur, const char **p, size_t line_num);
 static Token *newToken(TokenKind kind, Token *cur, const char *str, size_t len,
                        size_t line_num);
+static Token *tokeniseText(File *file);
+static TokenKind keywordKind(Keyword kwd);
 static bool consumeTokKind(TokenKind kind);
 static bool isIdentChar(char c);
-static bool isKeyword(const char *str, size_t len);
 static bool startsWith(const char *p, const char *q);
 static char *readFile(const char *file_path);
 static int fromHex(char c);
 static int readEscapedChar(const char **p);
 static long readIntLiteral(const char **start, Type **ret_ty);
+static size_t decodeStrLit(char *buf, Token *tok);
+static size_t findKeyword(const char *str, size_t len);
+static size_t keywordHash(const char *str, size_t len);
+static size_t punctLen(const char *p);
+static void removeLineContinuations(char *p);
 
 bool startsWith(const char *p, const char *q) {
-  return memcmp(p, q, strlen(q)) == 0;
+  return strncmp(p, q, strlen(q)) == 0;
 }
 
 bool consume(char *op) {
@@ -149,67 +224,89 @@ Token *expectNumber(void) {
 
 bool isEOF(void) { return token->kind == TK_EOF; }
 
+bool equal(Token *tok, const char *str) {
+  return tok->len == strlen(str) && strncmp(tok->str, str, tok->len) == 0;
+}
+
 Token *newToken(TokenKind kind, Token *cur, const char *str, size_t len,
                 size_t line_num) {
-  Token *tok = calloc(1, sizeof(Token));
+  tokens_lexed++;
+  Token *tok = arenaCalloc(&token_arena, 1, sizeof(Token));
   tok->kind = kind;
   tok->str = str;
   tok->len = len;
   tok->line_num = line_num;
+  tok->file = cur_file;
+  tok->at_bol = at_bol;
+  tok->has_space = has_space;
+  at_bol = has_space = false;
   cur->next = tok;
   return tok;
 }
 
 void tokenise(const char *file_path) {
-  const char *p = file_content = readFile(file_path);
+  token = preprocess(tokeniseFile(file_path));
+  joinStrLits(token);
+}
+
+// Every file gets a number for the .file and .loc directives, in the order it
+// is first read.
+Token *tokeniseFile(const char *file_path) {
+  char *contents = readFile(file_path);
+  removeLineContinuations(contents);
+  return tokeniseText(newFile(file_path, contents, ++file_cnt));
+}
+
+// Text made up by the preprocessor, such as a pasted token, gets a file of its
+// own so that error messages can still find the line it is on.
+Token *tokeniseString(const char *name, const char *text) {
+  return tokeniseText(newFile(name, text, 0));
+}
+
+File *newFile(const char *name, const char *contents, int file_no) {
+  File *file = arenaCalloc(&token_arena, 1, sizeof(File));
+  file->name = name;
+  file->contents = contents;
+  file->len = strlen(contents);
+  file->file_no = file_no;
+  if (last_file) {
+    last_file = last_file->next = file;
+  } else {
+    files = last_file = file;
+  }
+  return file;
+}
+
+Token *tokeniseText(File *file) {
+  const char *p = file->contents;
+  cur_file = file;
+  at_bol = true;
+  has_space = false;
 
   Token head = {0};
   Token *cur = &head;
   size_t line_num = 1;
   while (*p) {
-    if (startsWith(p, "//")) {
-      while (*p != '\n') {
-        p++;
-      }
-      continue;
-    }
-    if (startsWith(p, "/*")) {
-      char *q = strstr(p + 2, "*/");
-      if (!q) {
-        compErrorToken(p, "unclosed block comment");
-      }
-      p = q + 2;
-      continue;
-    }
-    if (isspace(*p)) {
+    const unsigned char cls = char_class[(unsigned char)*p];
+    if (cls == CC_SPACE) {
       if (*p == '\n') {
         line_num++;
+        at_bol = true;
       }
+      has_space = true;
       ++p;
       continue;
     }
-    if (startsWith(p, ">>=") || startsWith(p, "<<=") || startsWith(p, "...")) {
-      cur = newToken(TK_RESERVED, cur, p, 3, line_num);
-      p += 3;
-      continue;
-    }
-    if (startsWith(p, "==") || startsWith(p, "!=") || startsWith(p, "<=") ||
-        startsWith(p, ">=") || startsWith(p, "->") || startsWith(p, "+=") ||
-        startsWith(p, "-=") || startsWith(p, "*=") || startsWith(p, "/=") ||
-        startsWith(p, "++") || startsWith(p, "--") || startsWith(p, "%=") ||
-        startsWith(p, "&=") || startsWith(p, "|=") || startsWith(p, "^=") ||
-        startsWith(p, "&&") || startsWith(p, "||") || startsWith(p, ">>") ||
-        startsWith(p, "<<")) {
-      cur = newToken(TK_RESERVED, cur, p, 2, line_num);
-      p += 2;
+    if (cls == CC_ALPHA) {
+      cur = newIdent(cur, &p, line_num);
       continue;
     }
-    if (isdigit(*p) || (*p == '.' && isdigit(p[1]))) {
+    if (cls == CC_DIGIT || (*p == '.' && isdigit(p[1]))) {
       const char *q = p;
       Type *ty = NULL;
       const long val = readIntLiteral(&p, &ty);
 
-      if (!strchr(".eEfF", *p)) {
+      if (!*p || !strchr(".eEfF", *p)) {
         cur = newToken(TK_NUM, cur, q, p - q, line_num);
         cur->ty = ty;
         cur->val = val;
@@ -233,49 +330,37 @@ void tokenise(const char *file_path) {
       cur->fval = fval;
       continue;
     }
-    if (strchr("+-*/()<>=;{}&,[].!~%|^:?", *p)) {
-      cur = newToken(TK_RESERVED, cur, p++, 1, line_num);
-      continue;
-    }
-    if (strncmp(p, "if", 2) == 0 && !isIdentChar(p[2])) {
-      cur = newToken(TK_IF, cur, p, 2, line_num);
-      p += 2;
-      continue;
-    }
-    if (strncmp(p, "else", 4) == 0 && !isIdentChar(p[4])) {
-      cur = newToken(TK_ELSE, cur, p, 4, line_num);
-      p += 4;
-      continue;
-    }
-    if (strncmp(p, "while", 5) == 0 && !isIdentChar(p[5])) {
-      cur = newToken(TK_WHILE, cur, p, 5, line_num);
-      p += 5;
-      continue;
-    }
-    if (strncmp(p, "for", 3) == 0 && !isIdentChar(p[3])) {
-      cur = newToken(TK_FOR, cur, p, 3, line_num);
-      p += 3;
+    if (*p == '/' && p[1] == '/') {
+      while (*p != '\n') {
+        p++;
+      }
+      has_space = true;
       continue;
     }
-    if (strncmp(p, "return", 6) == 0 && !isIdentChar(p[6])) {
-      cur = newToken(TK_RET, cur, p, 6, line_num);
-      p += 6;
+    if (*p == '/' && p[1] == '*') {
+      char *q = strstr(p + 2, "*/");
+      if (!q) {
+        compErrorToken(p, "unclosed block comment");
+      }
+      for (; p < q; p++) {
+        if (*p == '\n') {
+          line_num++;
+        }
+      }
+      p = q + 2;
+      has_space = true;
       continue;
     }
-    if (strncmp(p, "sizeof", 6) == 0 && !isIdentChar(p[6])) {
-      cur = newToken(TK_SIZEOF, cur, p, 6, line_num);
-      p += 6;
-      continue;
-    }
-    if (isIdentChar(*p) && !(*p >= '0' && *p <= '9')) {
-      cur = newIdent(cur, &p, line_num);
-      if (isKeyword(cur->str, cur->len)) {
-        cur->kind = TK_KWD;
-      }
+    if (cls == CC_PUNCT) {
+      const size_t len = punctLen(p);
+      cur = newToken(TK_RESERVED, cur, p, len, line_num);
+      p += len;
       continue;
     }
+    // String literals keep their spelling until preprocessing is done, so
+    // that they can be stringised and pasted.
     if (*p == '"') {
-      const char *start = ++p;
+      const char *start = p++;
       for (; *p != '"'; ++p) {
         if (*p == '\n' || *p == '\0') {
           compErrorToken(start, "unclosed string literal");
@@ -284,27 +369,8 @@ void tokenise(const char *file_path) {
           p++;
         }
       }
-      const size_t max_len = p - start + 1;
-      size_t len = 0;
-      if (cur->kind != TK_STR) {
-        cur = newToken(TK_STR, cur, start, max_len, line_num);
-        cur->str = calloc(1, max_len);
-      } else {
-        const char *temp = strndup(cur->str, cur->len);
-        cur->str = calloc(1, max_len + cur->len);
-        memcpy((void *)cur->str, temp, strlen(temp));
-        len = cur->len - 1;
-      }
-      for (const char *c = start; c != p;) {
-        if (*c == '\\') {
-          c++;
-          ((char *)cur->str)[len++] = (char)readEscapedChar(&c);
-        } else {
-          ((char *)cur->str)[len++] = *(c++);
-        }
-      }
-      cur->len = len + 1;
       p++;
+      cur = newToken(TK_STR, cur, start, p - start, line_num);
       continue;
     }
     if (*p == '\'') {
@@ -330,8 +396,70 @@ void tokenise(const char *file_path) {
     }
     compErrorToken(p, "invalid token");
   }
+  at_bol = true;
   newToken(TK_EOF, cur, p, 0, line_num);
-  token = head.next;
+  return head.next;
+}
+
+// Adjacent string literals are concatenated, and their escape sequences
+// decoded, once macro expansion can no longer produce new ones.
+void joinStrLits(Token *tok) {
+  for (Token *t = tok; t->kind != TK_EOF; t = t->next) {
+    if (t->kind != TK_STR) {
+      continue;
+    }
+    size_t max_len = 1;
+    for (Token *n = t; n->kind == TK_STR; n = n->next) {
+      max_len += n->len;
+    }
+    char *buf = arenaCalloc(&token_arena, 1, max_len);
+    size_t len = decodeStrLit(buf, t);
+    while (t->next->kind == TK_STR) {
+      len += decodeStrLit(buf + len, t->next);
+      t->next = t->next->next;
+    }
+    t->str = buf;
+    t->len = len + 1;
+  }
+}
+
+size_t decodeStrLit(char *buf, Token *tok) {
+  const char *end = tok->str + tok->len - 1;
+  size_t len = 0;
+  for (const char *c = tok->str + 1; c != end;) {
+    if (*c == '\\') {
+      c++;
+      buf[len++] = (char)readEscapedChar(&c);
+    } else {
+      buf[len++] = *(c++);
+    }
+  }
+  return len;
+}
+
+// Backslash-newline pairs are removed in place. The newlines are put back
+// after the logical line ends, so that line numbers stay correct.
+void removeLineContinuations(char *p) {
+  size_t i = 0;
+  size_t j = 0;
+  size_t cnt = 0;
+  while (p[i]) {
+    if (p[i] == '\\' && p[i + 1] == '\n') {
+      i += 2;
+      cnt++;
+    } else if (p[i] == '\n') {
+      p[j++] = p[i++];
+      for (; cnt > 0; cnt--) {
+        p[j++] = '\n';
+      }
+    } else {
+      p[j++] = p[i++];
+    }
+  }
+  for (; cnt > 0; cnt--) {
+    p[j++] = '\n';
+  }
+  p[j] = '\0';
 }
 
 Token *newIdent(Token *cur, const char **p, size_t line_num) {
@@ -340,11 +468,97 @@ Token *newIdent(Token *cur, const char **p, size_t line_num) {
     q++;
   }
   Token *tok = newToken(TK_IDENT, cur, *p, q - *p, line_num);
+  const size_t slot = findKeyword(tok->str, tok->len);
+  if (slot) {
+    tok->kwd = kwd_ids[slot - 1];
+    tok->kind = keywordKind(tok->kwd);
+    // Keywords may still be macro names, so they have interned names too.
+    if (!kwd_interned[slot - 1]) {
+      kwd_interned[slot - 1] = intern(tok->str, tok->len);
+    }
+    tok->name = kwd_interned[slot - 1];
+  } else {
+    tok->name = intern(tok->str, tok->len);
+  }
   *p = q;
   return tok;
 }
 
-bool isIdentChar(char c) { return isalnum(c) || c == '_'; }
+bool isIdentChar(char c) {
+  return char_class[(unsigned char)c] >= CC_DIGIT;
+}
+
+// Maximal munch over the punctuators, branching on one character at a time.
+size_t punctLen(const char *p) {
+  switch (*p) {
+  case '<':
+  case '>':
+    if (p[1] == *p) {
+      return p[2] == '=' ? 3 : 2;
+    }
+    return p[1] == '=' ? 2 : 1;
+  case '+':
+  case '&':
+  case '|':
+    return p[1] == *p || p[1] == '=' ? 2 : 1;
+  case '-':
+    return p[1] == '-' || p[1] == '=' || p[1] == '>' ? 2 : 1;
+  case '*':
+  case '/':
+  case '%':
+  case '^':
+  case '=':
+  case '!':
+    return p[1] == '=' ? 2 : 1;
+  case '.':
+    return p[1] == '.' && p[2] == '.' ? 3 : 1;
+  case '#':
+    return p[1] == '#' ? 2 : 1;
+  default:
+    return 1;
+  }
+}
+
+size_t keywordHash(const char *str, size_t len) {
+  return (2 * (size_t)str[0] + (size_t)str[1] + 7 * (size_t)str[len - 1] +
+          3 * len) &
+         127;
+}
+
+// Returns one plus the keyword's index in kwd_names, or 0.
+size_t findKeyword(const char *str, size_t len) {
+  if (len < 2 || len > 12) {
+    return 0;
+  }
+  const size_t slot = kwd_slots[keywordHash(str, len)];
+  if (!slot) {
+    return 0;
+  }
+  const char *name = kwd_names[slot - 1];
+  if (strncmp(name, str, len) != 0 || name[len] != '\0') {
+    return 0;
+  }
+  return slot;
+}
+
+TokenKind keywordKind(Keyword kwd) {
+  switch (kwd) {
+  case KW_ELSE:
+    return TK_ELSE;
+  case KW_FOR:
+    return TK_FOR;
+  case KW_IF:
+    return TK_IF;
+  case KW_RETURN:
+    return TK_RET;
+  case KW_SIZEOF:
+    return TK_SIZEOF;
+  case KW_WHILE:
+    return TK_WHILE;
+  default:
+    return TK_KWD;
+  }
+}
 
 int fromHex(char c) {
   if ('0' <= c && c <= '9') {
@@ -437,29 +651,12 @@ char *readFile(const char *file_path) {
             file_path, len, bytesRead);
     exit(EXIT_FAILURE);
   }
-  if (file_content[len - 1] != '\n') {
+  if (len == 0 || file_content[len - 1] != '\n') {
     file_content[len] = '\n';
   }
   return file_content;
 }
 
-bool isKeyword(const char *str, size_t len) {
-  static const char *kwds[] = {
-      "int",       "char",     "short",    "void",       "long",
-      "struct",    "union",    "typedef",  "_Bool",      "enum",
-      "static",    "goto",     "break",    "continue",   "switch",
-      "case",      "default",  "extern",   "_Alignas",   "_Alignof",
-      "do",        "signed",   "unsigned", "const",      "volatile",
-      "auto",      "register", "restrict", "__restrict", "__restrict__",
-      "_Noreturn", "float",    "double"};
-  for (size_t i = 0; i < sizeof(kwds) / sizeof(*kwds); ++i) {
-    if (strlen(kwds[i]) == len && strncmp(str, kwds[i], len) == 0) {
-      return true;
-    }
-  }
-  return false;
-}
-
 long readIntLiteral(const char **start, Type **ret_ty) {
   const char *p = *start;
   int base = 10;
@@ -532,27 +729,26 @@ long readIntLiteral(const char **start, Type **ret_ty) {
   return val;
 }
 
-bool consumeKwdMatch(const char *kwd) {
-  if (token->kind != TK_KWD || strlen(kwd) != token->len ||
-      memcmp(token->str, kwd, token->len) != 0) {
+bool consumeKwdMatch(Keyword kwd) {
+  if (token->kind != TK_KWD || token->kwd != kwd) {
     return false;
   }
   token = token->next;
   return true;
 }
 
-bool consumeGoto(void) { return consumeKwdMatch("goto"); }
+bool consumeGoto(void) { return consumeKwdMatch(KW_GOTO); }
 
-bool consumeDo(void) { return consumeKwdMatch("do"); }
+bool consumeDo(void) { return consumeKwdMatch(KW_DO); }
 
-bool consumeBreak(void) { return consumeKwdMatch("break"); }
+bool consumeBreak(void) { return consumeKwdMatch(KW_BREAK); }
 
-bool consumeCont(void) { return consumeKwdMatch("continue"); }
+bool consumeCont(void) { return consumeKwdMatch(KW_CONTINUE); }
 
-bool consumeSwitch(void) { return consumeKwdMatch("switch"); }
+bool consumeSwitch(void) { return consumeKwdMatch(KW_SWITCH); }
 
-bool consumeCase(void) { return consumeKwdMatch("case"); }
+bool consumeCase(void) { return consumeKwdMatch(KW_CASE); }
 
-bool consumeDefault(void) { return consumeKwdMatch("default"); }
+bool consumeDefault(void) { return consumeKwdMatch(KW_DEFAULT); }
 
-bool consumeAlignof(void) { return consumeKwdMatch("_Alignof"); }
+bool consumeAlignof(void) { return consumeKwdMatch(KW_ALIGNOF); }
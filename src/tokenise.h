@@ -4,6 +4,9 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "defs.h"
+
+typedef struct File File;
 typedef struct Token Token;
 
 Token *consumeIdent(void);
@@ -13,6 +16,8 @@ Token *consumeStrLit(void);
 Token *expectIdent(void);
 Token *expectKeyword(void);
 Token *expectNumber(void);
+Token *tokeniseFile(const char *file_path);
+Token *tokeniseString(const char *name, const char *text);
 bool consume(char *op);
 bool consumeAlignof(void);
 bool consumeBreak(void);
@@ -24,14 +29,16 @@ bool consumeElse(void);
 bool consumeFor(void);
 bool consumeGoto(void);
 bool consumeIf(void);
-bool consumeKwdMatch(const char *kwd);
+bool consumeKwdMatch(Keyword kwd);
 bool consumeReturn(void);
 bool consumeSizeof(void);
 bool consumeSwitch(void);
 bool consumeWhile(void);
+bool equal(Token *tok, const char *str);
 bool isEOF(void);
 void expect(char *op);
 void expectWhile(void);
+void joinStrLits(Token *tok);
 void tokenise(const char *file_path);
 
 #endif // TOKENISE_H
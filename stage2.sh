@@ -40,6 +40,23 @@ printf "%s\n" \
 "" \
 "typedef __va_elem va_list[1];" \
 "" \
+"struct timespec {" \
+"  long tv_sec;" \
+"  long tv_nsec;" \
+"};" \
+"" \
+"struct timeval {" \
+"  long tv_sec;" \
+"  long tv_usec;" \
+"};" \
+"" \
+"struct rusage {" \
+"  struct timeval ru_utime;" \
+"  struct timeval ru_stime;" \
+"  long ru_maxrss;" \
+"  long _[13];" \
+"};" \
+"" \
 "struct stat {" \
 "  char _[512];" \
 "};" \
@@ -72,6 +89,7 @@ printf "%s\n" \
 "long strlen(char *p);" \
 "int strncmp(char *p, char *q, long n);" \
 "void *memcpy(char *dst, char *src, long n);" \
+"void *memset(void *s, int c, long n);" \
 "char *strdup(char *p);" \
 "char *strndup(char *p, long n);" \
 "int isspace(int c);" \
@@ -80,8 +98,14 @@ printf "%s\n" \
 "int isxdigit(int c);" \
 "char *strstr(char *haystack, char *needle);" \
 "char *strchr(char *s, int c);" \
+"void *memchr(void *s, int c, long n);" \
 "double strtod(char *nptr, char **endptr);" \
 "static void va_end(va_list ap) {}" \
+"static long __va_arg_gp(__va_elem *ap) {" \
+"  long *p = (long *)((char *)ap->reg_save_area + ap->gp_offset);" \
+"  ap->gp_offset = ap->gp_offset + 8;" \
+"  return *p;" \
+"}" \
 "long strtoul(char *nptr, char **endptr, int base);" \
 "int getopt_long (int argc, char* argv[], const char * opts, struct option *lopts, int *lind);" \
 "char *strncpy (char *dst, const char *src, size_t n);" \
@@ -92,17 +116,40 @@ printf "%s\n" \
 "int fork (void);" \
 "int execvp (const char *__file, char *const __argv[]);" \
 "int wait (int *__stat_loc);" \
+"int waitpid (int __pid, int *__stat_loc, int __options);" \
+"int pipe (int *__pipedes);" \
+"int dup2 (int __fd, int __fd2);" \
+"FILE *tmpfile (void);" \
+"int fileno (FILE *__stream);" \
+"FILE *fdopen (int __fd, const char *__modes);" \
+"int kill (int __pid, int __sig);" \
+"int clock_gettime (int __clock_id, struct timespec *__tp);" \
+"int getrusage (int __who, struct rusage *__usage);" \
+"int getpid (void);" \
+"long readlink (const char *__path, char *__buf, size_t __len);" \
+"char *realpath (const char *__name, char *__resolved);" \
 "int isalnum(int c);" \
 "int fseek(FILE *stream, long offset, int origin);" \
 "long int ftell (FILE *__stream);" \
+"char *getcwd (char *__buf, size_t __size);" \
 "void free (void *__ptr);" \
 "void exit(int code);" > $OUTPUT_FILE
 
-for f in $@; do
-  LCL_INC=$(sed -n 's/^#include "\(.*\)"$/\1/p' $f)
-  for inc in $LCL_INC; do
-    cat $(dirname $OUTPUT_FILE)/$inc >> $OUTPUT_FILE
+# Local headers are pasted in once each, after the headers they include.
+declare -A SEEN
+addHeaders() {
+  local inc
+  for inc in $(sed -n 's/^#include "\(.*\)"$/\1/p' $1); do
+    if [ -z "${SEEN[$inc]:-}" ]; then
+      SEEN[$inc]=1
+      addHeaders $(dirname $OUTPUT_FILE)/$inc
+      cat $(dirname $OUTPUT_FILE)/$inc >> $OUTPUT_FILE
+    fi
   done
+}
+
+for f in $@; do
+  addHeaders $f
   cat $f >> $OUTPUT_FILE
 done
 
@@ -112,8 +159,16 @@ sed -i 's/EXIT_FAILURE/1/g' $OUTPUT_FILE
 sed -i 's/SEEK_SET/0/g' $OUTPUT_FILE
 sed -i 's/SEEK_CUR/1/g' $OUTPUT_FILE
 sed -i 's/SEEK_END/2/g' $OUTPUT_FILE
+sed -i 's/STDIN_FILENO/0/g' $OUTPUT_FILE
+sed -i 's/STDERR_FILENO/2/g' $OUTPUT_FILE
+sed -i 's/CLOCK_MONOTONIC/1/g' $OUTPUT_FILE
+sed -i 's/CLOCK_PROCESS_CPUTIME_ID/2/g' $OUTPUT_FILE
+sed -i 's/RUSAGE_CHILDREN/-1/g' $OUTPUT_FILE
+sed -i 's/RUSAGE_SELF/0/g' $OUTPUT_FILE
+sed -i 's/SIGKILL/9/g' $OUTPUT_FILE
 sed -i 's/no_argument/0/g' $OUTPUT_FILE
 sed -i 's/required_argument/1/g' $OUTPUT_FILE
+sed -i 's/optional_argument/2/g' $OUTPUT_FILE
 sed -i '/^#define \(COMP_ERR_BODY\|MIN\)/! s/^\s*#.*//g' $OUTPUT_FILE
 sed -i 's/"\n\s*"//g' $OUTPUT_FILE
 sed -i 's/\bbool\b/_Bool/g' $OUTPUT_FILE
@@ -122,5 +177,6 @@ sed -i 's/\btrue\b/1/g' $OUTPUT_FILE
 sed -i 's/\bfalse\b/0/g' $OUTPUT_FILE
 sed -i 's/\bNULL\b/0/g' $OUTPUT_FILE
 sed -i 's/\bva_start(\([^)]*\),\([^)]*\))/*(\1)=*(__va_elem*)__va_area__/g' $OUTPUT_FILE
+sed -i 's/\bva_arg(\([^,]*\), *\([^)]*\))/((\2)__va_arg_gp(\1))/g' $OUTPUT_FILE
 sed -i 's/\bunreachable\(\)/error("unreachable")/g' $OUTPUT_FILE
 sed -i 's/\bMIN\(([^)]*),([^)]*)\)/((\\1)<(\\2)?(\\1):(\\2))/g' $OUTPUT_FILE
@@ -1,5 +1,8 @@
 #include "test.h"
 
+int g_sum;
+char g_chars[4];
+
 int main() {
   ASSERT(0, 0);
   ASSERT(42, 42);
@@ -63,6 +66,26 @@ int main() {
   ASSERT(2, ({ int a[3]; a[0]=0; a[1]=1; a[2]=2; int *p=a+1; (*p++)--; a[2]; }));
   ASSERT(2, ({ int a[3]; a[0]=0; a[1]=1; a[2]=2; int *p=a+1; (*p++)--; *p; }));
 
+  ASSERT(44, ({ char c=100; char *p=&c; c+=200; *p; }));
+  ASSERT(-56, ({ char c=100; char *p=&c; c+=100; }));
+  ASSERT(255, ({ unsigned char c=0; unsigned char *p=&c; c--; *p; }));
+  ASSERT(-1, ({ short s=0; short *p=&s; s-=1; }));
+  ASSERT(1, ({ long l=1; long *p=&l; l+=4294967296; l==4294967297; }));
+  ASSERT(12, ({ int a[3]={1,2,3}; int i=1; a[i]+=10; a[1]; }));
+  ASSERT(7, ({ int a[3]={1,2,3}; int i=0; a[i++]+=5; a[0]+i; }));
+  ASSERT(3, ({ int a[3]={1,2,3}; int *p=a; int **q=&p; p+=2; **q; }));
+  ASSERT(10, ({ struct {int a; long b;} s={1,2}; s.b+=8; s.b; }));
+  ASSERT(6, ({ struct {char a; int b;} s={3,5}; s.a^=5; s.a; }));
+  ASSERT(12, ({ int x=15; int *p=&x; x&=12; }));
+  ASSERT(1, ({ _Bool b=0; _Bool *p=&b; b+=2; }));
+  ASSERT(24, ({ int x=3; int *p=&x; x<<=3; }));
+  ASSERT(5, ({ double d=2.5; double *p=&d; d*=2; (int)d; }));
+  ASSERT(4, ({ int x=5; int *p=&x; x=x-1; }));
+  ASSERT(9, ({ int a[2]={4,0}; int i=0; a[i]=a[i]+5; a[0]; }));
+  ASSERT(7, ({ g_sum=5; g_sum+=2; g_sum; }));
+  ASSERT(3, ({ g_sum=0; for (int i=0; i<3; i++) g_sum++; g_sum; }));
+  ASSERT(-2, ({ g_chars[1]=126; g_chars[1]+=128; }));
+
   ASSERT(0, !1);
   ASSERT(0, !2);
   ASSERT(1, !0);
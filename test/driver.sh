@@ -0,0 +1,141 @@
+#!/bin/bash
+# Checks ucc's command-line behaviour and diagnostic output, which the test/*.c
+# programs cannot observe. Inputs live in test/driver, and each check compares
+# what ucc writes against the expected file or figures next to them.
+#
+# usage: driver.sh <ucc>
+
+set -euo pipefail
+
+if [ $# -ne 1 ]; then
+  echo "usage: $0 <ucc>" >&2
+  exit 1
+fi
+
+ucc=$(realpath "$1")
+cc=${CC:-cc}
+dir=$(dirname "$0")/driver
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+export ASAN_OPTIONS=detect_leaks=0
+
+fail() {
+  echo "FAIL: $*" >&2
+  exit 1
+}
+
+# The IR after folding and compound assignment lowering.
+checkEmitIr() {
+  "$ucc" --emit-ir -o "$tmp/ir.ir" "$dir/ir.c"
+  diff -u "$dir/ir.ir" "$tmp/ir.ir" || fail "--emit-ir output differs"
+  echo "emit-ir => OK"
+}
+
+# Every rule on test/driver/peephole.s, through a harness linked against the
+# optimiser itself, including the rewrites that must not happen: a 32-bit self
+# move zero-extends, a label between a move and its move back may be jumped to,
+# a move back through memory other than a stack slot may alias, and a repeated
+# load may read from an address the first one changed.
+checkPeephole() {
+  local src
+  src=$(dirname "$0")/../src
+  "$cc" -I"$src" -o "$tmp/peephole" "$dir/peephole.c" "$src/emit.c" \
+    "$src/peephole.c" "$src/arena.c"
+  "$tmp/peephole" >"$tmp/peephole.out" 2>&1
+  diff -u "$dir/peephole.expected" "$tmp/peephole.out" ||
+    fail "peephole output differs"
+  echo "peephole => OK"
+}
+
+# --peephole-stats on a real compilation reports the rules that fired.
+checkPeepholeStats() {
+  "$ucc" --peephole-stats -c -o "$tmp/zero.o" "$dir/zero.c" 2>"$tmp/stats"
+  awk '$1 == "cmp-zero" && $2 >= 1 { hit = 1 }
+    $1 == "total" && $2 >= 1 { total = 1 }
+    END { exit !(hit && total) }' "$tmp/stats" ||
+    fail "--peephole-stats: $(cat "$tmp/stats")"
+  echo "peephole-stats => OK"
+}
+
+# Locals of sibling blocks share stack slots, as --ftime-report and the frame
+# of the function both show.
+checkSlotSharing() {
+  "$ucc" --ftime-report -S -o "$tmp/slots.s" "$dir/slots.c" 2>"$tmp/report"
+  grep -q "^frame bytes for locals  *64$" "$tmp/report" ||
+    fail "frame bytes for locals: $(grep frame "$tmp/report")"
+  grep -q "^frame bytes saved  *64$" "$tmp/report" ||
+    fail "frame bytes saved: $(grep frame "$tmp/report")"
+  grep -q "^  sub rsp, 64$" "$tmp/slots.s" ||
+    fail "frame size: $(grep "rsp" "$tmp/slots.s")"
+  echo "slot-sharing => OK"
+}
+
+# Several files compiled at once, one with an error: the error is reported
+# once, as a serial build reports it, the good files are still compiled, and
+# ucc fails.
+checkParallelFiles() {
+  mkdir "$tmp/jobs"
+  cp "$dir/good.c" "$dir/bad.c" "$tmp/jobs"
+  cp "$dir/good.c" "$tmp/jobs/good2.c"
+  local rc=0
+  (cd "$tmp/jobs" && "$ucc" -c good.c bad.c good2.c) 2>"$tmp/serial" || true
+  (cd "$tmp/jobs" && rm -f good.o good2.o &&
+    "$ucc" -j2 -c good.c bad.c good2.c) 2>"$tmp/parallel" || rc=$?
+  [ "$rc" -ne 0 ] || fail "-j2 with an error exited with 0"
+  [ "$(grep -c "undefined variable" "$tmp/parallel")" -eq 1 ] ||
+    fail "-j2 error reported $(grep -c "undefined variable" "$tmp/parallel") times"
+  diff -u "$tmp/serial" "$tmp/parallel" || fail "-j2 diagnostics differ"
+  [ -f "$tmp/jobs/good.o" ] && [ -f "$tmp/jobs/good2.o" ] ||
+    fail "-j2 did not compile the good files"
+  echo "parallel-files => OK"
+}
+
+# The IR register allocator: all locals of test/driver/regalloc.c are virtual
+# registers, and those live across the call that do not fit in the
+# callee-saved registers are spilled.
+checkRegalloc() {
+  "$ucc" --emit-ir -o "$tmp/regalloc.ir" "$dir/regalloc.c"
+  [ "$(grep -c "^  ; v[0-9]* = [a-z]$" "$tmp/regalloc.ir")" -eq 14 ] ||
+    fail "locals not promoted: $(grep "^  ;" "$tmp/regalloc.ir")"
+  "$ucc" -S -o "$tmp/regalloc.s" "$dir/regalloc.c"
+  [ "$(grep -c "^  mov \[rbp-[0-9]*\], \(rbx\|r1[2-5]\)$" \
+    "$tmp/regalloc.s")" -eq 5 ] || fail "callee-saved registers not used"
+  [ "$(grep -c "^  mov \[rbp-[0-9]*\], rax$" "$tmp/regalloc.s")" -eq 7 ] ||
+    fail "spills: $(grep "^  mov \[rbp" "$tmp/regalloc.s")"
+  echo "regalloc => OK"
+}
+
+checkRodata() {
+  "$ucc" -c -o "$tmp/rodata.o" "$dir/rodata.c"
+  objdump -t "$tmp/rodata.o" >"$tmp/rodata.syms"
+  grep -q " \.rodata\s.* table$" "$tmp/rodata.syms" ||
+    fail "const table: $(grep table "$tmp/rodata.syms")"
+  grep -q " \.data\s.* names$" "$tmp/rodata.syms" ||
+    fail "const pointers: $(grep names "$tmp/rodata.syms")"
+  grep -q " \.data\s.* counter$" "$tmp/rodata.syms" ||
+    fail "writable data: $(grep counter "$tmp/rodata.syms")"
+  objdump -s -j .rodata.str1.1 "$tmp/rodata.o" | grep -q "many" ||
+    fail "strings not mergeable"
+  echo "rodata => OK"
+}
+
+checkParallelCodegen() {
+  local src=$dir/../function.c
+  "$ucc" --emit-stats --peephole-stats --ftime-report -S -o "$tmp/gen1.s" \
+    "$src" 2>&1 | grep -v "^[a-z]* *[0-9.]* *[0-9.]* *[0-9]*$" >"$tmp/gen1"
+  "$ucc" --codegen-jobs 3 --emit-stats --peephole-stats --ftime-report \
+    -S -o "$tmp/gen3.s" "$src" 2>&1 |
+    grep -v "^[a-z]* *[0-9.]* *[0-9.]* *[0-9]*$" >"$tmp/gen3"
+  cmp -s "$tmp/gen1.s" "$tmp/gen3.s" || fail "--codegen-jobs output differs"
+  diff -u "$tmp/gen1" "$tmp/gen3" || fail "--codegen-jobs statistics differ"
+  echo "parallel-codegen => OK"
+}
+
+checkEmitIr
+checkPeephole
+checkPeepholeStats
+checkSlotSharing
+checkParallelFiles
+checkRegalloc
+checkRodata
+checkParallelCodegen
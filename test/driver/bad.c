@@ -0,0 +1,3 @@
+int two(void) {
+  return undefined_name;
+}
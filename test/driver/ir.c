@@ -0,0 +1,10 @@
+int g;
+
+// Folded down to one immediate.
+int fold(void) { return (1 << 4) + 2 * 3 - 1; }
+
+// Each compound assignment is one read-modify-write instruction.
+void bump(int *p, int n) {
+  g += n;
+  *p -= 3;
+}
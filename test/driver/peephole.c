@@ -0,0 +1,63 @@
+// Emits a function body through the same calls the code generator uses, runs
+// the peephole optimiser over it as emitEndFunc() does, and prints the lines
+// that survive followed by the rule hit counts.
+#include <stdio.h>
+
+#include "defs.h"
+#include "emit.h"
+#include "peephole.h"
+
+FILE *output;
+
+int main(void) {
+  output = stdout;
+  PeepOperand slot = slotOperand(REG_RBP, -8, 0);
+  PeepOperand rax = regOperand(REG_RAX, 8);
+  PeepOperand rbp = regOperand(REG_RBP, 8);
+  PeepOperand xmm0 = regOperand(REG_XMM0, 16);
+  PeepOperand dword = slotOperand(REG_RBP, -4, 4);
+  PeepOperand zero = immOperand(0);
+
+  emitBeginFunc();
+  emitLabel("f");
+  emitJumpTo(OPC_JMP, ".L.a");
+  emitLabel(".L.a");
+  emitJumpTo(OPC_JE, ".L.b");
+  emitLoc(1, 2);
+  emitLabel(".L.b");
+  emitJumpTo(OPC_JNE, ".L.a");
+  println("  nop");
+  emitLabel(".L.c");
+  emitRegs(OPC_MOV, REG_RAX, 8, REG_RAX, 8);
+  emitRegs(OPC_MOVAPS, REG_XMM1, 16, REG_XMM1, 16);
+  emitRegs(OPC_MOV, REG_RAX, 4, REG_RAX, 4);
+  emitRegs(OPC_MOV, REG_R12, 8, REG_RAX, 8);
+  emitRegs(OPC_MOV, REG_RAX, 8, REG_R12, 8);
+  emitOp(OPC_MOV, &slot, &rax);
+  emitLoc(1, 3);
+  emitOp(OPC_MOV, &rax, &slot);
+  emitRegs(OPC_MOV, REG_R13, 8, REG_RAX, 8);
+  emitLabel(".L.d");
+  emitRegs(OPC_MOV, REG_RAX, 8, REG_R13, 8);
+  emitRegs(OPC_MOV, REG_RBX, 4, REG_RAX, 4);
+  emitRegs(OPC_MOV, REG_RAX, 4, REG_RBX, 4);
+  emitOp(OPC_MOV, &rbp, &slot);
+  emitOp(OPC_MOV, &slot, &rbp);
+  emitOp(OPC_MOVSD, &xmm0, &slot);
+  emitOp(OPC_MOVSD, &slot, &xmm0);
+  emitRegImm(OPC_CMP, REG_RAX, 4, 0);
+  emitOp(OPC_CMP, &dword, &zero);
+  emitRegImm(OPC_CMP, REG_RAX, 4, 1);
+  emitRegs(OPC_MOVZX, REG_RAX, 4, REG_RAX, 1);
+  emitRegs(OPC_MOVSXD, REG_RAX, 8, REG_RAX, 4);
+  emitRegs(OPC_MOVSX, REG_RAX, 4, REG_RAX, 1);
+  emitRegs(OPC_MOVSX, REG_RAX, 4, REG_RAX, 1);
+  println("  movzx eax, BYTE PTR [rax]");
+  println("  movzx eax, BYTE PTR [rax]");
+  println("  ret");
+  emitEndFunc();
+
+  emitFlush();
+  printPeepholeStats();
+  return 0;
+}
@@ -0,0 +1,11 @@
+int id(int x);
+
+// Every local is promoted to a virtual register. Five of the twelve values
+// live across the call take the callee-saved registers and the other seven
+// are spilled.
+int spill(int n) {
+  int a = n + 1, b = n + 2, c = n + 3, d = n + 4, e = n + 5, f = n + 6;
+  int g = n + 7, h = n + 8, i = n + 9, j = n + 10, k = n + 11, l = n + 12;
+  int z = id(n);
+  return a + b + c + d + e + f + g + h + i + j + k + l + z;
+}
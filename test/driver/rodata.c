@@ -0,0 +1,5 @@
+const int table[4] = {1, 2, 3, 4};
+const char *const names[2] = {"one", "two"};
+int counter = 1;
+
+const char *name(int i) { return i < 2 ? names[i] : "many"; }
@@ -0,0 +1,12 @@
+void use(char *p);
+
+// The arrays of the two branches share one 64-byte slot.
+void branches(int x) {
+  if (x) {
+    char a[64];
+    use(a);
+  } else {
+    char b[64];
+    use(b);
+  }
+}
@@ -0,0 +1,6 @@
+// The comparison with zero becomes `test`.
+int isZero(int x) {
+  if (x == 0)
+    return 1;
+  return 2;
+}
@@ -0,0 +1,95 @@
+#include "test.h"
+
+int div8(int x) { return x / 8; }
+int mod8(int x) { return x % 8; }
+long ldiv4(long x) { return x / 4; }
+long lmod4(long x) { return x % 4; }
+unsigned udiv16(unsigned x) { return x / 16; }
+unsigned umod16(unsigned x) { return x % 16; }
+int mul8(int x) { return x * 8 + (3 << 2); }
+
+int dead_label(int x) {
+  if (0) {
+  skip:
+    return x + 100;
+  }
+  if (x < 0) {
+    x = -x;
+    goto skip;
+  }
+  return x;
+}
+
+int duff(int n) {
+  int cnt = 0;
+  switch (n) {
+  case 0:
+    if (0) {
+    case 1:
+      cnt = cnt + 10;
+    }
+    cnt = cnt + 1;
+  }
+  return cnt;
+}
+
+int calls = 0;
+int side(void) {
+  calls = calls + 1;
+  return calls;
+}
+
+int main() {
+  ASSERT(0, div8(-7));
+  ASSERT(-1, div8(-8));
+  ASSERT(-1, div8(-9));
+  ASSERT(12, div8(100));
+  ASSERT(-7, mod8(-7));
+  ASSERT(0, mod8(-8));
+  ASSERT(-1, mod8(-9));
+  ASSERT(4, mod8(100));
+  ASSERT(-2, ldiv4(-9));
+  ASSERT(-1, lmod4(-9));
+  ASSERT(2, ldiv4(11));
+  ASSERT(3, lmod4(11));
+  ASSERT(268435455, udiv16(-1));
+  ASSERT(15, umod16(-1));
+  ASSERT(52, mul8(5));
+  ASSERT(-28, mul8(-5));
+  ASSERT(5, dead_label(5));
+  ASSERT(105, dead_label(-5));
+  ASSERT(1, duff(0));
+  ASSERT(11, duff(1));
+  ASSERT(0, duff(2));
+
+  ASSERT(-2147483648, 2147483647 + 1);
+  ASSERT(0, 4294967295U + 1 == 0 ? 0 : 1);
+  ASSERT(1, (unsigned)-1 / 2 == 2147483647);
+  ASSERT(1, (char)300 == 44);
+  ASSERT(1, (_Bool)0.5);
+  ASSERT(1, 1.5 < 1.7);
+  ASSERT(0, 1.7 <= 1.5);
+  ASSERT(1, 0.5 && 2);
+  ASSERT(0, !0.5);
+  ASSERT(1, (double)18446744073709551615UL > 0);
+  ASSERT(7, (int)(7.9f));
+  ASSERT(3, 1 ? 3 : side());
+  ASSERT(0, calls);
+  ASSERT(0, 0 && side());
+  ASSERT(1, 1 || side());
+  ASSERT(0, calls);
+  ASSERT(1, 1 && side());
+  ASSERT(1, calls);
+  ASSERT(2, side() * 1);
+  ASSERT(3, side() + 0);
+  ASSERT(0, side() * 0);
+  ASSERT(4, calls);
+  ASSERT(5, ({ int x = 5; x | 0; }));
+  ASSERT(5, ({ int x = 5; x & -1; }));
+  ASSERT(5, ({ int x = 5; x << 0; }));
+  ASSERT(20, ({ int x = 5; 4 * x; }));
+  ASSERT(1, ({ int x = -5; x % 1 == 0; }));
+
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,6 @@
+#ifndef GUARDED_H
+#define GUARDED_H
+
+int guarded = 2;
+
+#endif
@@ -0,0 +1,92 @@
+#include "test.h"
+#include "inc/once.h"
+#include "./inc/once.h"
+#include "inc/guarded.h"
+#include "inc/../inc/guarded.h"
+#include <float.h>
+#include <stdalign.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+  char c;
+  int i;
+  long l;
+} Fields;
+
+int sumInts(int n, ...) {
+  va_list ap;
+  va_start(ap, n);
+  int sum = 0;
+  for (int i = 0; i < n; i++)
+    sum += va_arg(ap, int);
+  va_end(ap);
+  return sum;
+}
+
+double sumMixed(int n, ...) {
+  va_list ap;
+  va_start(ap, n);
+  double sum = 0;
+  for (int i = 0; i < n; i++) {
+    sum += va_arg(ap, int);
+    sum += va_arg(ap, double);
+  }
+  va_end(ap);
+  return sum;
+}
+
+int lastLen(int n, ...) {
+  va_list ap, copy;
+  va_start(ap, n);
+  va_copy(copy, ap);
+  char *s;
+  for (int i = 0; i < n; i++)
+    s = va_arg(copy, char *);
+  va_end(copy);
+  va_end(ap);
+  return strcmp(s, "three") == 0;
+}
+
+int main() {
+  ASSERT(1, onced);
+  ASSERT(2, guarded);
+
+  ASSERT(1, true);
+  ASSERT(0, false);
+  ASSERT(1, ({ bool b = 7; b; }));
+  ASSERT(1, __bool_true_false_are_defined);
+
+  ASSERT(1, NULL == 0);
+  ASSERT(8, sizeof(size_t));
+  ASSERT(8, sizeof(ptrdiff_t));
+  ASSERT(0, offsetof(Fields, c));
+  ASSERT(4, offsetof(Fields, i));
+  ASSERT(8, offsetof(Fields, l));
+
+  ASSERT(4, sizeof(int32_t));
+  ASSERT(8, sizeof(uint64_t));
+  ASSERT(1, INT32_MAX == 2147483647);
+  ASSERT(255, UINT8_MAX);
+  ASSERT(1, ({ intptr_t p = (intptr_t)&p; p != 0; }));
+
+  ASSERT(8, alignof(long));
+  ASSERT(16, ({ alignas(16) char x, y; &y-&x; }));
+
+  ASSERT(10, sumInts(4, 1, 2, 3, 4));
+  ASSERT(13, (int)(sumMixed(2, 1, 2.5, 3, 6.5)));
+  ASSERT(1, lastLen(3, "one", "two", "three"));
+
+  ASSERT(24, FLT_MANT_DIG);
+  ASSERT(53, DBL_MANT_DIG);
+  ASSERT(1, 1.0f + FLT_EPSILON != 1.0f);
+  ASSERT(1, 1.0 + DBL_EPSILON != 1.0);
+  ASSERT(1, 1.0 + DBL_EPSILON / 2 == 1.0);
+  ASSERT(1, DBL_MAX > 1e308);
+  ASSERT(1, FLT_MIN > 0);
+
+  printf("OK\n");
+  return 0;
+}
@@ -36,6 +36,12 @@ typedef struct { char a, b[]; } T65;
 T65 g65 = {'f','o','o',0};
 T65 g66 = {'f','o','o','b','a','r',0};
 
+int g70[100] = {1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2};
+char g71[] = "a\"b\\c\td\n\001e";
+long g72[3] = {-1, 0x0102030405060708, -2};
+int g73[4] = {};
+struct {char a[3]; char *b; int c[20];} g74 = {"xy", g17, {0, 7}};
+
 int main() {
   ASSERT(1, ({ int x[3]={1,2,3}; x[0]; }));
   ASSERT(2, ({ int x[3]={1,2,3}; x[1]; }));
@@ -181,6 +187,34 @@ int main() {
   ASSERT(0, strcmp(g65.b, "oo"));
   ASSERT(0, strcmp(g66.b, "oobar"));
 
+  ASSERT(1, g70[0]);
+  ASSERT(0, g70[1]);
+  ASSERT(2, g70[16]);
+  ASSERT(0, g70[99]);
+  ASSERT(11, sizeof(g71));
+  ASSERT('"', g71[1]);
+  ASSERT('\\', g71[3]);
+  ASSERT('\t', g71[5]);
+  ASSERT('\n', g71[7]);
+  ASSERT(1, g71[8]);
+  ASSERT('e', g71[9]);
+  ASSERT(-1, g72[0]);
+  ASSERT(8, g72[1] & 0xff);
+  ASSERT(1, g72[1] >> 56);
+  ASSERT(-2, g72[2]);
+  ASSERT(0, g73[3]);
+  ASSERT(0, strcmp(g74.a, "xy"));
+  ASSERT('f', g74.b[0]);
+  ASSERT(7, g74.c[1]);
+  ASSERT(0, g74.c[19]);
+
+  ASSERT(0, ({ char x[37]={1}; x[36]; }));
+  ASSERT(0, ({ char x[37]={1}; x[15]+x[16]+x[31]+x[32]+x[35]; }));
+  ASSERT(0, ({ long x[40]={1}; x[39]; }));
+  ASSERT(3, ({ struct {char a; short b; int c; long d;} x={1,2}; x.a+x.b+x.c+x.d; }));
+  ASSERT(6, ({ struct {int a; int b[2];} x={1,{2,3}}; x.a+x.b[0]+x.b[1]; }));
+  ASSERT(0, ({ struct {char a; long b;} x={1,2}; struct {char a; long b;} y={1,2}; memcmp(&x, &y, sizeof(x)); }));
+
   printf("OK\n");
   return 0;
 }
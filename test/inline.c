@@ -0,0 +1,124 @@
+#include "test.h"
+
+typedef struct {
+  int x;
+  int y;
+} Point;
+
+static int get_x(Point *p) { return p->x; }
+static void set_y(Point *p, int y) { p->y = y; }
+static int twice(int x) { return x + x; }
+static char narrow(int x) { return x; }
+static _Bool truth(int x) { return x; }
+static double half(double x) { return x / 2; }
+static int quad(int x) { return twice(twice(x)); }
+static int local_addr(int x) {
+  int y = x;
+  int *p = &y;
+  *p = *p + 1;
+  return y;
+}
+
+static int early(int x) {
+  if (x < 0)
+    return -1;
+  if (x == 0)
+    return 0;
+  return 1;
+}
+
+static int sum_to(int n) {
+  int s = 0;
+  for (int i = 0; i < n; i++) {
+    if (i == 5)
+      continue;
+    if (i > 50)
+      break;
+    s += i;
+  }
+  return s;
+}
+
+static int classify(int x) {
+  switch (x) {
+  case 1:
+    return 10;
+  case 2:
+  case 3:
+    return 20;
+  default:
+    switch (x & 1) {
+    case 0:
+      return 30;
+    }
+    return 40;
+  }
+}
+
+static int with_goto(int x) {
+  int n = 0;
+again:
+  n++;
+  if (--x > 0)
+    goto again;
+  return n;
+}
+
+static int counter(void) {
+  static int cnt = 0;
+  return ++cnt;
+}
+
+static int fact(int n) { return n <= 1 ? 1 : n * fact(n - 1); }
+
+static int single_use(int a, int b, int c) {
+  int arr[4] = {a, b, c, 0};
+  int s = 0;
+  for (int i = 0; i < 4; i++) {
+    s = s * 10 + arr[i];
+  }
+  return s;
+}
+
+static int by_pointer(int x) { return x * 3; }
+
+static int add_all(int a, int b, int c, int d, int e, int f, int g) {
+  return a + b + c + d + e + f + g;
+}
+
+int main() {
+  Point pt = {3, 4};
+  ASSERT(3, get_x(&pt));
+  set_y(&pt, 9);
+  ASSERT(9, pt.y);
+  ASSERT(14, twice(7));
+  ASSERT(14, twice(twice(3)) + 2);
+  ASSERT(-56, narrow(200));
+  ASSERT(1, truth(256));
+  ASSERT(0, truth(0));
+  ASSERT(5, (int)(half(10.0) + 0.5));
+  ASSERT(20, quad(5));
+  ASSERT(8, local_addr(7));
+  ASSERT(-1, early(-5));
+  ASSERT(0, early(0));
+  ASSERT(1, early(9));
+  ASSERT(40, sum_to(10));
+  ASSERT(40, sum_to(10) + sum_to(0));
+  ASSERT(10, classify(1));
+  ASSERT(20, classify(3));
+  ASSERT(30, classify(8));
+  ASSERT(40, classify(9));
+  ASSERT(4, with_goto(4));
+  ASSERT(1, with_goto(0));
+  ASSERT(1, counter());
+  ASSERT(2, counter());
+  ASSERT(120, fact(5));
+  ASSERT(1230, single_use(1, 2, 3));
+  ASSERT(12, by_pointer(4));
+  ASSERT(1, ({ void *p = by_pointer; p != 0; }));
+  ASSERT(28, add_all(1, 2, 3, 4, 5, 6, 7));
+  ASSERT(6, ({ int i = 1; int a = twice(i++); a + twice(i); }));
+
+  printf("OK\n");
+  return 0;
+}
@@ -3,12 +3,12 @@
 int main() {
   ASSERT(3, ({ int x=3; *&x; }));
   ASSERT(3, ({ int x=3; int *y=&x; int **z=&y; **z; }));
-  ASSERT(5, ({ int x=3; int y=5; *(&x+1); }));
-  ASSERT(3, ({ int x=3; int y=5; *(&y-1); }));
-  ASSERT(5, ({ int x=3; int y=5; *(&x-(-1)); }));
+  ASSERT(5, ({ int x=3; int y=5; (void)&y; *(&x+1); }));
+  ASSERT(3, ({ int x=3; int y=5; (void)&x; *(&y-1); }));
+  ASSERT(5, ({ int x=3; int y=5; (void)&y; *(&x-(-1)); }));
   ASSERT(5, ({ int x=3; int *y=&x; *y=5; x; }));
-  ASSERT(7, ({ int x=3; int y=5; *(&x+1)=7; y; }));
-  ASSERT(7, ({ int x=3; int y=5; *(&y-2+1)=7; x; }));
+  ASSERT(7, ({ int x=3; int y=5; (void)&y; *(&x+1)=7; y; }));
+  ASSERT(7, ({ int x=3; int y=5; (void)&x; *(&y-2+1)=7; x; }));
   ASSERT(5, ({ int x=3; (&x+2)-&x+3; }));
   ASSERT(8, ({ int x, y; x=3; y=5; x+y; }));
   ASSERT(8, ({ int x=3, y=5; x+y; }));
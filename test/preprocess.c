@@ -0,0 +1,81 @@
+#include "test.h"
+#include "test.h"
+
+#define M1 3
+#define M2() 4
+#define ADD(x, y) ((x) + (y))
+#define STR(x) #x
+#define KEEP(x) (x, #x)
+#define CAT(x, y) x##y
+#define VA(fmt, ...) sprintf(buf, fmt, ##__VA_ARGS__)
+#define SELF SELF
+#define ONCE_ONLY
+
+#if defined(M1) && M1 == 3
+int m1_defined = 1;
+#elif M1
+int m1_defined = 2;
+#else
+int m1_defined = 3;
+#endif
+
+#ifdef UNDEFINED_MACRO
+#error "must not be reached"
+#endif
+
+#undef ONCE_ONLY
+#ifndef ONCE_ONLY
+int undef_works = 1;
+#endif
+
+#if 0
+#if 1
+int skipped = 1;
+#endif
+#else
+int skipped = 0;
+#endif
+
+int main() {
+  char buf[32];
+  int xy = 7;
+  int SELF = 5;
+
+  ASSERT(3, M1);
+  ASSERT(4, M2());
+  ASSERT(7, ADD(M1, M2()));
+  ASSERT(9, ADD(ADD(1, 2), ADD(3, 3)));
+  ASSERT(0, strcmp(STR(a + b), "a + b"));
+  ASSERT(0, strcmp(STR("q"), "\"q\""));
+  ASSERT(0, strcmp(KEEP(STR(a)), "STR(a)"));
+  ASSERT(7, CAT(x, y));
+  ASSERT(12, CAT(1, 2));
+  ASSERT(2, VA("ab"));
+  ASSERT(3, VA("%d", 123));
+  ASSERT(5, SELF);
+  ASSERT(1, m1_defined);
+  ASSERT(1, undef_works);
+  ASSERT(0, skipped);
+  ASSERT(59, __LINE__);
+  ASSERT(4, sizeof(__LINE__));
+  ASSERT(1, __LINE__ % 4);
+  ASSERT(4, sizeof(CAT(1, 2)));
+  ASSERT(2, CAT(1, 2) % 5);
+  ASSERT(0, ({ sprintf(buf, "%d", CAT(1, 2)); strcmp(buf, "12"); }));
+  ASSERT(0, strcmp(__FILE__, "test/preprocess.c"));
+  ASSERT(1, __STDC__);
+
+#if L'\0' - 1 < 0 && U'\0' - 1 > 0 && u'\0' - 1 < 0 && u8'a' == 97
+  ASSERT(1, 1);
+#else
+  ASSERT(1, 0);
+#endif
+#if L'\xff' == 255 && 'a' == 97
+  ASSERT(1, 1);
+#else
+  ASSERT(1, 0);
+#endif
+
+  printf("OK\n");
+  return 0;
+}
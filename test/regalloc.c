@@ -0,0 +1,99 @@
+#include "test.h"
+
+int add2(int x, int y) {
+  return x + y;
+}
+
+double add2d(double x, double y) {
+  return x + y;
+}
+
+int many_locals(int n) {
+  int a = 1, b = 2, c = 3, d = 4, e = 5, f = 6, g = 7, h = 8;
+  for (int i = 0; i < n; i = i + 1) {
+    a = a + b;
+    b = b + c;
+    c = c + d;
+    d = d + e;
+    e = e + f;
+    f = f + g;
+    g = g + h;
+    h = h + 1;
+  }
+  return a + b + c + d + e + f + g + h;
+}
+
+int deep_expr(int a, int b, int c) {
+  return a * (b + (c * (a + (b * (c + (a + 1)))))) + add2(a, b) * add2(b, c);
+}
+
+char char_wrap(void) {
+  char x = 127;
+  x = x + 1;
+  return x;
+}
+
+unsigned char uchar_wrap(void) {
+  unsigned char x = 255;
+  x = x + 2;
+  return x;
+}
+
+short short_param(short x) {
+  short y = x;
+  y = y + 1;
+  return y;
+}
+
+long sum_ptr(long *p, int n) {
+  long sum = 0;
+  long *end = p + n;
+  while (p < end) {
+    sum = sum + *p;
+    p = p + 1;
+  }
+  return sum;
+}
+
+int addr_taken(void) {
+  int x = 3;
+  int *p = &x;
+  *p = 5;
+  return x;
+}
+
+// Twelve values live across a call, more than there are callee-saved
+// registers, so that some of them are spilled.
+int spill_across_call(int n) {
+  int a = n + 1, b = n + 2, c = n + 3, d = n + 4, e = n + 5, f = n + 6;
+  int g = n + 7, h = n + 8, i = n + 9, j = n + 10, k = n + 11, l = n + 12;
+  int z = add2(n, n);
+  return a + b + c + d + e + f + g + h + i + j + k + l + z;
+}
+
+// Floating point values live across a call are always spilled.
+double spill_double(double x) {
+  double a = x + 1, b = x + 2, c = x + 3;
+  double d = add2d(a, b);
+  return a * b + c + d;
+}
+
+int main() {
+  ASSERT(21345, many_locals(10));
+  ASSERT(225, deep_expr(2, 3, 4));
+  ASSERT(-128, char_wrap());
+  ASSERT(1, uchar_wrap());
+  ASSERT(-32768, short_param(32767));
+  ASSERT(15, ({ long a[5] = {1, 2, 3, 4, 5}; sum_ptr(a, 5); }));
+  ASSERT(5, addr_taken());
+  ASSERT(21, ({ int x = 1; x + add2(2, add2(3, add2(4, add2(5, 6)))); }));
+  ASSERT(7, ({ int x = 1; int y = 2; (x + y) * add2(x, y) - add2(x, x); }));
+  ASSERT(10, (int)({ double x = 1; x + add2d(2, add2d(3, 4)); }));
+  ASSERT(36, (int)({ double a = 1, b = 2, c = 3; a + (b + (c + (a + (b + (c + (a + (b + (c + (a + (b + (c + (a + (b + (c + (a + (b + c)))))))))))))))); }));
+  ASSERT(3, ({ int i = 2, j = 3; (i = 5, j) = 6; j - i + 2; }));
+  ASSERT(92, spill_across_call(1));
+  ASSERT(15, (int)spill_double(1));
+
+  printf("OK\n");
+  return 0;
+}
@@ -35,6 +35,12 @@ int main() {
   ASSERT(0, "\x00"[0]);
   ASSERT(119, "\x77"[0]);
 
+  ASSERT(1, "pool" == "pool");
+  ASSERT(1, "foobar" + 3 == "bar");
+  ASSERT(1, "x\0y" + 2 == "y");
+  ASSERT(0, "foobar" == "bar");
+  ASSERT(0, "foo" == "foobar");
+
   printf("OK\n");
   return 0;
 }
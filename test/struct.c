@@ -72,6 +72,13 @@ int main() {
   ASSERT(5, ((struct { int a,b,c; }){ .c=5 }).c);
   ASSERT(0, ((struct { int a,b,c; }){ .c=5 }).a);
 
+  ASSERT(23, ({ struct { char a[23]; } x, y; for (int i=0; i<23; i++) x.a[i]=i+1; y=x; y.a[22]; }));
+  ASSERT(1, ({ struct { char a[23]; } x, y; for (int i=0; i<23; i++) x.a[i]=i+1; y=x; y.a[0]; }));
+  ASSERT(40, ({ struct { long a[5]; } x, y; for (int i=0; i<5; i++) x.a[i]=i*10; y=x; y.a[4]; }));
+  ASSERT(30, ({ struct { char a[131]; } x, y; for (int i=0; i<131; i++) x.a[i]=i%100; y=x; y.a[130]; }));
+  ASSERT(0, ({ struct { int a[1024]; } x, y; for (int i=0; i<1024; i++) x.a[i]=i; y=x; memcmp(&x, &y, sizeof(x)); }));
+  ASSERT(7, ({ struct { char a[3]; } y = (struct { char a[3]; }){1,2,4}; y.a[0]+y.a[1]+y.a[2]; }));
+
   printf("OK\n");
   return 0;
 }
@@ -0,0 +1,182 @@
+#include "test.h"
+
+int dense(int x) {
+  switch (x) {
+  case 0:
+    return 10;
+  case 1:
+    return 11;
+  case 2:
+    return 12;
+  case 3:
+    return 13;
+  case 5:
+    return 15;
+  case 6:
+    return 16;
+  default:
+    return -1;
+  }
+}
+
+int sparse(int x) {
+  switch (x) {
+  case -1000:
+    return 1;
+  case -7:
+    return 2;
+  case 3:
+    return 3;
+  case 100:
+    return 4;
+  case 1000:
+    return 5;
+  case 65536:
+    return 6;
+  case 2147483647:
+    return 7;
+  }
+  return 0;
+}
+
+int mixed(int x) {
+  int r = 0;
+  switch (x) {
+  case -3:
+  case -2:
+  case -1:
+  case 0:
+    r = 1;
+    break;
+  case 500:
+    r = 2;
+  case 501:
+    r = r + 3;
+    break;
+  case 502:
+  case 503:
+    r = 4;
+    break;
+  case 100000:
+    r = 5;
+    break;
+  default:
+    r = 6;
+  }
+  return r;
+}
+
+int uswitch(unsigned x) {
+  switch (x) {
+  case 0:
+    return 1;
+  case 1:
+    return 2;
+  case 2:
+    return 3;
+  case 3:
+    return 4;
+  case 4000000000U:
+    return 5;
+  case 4000000001U:
+    return 6;
+  }
+  return 0;
+}
+
+int lswitch(long x) {
+  switch (x) {
+  case -5000000000L:
+    return 1;
+  case 5000000000L:
+    return 2;
+  case 5000000001L:
+    return 3;
+  case 5000000002L:
+    return 4;
+  case 5000000003L:
+    return 5;
+  case 7:
+    return 6;
+  }
+  return 0;
+}
+
+int ulswitch(unsigned long x) {
+  switch (x) {
+  case 1:
+    return 1;
+  case 0x8000000000000000UL:
+    return 2;
+  case 0xffffffffffffffffUL:
+    return 3;
+  case 2:
+    return 4;
+  }
+  return 0;
+}
+
+int cswitch(char c) {
+  switch (c) {
+  case 'a':
+    return 1;
+  case 'b':
+    return 2;
+  case 'c':
+    return 3;
+  case 'd':
+    return 4;
+  case -1:
+    return 5;
+  }
+  return 0;
+}
+
+int main() {
+  ASSERT(10, dense(0));
+  ASSERT(13, dense(3));
+  ASSERT(-1, dense(4));
+  ASSERT(16, dense(6));
+  ASSERT(-1, dense(7));
+  ASSERT(-1, dense(-1));
+  ASSERT(-1, dense(-2147483647 - 1));
+  ASSERT(1, sparse(-1000));
+  ASSERT(2, sparse(-7));
+  ASSERT(3, sparse(3));
+  ASSERT(4, sparse(100));
+  ASSERT(5, sparse(1000));
+  ASSERT(6, sparse(65536));
+  ASSERT(7, sparse(2147483647));
+  ASSERT(0, sparse(4));
+  ASSERT(0, sparse(-2147483647 - 1));
+  ASSERT(1, mixed(-3));
+  ASSERT(1, mixed(0));
+  ASSERT(5, mixed(500));
+  ASSERT(3, mixed(501));
+  ASSERT(4, mixed(503));
+  ASSERT(5, mixed(100000));
+  ASSERT(6, mixed(504));
+  ASSERT(6, mixed(-4));
+  ASSERT(1, uswitch(0));
+  ASSERT(4, uswitch(3));
+  ASSERT(5, uswitch(4000000000U));
+  ASSERT(6, uswitch(4000000001U));
+  ASSERT(0, uswitch(-1));
+  ASSERT(1, lswitch(-5000000000L));
+  ASSERT(3, lswitch(5000000001L));
+  ASSERT(5, lswitch(5000000003L));
+  ASSERT(6, lswitch(7));
+  ASSERT(0, lswitch(5000000004L));
+  ASSERT(0, lswitch(705032704));
+  ASSERT(1, ulswitch(1));
+  ASSERT(2, ulswitch(0x8000000000000000UL));
+  ASSERT(3, ulswitch(-1));
+  ASSERT(4, ulswitch(2));
+  ASSERT(0, ulswitch(3));
+  ASSERT(3, cswitch('c'));
+  ASSERT(5, cswitch(-1));
+  ASSERT(0, cswitch('e'));
+
+  printf("OK\n");
+  return 0;
+}
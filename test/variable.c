@@ -3,6 +3,51 @@
 int g1, g2[4];
 static int g3 = 3;
 
+typedef struct {
+  int a, b;
+} Pair;
+
+int sibling_blocks(int n) {
+  int keep[4] = {1, 2, 3, 4};
+  int sum = 0;
+  {
+    int a[8];
+    for (int i = 0; i < 8; i++)
+      a[i] = i * n;
+    sum += a[7];
+  }
+  {
+    int b[8];
+    for (int i = 0; i < 8; i++)
+      b[i] = 100;
+    sum += b[0];
+  }
+  for (int i = 0; i < 2; i++) {
+    char c[3] = {1, 2, 3};
+    sum += c[i];
+  }
+  return sum + keep[0] + keep[3];
+}
+
+int nested_blocks(void) {
+  int a = 1;
+  int sibling_blocks(int n);
+  int b[2] = {2, 3};
+  {
+    int c[2] = {4, 5};
+    {
+      int d[2] = {6, 7};
+      a += c[1] + d[0];
+    }
+    a += c[0];
+  }
+  {
+    Pair p = {8, 9};
+    a += p.b;
+  }
+  return a + b[0] + b[1];
+}
+
 int main() {
   ASSERT(3, ({ int a; a=3; a; }));
   ASSERT(3, ({ int a=3; a; }));
@@ -48,8 +93,8 @@ int main() {
   ASSERT(2, ({ int x=2; { int x=3; } int y=4; x; }));
   ASSERT(3, ({ int x=2; { x=3; } x; }));
 
-  ASSERT(7, ({ int x; int y; char z; char *a=&y; char *b=&z; b-a; }));
-  ASSERT(1, ({ int x; char y; int z; char *a=&y; char *b=&z; b-a; }));
+  ASSERT(7, ({ int x; int y; char z; char *a=&y; char *b=&z; (void)&x; b-a; }));
+  ASSERT(1, ({ int x; char y; int z; char *a=&y; char *b=&z; (void)&x; b-a; }));
 
   ASSERT(8, ({ long x; sizeof(x); }));
   ASSERT(2, ({ short x; sizeof(x); }));
@@ -67,6 +112,12 @@ int main() {
 
   ASSERT(3, g3);
 
+  ASSERT(122, sibling_blocks(2));
+  ASSERT(30, nested_blocks());
+  ASSERT(1, ({ char *p, *q; { char a[8]; p = a; } { char b[8]; q = b; } p == q; }));
+  ASSERT(0, ({ char *p, *q; { char a[8]; p = a; { char b[8]; q = b; } } p == q; }));
+  ASSERT(7, ({ Pair p = ({ Pair q = {3, 4}; q; }); int z[4] = {9, 9, 9, 9}; p.a + p.b + z[0] - 9; }));
+
   printf("OK\n");
   return 0;
 }